@@ -16,14 +16,27 @@
 
 #include "Backend.h"
 
+#include <algorithm>
 #include <climits>
 
 #include <aidl/android/hardware/graphics/composer3/Composition.h>
 #include "BackendManager.h"
 #include "bufferinfo/BufferInfoGetter.h"
+#include "compositor/DrmKmsPlan.h"
+#include "utils/properties.h"
 
 namespace android {
 
+static int ReadMaxTestCommitsProperty() {
+  char max_test_commits[PROPERTY_VALUE_MAX];
+  property_get("vendor.hwc.drm.max_test_commits", max_test_commits, "3");
+  constexpr int kStrtolBase = 10;
+  return std::max(int(strtol(max_test_commits, nullptr, kStrtolBase)), 1);
+}
+
+/* Time given to TEST_ONLY commits of a single frame */
+constexpr int64_t kTestCommitsBudgetNs = 2000000;
+
 HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
                                      uint32_t *num_requests) {
   *num_types = 0;
@@ -38,29 +51,54 @@ HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
   int client_start = -1;
   size_t client_size = 0;
 
-  if (display->ProcessClientFlatteningState(layers.size() <= 1)) {
+  /* Flattened layers are a part of the client range */
+  auto flat_size = std::get<1>(display->ProcessClientFlatteningState(layers));
+  if (flat_size != 0) {
     display->total_stats().frames_flattened_++;
-    client_start = 0;
-    client_size = layers.size();
-    MarkValidated(layers, client_start, client_size);
-  } else {
-    std::tie(client_start, client_size) = GetClientLayers(display, layers);
+    display->total_stats().layers_flattened_ += flat_size;
+  }
 
+  auto candidates = GetClientLayersCandidates(display, layers);
+
+  /* Candidates are ranked by GPU load, take the first one accepted by KMS
+   * within the budget. Full client composition needs no testing.
+   */
+  static const int max_test_commits = ReadMaxTestCommitsProperty();
+  int test_commits = 0;
+  auto deadline = ResourceManager::GetTimeMonotonicNs() + kTestCommitsBudgetNs;
+  bool found = false;
+
+  for (auto &[start, size] : candidates) {
+    client_start = start;
+    client_size = size;
     MarkValidated(layers, client_start, client_size);
 
-    bool testing_needed = !(client_start == 0 && client_size == layers.size());
+    if (client_start == 0 && client_size == layers.size()) {
+      found = true;
+      break;
+    }
 
-    AtomicCommitArgs a_args = {.test_only = true};
+    if (test_commits >= max_test_commits ||
+        (test_commits > 0 &&
+         ResourceManager::GetTimeMonotonicNs() > deadline)) {
+      break;
+    }
 
-    if (testing_needed &&
-        display->CreateComposition(a_args) != HWC2::Error::None) {
-      ++display->total_stats().failed_kms_validate_;
-      client_start = 0;
-      client_size = layers.size();
-      MarkValidated(layers, 0, client_size);
+    test_commits++;
+    AtomicCommitArgs a_args = {.test_only = true};
+    if (display->CreateComposition(a_args) == HWC2::Error::None) {
+      found = true;
+      break;
     }
   }
 
+  if (!found) {
+    ++display->total_stats().failed_kms_validate_;
+    client_start = 0;
+    client_size = layers.size();
+    MarkValidated(layers, 0, client_size);
+  }
+
   *num_types = client_size;
 
   display->total_stats().gpu_pixops_ += CalcPixOps(layers, client_start,
@@ -70,8 +108,9 @@ HWC2::Error Backend::ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
   return *num_types != 0 ? HWC2::Error::HasChanges : HWC2::Error::None;
 }
 
-std::tuple<int, size_t> Backend::GetClientLayers(
-    HwcDisplay *display, const std::vector<HwcLayer *> &layers) {
+auto Backend::GetClientLayersCandidates(HwcDisplay *display,
+                                        const std::vector<HwcLayer *> &layers)
+    -> std::vector<std::tuple<int, size_t>> {
   int client_start = -1;
   size_t client_size = 0;
 
@@ -83,11 +122,12 @@ std::tuple<int, size_t> Backend::GetClientLayers(
     }
   }
 
-  return GetExtraClientRange(display, layers, client_start, client_size);
+  return GetClientRangeCandidates(display, layers, client_start, client_size);
 }
 
 bool Backend::IsClientLayer(HwcDisplay *display, HwcLayer *layer) {
-  return !HardwareSupportsLayerType(layer->GetSfType()) ||
+  return layer->IsFlattened() ||
+         !HardwareSupportsLayerType(layer->GetSfType()) ||
          !layer->IsLayerUsableAsDevice() ||
          display->color_transform_hint() != HAL_COLOR_TRANSFORM_IDENTITY ||
          (layer->GetLayerData().pi.RequireScalingOrPhasing() &&
@@ -121,49 +161,105 @@ void Backend::MarkValidated(std::vector<HwcLayer *> &layers,
   }
 }
 
-std::tuple<int, int> Backend::GetExtraClientRange(
-    HwcDisplay *display, const std::vector<HwcLayer *> &layers,
-    int client_start, size_t client_size) {
+auto Backend::GetClientRangeCandidates(HwcDisplay *display,
+                                       const std::vector<HwcLayer *> &layers,
+                                       int client_start, size_t client_size)
+    -> std::vector<std::tuple<int, size_t>> {
   auto planes = display->GetPipe().GetUsablePlanes();
-  size_t avail_planes = planes.size();
 
-  /*
-   * If more layers then planes, save one plane
-   * for client composited layers
+  /* The last element represents the client target */
+  std::vector<LayerData *> layers_data;
+  layers_data.reserve(layers.size() + 1);
+  for (auto *layer : layers) {
+    layers_data.emplace_back(&layer->GetLayerData());
+  }
+  layers_data.emplace_back(&display->GetClientLayer().GetLayerData());
+
+  auto caps = DrmKmsPlan::GetPlaneCaps(planes, layers_data);
+
+  /* Checks whether device layers outside of the client range along with the
+   * client target can be mapped to the planes
    */
-  if (avail_planes < display->layers().size())
-    avail_planes--;
-
-  int extra_client = int(layers.size() - client_size) - int(avail_planes);
-
-  if (extra_client > 0) {
-    int start = 0;
-    size_t steps = 0;
-    if (client_size != 0) {
-      int prepend = std::min(client_start, extra_client);
-      int append = std::min(int(layers.size()) -
-                                int(client_start + client_size),
-                            extra_client);
-      start = client_start - (int)prepend;
-      client_size += extra_client;
-      steps = 1 + std::min(std::min(append, prepend),
-                           int(layers.size()) - int(start + client_size));
-    } else {
-      client_size = extra_client;
-      steps = 1 + layers.size() - extra_client;
+  auto is_feasible = [&](size_t start, size_t size) {
+    size_t layers_num = layers.size() - size + (size != 0 ? 1 : 0);
+    if (layers_num > planes.size()) {
+      return false;
     }
 
-    uint32_t gpu_pixops = UINT32_MAX;
-    for (size_t i = 0; i < steps; i++) {
-      uint32_t po = CalcPixOps(layers, start + i, client_size);
-      if (po < gpu_pixops) {
-        gpu_pixops = po;
-        client_start = start + int(i);
+    std::vector<DrmKmsPlan::PlaneCaps> window_caps(caps.size());
+    for (size_t p = 0; p < caps.size(); p++) {
+      window_caps[p].fixed_zpos = caps[p].fixed_zpos;
+      for (size_t z_order = 0; z_order < layers.size(); z_order++) {
+        if (size != 0 && z_order == start) {
+          window_caps[p].valid_for_layer.emplace_back(
+              caps[p].valid_for_layer[layers.size()]);
+        }
+        if (size == 0 || z_order < start || z_order >= start + size) {
+          window_caps[p].valid_for_layer.emplace_back(
+              caps[p].valid_for_layer[z_order]);
+        }
       }
     }
+
+    return DrmKmsPlan::AssignPlanes(layers_num, window_caps).has_value();
+  };
+
+  struct Candidate {
+    uint32_t gpu_pixops;
+    size_t size;
+    int start;
+  };
+  std::vector<Candidate> candidates;
+
+  /* Every candidate range has to contain the mandatory client layers */
+  size_t first_start = 0;
+  size_t last_end = 0;
+  if (client_size != 0) {
+    first_start = client_start;
+    last_end = client_start + client_size;
+  } else {
+    if (is_feasible(0, 0)) {
+      candidates.emplace_back(Candidate{0, 0, client_start});
+    }
+    first_start = layers.empty() ? 0 : layers.size() - 1;
+  }
+
+  for (size_t start = 0; start <= first_start; start++) {
+    for (size_t end = std::max(last_end, start + 1); end <= layers.size();
+         end++) {
+      if (is_feasible(start, end - start)) {
+        candidates.emplace_back(Candidate{CalcPixOps(layers, start,
+                                                     end - start),
+                                          end - start, int(start)});
+      }
+    }
+  }
+
+  /* Prefer the ranges leaving the most pixels to the planes */
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate &a, const Candidate &b) {
+                     return std::tie(a.gpu_pixops, a.size) <
+                            std::tie(b.gpu_pixops, b.size);
+                   });
+
+  std::vector<std::tuple<int, size_t>> ranges;
+  ranges.reserve(candidates.size() + 1);
+  for (auto &c : candidates) {
+    ranges.emplace_back(c.start, c.size);
+  }
+
+  /* Full client composition is always possible */
+  if (!layers.empty() &&
+      (candidates.empty() || candidates.back().start != 0 ||
+       candidates.back().size != layers.size())) {
+    ranges.emplace_back(0, layers.size());
+  }
+
+  if (ranges.empty()) {
+    ranges.emplace_back(client_start, client_size);
   }
 
-  return std::make_tuple(client_start, client_size);
+  return ranges;
 }
 
 // clang-format off
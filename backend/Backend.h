@@ -26,9 +26,11 @@ class Backend {
   virtual ~Backend() = default;
   virtual HWC2::Error ValidateDisplay(HwcDisplay *display, uint32_t *num_types,
                                       uint32_t *num_requests);
-  virtual std::tuple<int, size_t> GetClientLayers(
-      HwcDisplay *display, const std::vector<HwcLayer *> &layers);
   virtual bool IsClientLayer(HwcDisplay *display, HwcLayer *layer);
+  /* Client ranges {start, size} ranked from the lowest GPU load */
+  virtual auto GetClientLayersCandidates(HwcDisplay *display,
+                                         const std::vector<HwcLayer *> &layers)
+      -> std::vector<std::tuple<int, size_t>>;
 
  protected:
   static bool HardwareSupportsLayerType(HWC2::Composition comp_type);
@@ -36,9 +38,10 @@ class Backend {
                              size_t first_z, size_t size);
   static void MarkValidated(std::vector<HwcLayer *> &layers,
                             size_t client_first_z, size_t client_size);
-  static std::tuple<int, int> GetExtraClientRange(
-      HwcDisplay *display, const std::vector<HwcLayer *> &layers,
-      int client_start, size_t client_size);
+  static auto GetClientRangeCandidates(HwcDisplay *display,
+                                       const std::vector<HwcLayer *> &layers,
+                                       int client_start, size_t client_size)
+      -> std::vector<std::tuple<int, size_t>>;
 };
 }  // namespace android
 
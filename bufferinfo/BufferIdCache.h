@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BUFFERIDCACHE_H_
+#define ANDROID_BUFFERIDCACHE_H_
+
+#include <cutils/native_handle.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace android {
+
+/*
+ * Unique ids of the buffer handles seen recently, resolved without a syscall.
+ *
+ * The composer (ComposerResources of the HWC3 service) imports a buffer
+ * once per slot and then passes the same handle until the slot is
+ * replaced. The replaced handle is freed, and its address, file
+ * descriptors and gralloc ints may all be taken by the next import, so
+ * nothing in the handle tells a new buffer apart. The composer therefore
+ * tells whether the handle is a reused one. A newly imported handle drops
+ * the entry of its address.
+ */
+class BufferIdCache {
+ public:
+  static constexpr size_t kCapacity = 8;
+
+  auto Find(buffer_handle_t handle, bool reused) -> std::optional<uint64_t> {
+    auto *entry = FindEntry(handle);
+    if (entry == nullptr) {
+      return {};
+    }
+
+    if (!reused) {
+      *entry = {};
+      return {};
+    }
+
+    entry->last_used = ++use_counter_;
+    return entry->id;
+  }
+
+  /* Replaces the entry of the handle or the least recently used one */
+  void Add(buffer_handle_t handle, uint64_t id) {
+    auto *entry = FindEntry(handle);
+    if (entry == nullptr) {
+      entry = &*std::min_element(entries_.begin(), entries_.end(),
+                                 [](auto &a, auto &b) {
+                                   return a.last_used < b.last_used;
+                                 });
+    }
+    entry->handle = handle;
+    entry->id = id;
+    entry->last_used = ++use_counter_;
+  }
+
+  void Clear() {
+    entries_ = {};
+  }
+
+ private:
+  struct Entry {
+    buffer_handle_t handle{};
+    uint64_t id{};
+    uint64_t last_used{};
+  };
+
+  auto FindEntry(buffer_handle_t handle) -> Entry * {
+    if (handle == nullptr) {
+      return nullptr;
+    }
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+                           [handle](auto &e) { return e.handle == handle; });
+    return it != entries_.end() ? &*it : nullptr;
+  }
+
+  std::array<Entry, kCapacity> entries_;
+  uint64_t use_counter_{};
+};
+
+}  // namespace android
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BUFFERINFOCACHE_H_
+#define ANDROID_BUFFERINFOCACHE_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "BufferInfo.h"
+
+namespace android {
+
+/*
+ * Buffer metadata decoded from gralloc, by the buffer unique id. A buffer
+ * shown by several layers or displays (mirroring, screen recording) is
+ * decoded once.
+ *
+ * The records don't hold the prime fds, which belong to the handle the
+ * buffer was decoded from and are closed together with it.
+ */
+class BufferInfoCache {
+ public:
+  static constexpr size_t kCapacity = 64;
+
+  auto Get(uint64_t unique_id) -> std::shared_ptr<const BufferInfo> {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find(ids_.begin(), ids_.end(), unique_id);
+    if (unique_id == 0 || it == ids_.end()) {
+      return {};
+    }
+
+    auto &entry = entries_[it - ids_.begin()];
+    entry.last_used = ++use_counter_;
+    return entry.bi;
+  }
+
+  /* Replaces the least recently used record */
+  void Put(uint64_t unique_id, std::shared_ptr<const BufferInfo> bi) {
+    if (unique_id == 0) {
+      return;
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find(ids_.begin(), ids_.end(), unique_id);
+    if (it == ids_.end()) {
+      it = ids_.begin() +
+           (std::min_element(entries_.begin(), entries_.end(),
+                             [](auto &a, auto &b) {
+                               return a.last_used < b.last_used;
+                             }) -
+            entries_.begin());
+    }
+
+    *it = unique_id;
+    auto &entry = entries_[it - ids_.begin()];
+    entry.bi = std::move(bi);
+    entry.last_used = ++use_counter_;
+  }
+
+ private:
+  struct Entry {
+    std::shared_ptr<const BufferInfo> bi;
+    uint64_t last_used{};
+  };
+
+  std::mutex mutex_;
+  /* Ids are kept apart to be scanned quickly, 0 marks a free entry */
+  std::array<uint64_t, kCapacity> ids_{};
+  std::array<Entry, kCapacity> entries_;
+  uint64_t use_counter_{};
+};
+
+}  // namespace android
+
+#endif
@@ -40,6 +40,15 @@ class BufferInfoGetter {
   virtual auto GetBoInfo(buffer_handle_t handle)
       -> std::optional<BufferInfo> = 0;
 
+  /* Same as GetBoInfo(), the getter may reuse the metadata decoded for the
+   * same buffer before.
+   */
+  virtual auto GetCachedBoInfo(buffer_handle_t handle,
+                               BufferUniqueId /*unique_id*/)
+      -> std::optional<BufferInfo> {
+    return GetBoInfo(handle);
+  }
+
   virtual std::optional<BufferUniqueId> GetUniqueId(buffer_handle_t handle);
 
   static BufferInfoGetter *GetInstance();
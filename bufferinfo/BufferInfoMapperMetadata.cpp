@@ -86,7 +86,7 @@ BufferInfoMapperMetadata::GetFds(buffer_handle_t handle, BufferInfo *bo) {
   return 0;
 }
 
-auto BufferInfoMapperMetadata::GetBoInfo(buffer_handle_t handle)
+auto BufferInfoMapperMetadata::GetMetadata(buffer_handle_t handle)
     -> std::optional<BufferInfo> {
   GraphicBufferMapper &mapper = GraphicBufferMapper::getInstance();
   if (handle == nullptr)
@@ -136,7 +136,40 @@ auto BufferInfoMapperMetadata::GetBoInfo(buffer_handle_t handle)
     bi.sizes[i] = layouts[i].totalSizeInBytes;
   }
 
-  err = GetFds(handle, &bi);
+  return bi;
+}
+
+auto BufferInfoMapperMetadata::GetBoInfo(buffer_handle_t handle)
+    -> std::optional<BufferInfo> {
+  auto bi = GetMetadata(handle);
+  if (!bi) {
+    return {};
+  }
+
+  int err = GetFds(handle, &bi.value());
+  if (err != 0) {
+    ALOGE("Failed to get fds (err=%d)", err);
+    return {};
+  }
+
+  return bi;
+}
+
+auto BufferInfoMapperMetadata::GetCachedBoInfo(buffer_handle_t handle,
+                                               BufferUniqueId unique_id)
+    -> std::optional<BufferInfo> {
+  auto metadata = metadata_cache_.Get(unique_id);
+  if (!metadata) {
+    auto bi = GetMetadata(handle);
+    if (!bi) {
+      return {};
+    }
+    metadata = std::make_shared<const BufferInfo>(*bi);
+    metadata_cache_.Put(unique_id, metadata);
+  }
+
+  BufferInfo bi = *metadata;
+  int err = GetFds(handle, &bi);
   if (err != 0) {
     ALOGE("Failed to get fds (err=%d)", err);
     return {};
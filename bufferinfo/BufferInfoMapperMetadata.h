@@ -17,6 +17,7 @@
 #ifndef PLATFORMIMAGINATION_H
 #define PLATFORMIMAGINATION_H
 
+#include "bufferinfo/BufferInfoCache.h"
 #include "bufferinfo/BufferInfoGetter.h"
 
 namespace android {
@@ -27,9 +28,18 @@ class BufferInfoMapperMetadata : public BufferInfoGetter {
 
   auto GetBoInfo(buffer_handle_t handle) -> std::optional<BufferInfo> override;
 
+  auto GetCachedBoInfo(buffer_handle_t handle, BufferUniqueId unique_id)
+      -> std::optional<BufferInfo> override;
+
   int GetFds(buffer_handle_t handle, BufferInfo *bo);
 
   static BufferInfoGetter *CreateInstance();
+
+ private:
+  /* All the mapper queries of the buffer, the fds are not set */
+  static auto GetMetadata(buffer_handle_t handle) -> std::optional<BufferInfo>;
+
+  BufferInfoCache metadata_cache_;
 };
 }  // namespace android
 
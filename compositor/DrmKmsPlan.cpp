@@ -18,11 +18,122 @@
 
 #include "DrmKmsPlan.h"
 
+#include <set>
+#include <tuple>
+
 #include "drm/DrmDevice.h"
 #include "drm/DrmPlane.h"
 #include "utils/log.h"
 
 namespace android {
+
+namespace {
+class PlaneAssignmentSolver {
+ public:
+  PlaneAssignmentSolver(size_t layers_num,
+                        const std::vector<DrmKmsPlan::PlaneCaps> &planes)
+      : layers_num_(layers_num), planes_(planes) {
+  }
+
+  auto Solve() -> std::optional<std::vector<size_t>> {
+    assignment_.clear();
+    failed_states_.clear();
+
+    if (layers_num_ > planes_.size() || planes_.size() > kMaxPlanes) {
+      return {};
+    }
+
+    if (!Search(0, 0, 0)) {
+      return {};
+    }
+
+    return assignment_;
+  }
+
+ private:
+  static constexpr size_t kMaxPlanes = 64;
+
+  /* Depth-first search over layers in z-order. States already proven to be
+   * dead ends are remembered, which keeps the search polynomial in practice
+   * for the plane counts found on real hardware.
+   */
+  auto Search(size_t layer, uint64_t used_mask, size_t min_plane) -> bool {
+    if (layer == layers_num_) {
+      return true;
+    }
+
+    auto state = std::make_tuple(layer, used_mask, min_plane);
+    if (failed_states_.count(state) != 0) {
+      return false;
+    }
+
+    for (size_t plane = min_plane; plane < planes_.size(); plane++) {
+      auto &caps = planes_[plane];
+      uint64_t plane_bit = uint64_t(1) << plane;
+      if ((used_mask & plane_bit) != 0 ||
+          layer >= caps.valid_for_layer.size() ||
+          !caps.valid_for_layer[layer]) {
+        continue;
+      }
+
+      /* Plane which can't be restacked must be above all the planes used by
+       * the layers below and below all the planes used by the layers above.
+       */
+      size_t next_min_plane = min_plane;
+      if (caps.fixed_zpos) {
+        if (used_mask >= plane_bit) {
+          continue;
+        }
+        next_min_plane = plane + 1;
+      }
+
+      assignment_.emplace_back(plane);
+      if (Search(layer + 1, used_mask | plane_bit, next_min_plane)) {
+        return true;
+      }
+      assignment_.pop_back();
+    }
+
+    failed_states_.emplace(state);
+    return false;
+  }
+
+  const size_t layers_num_;
+  const std::vector<DrmKmsPlan::PlaneCaps> &planes_;
+  std::vector<size_t> assignment_;
+  std::set<std::tuple<size_t, uint64_t, size_t>> failed_states_;
+};
+}  // namespace
+
+auto DrmKmsPlan::AssignPlanes(size_t layers_num,
+                              const std::vector<PlaneCaps> &planes)
+    -> std::optional<std::vector<size_t>> {
+  return PlaneAssignmentSolver(layers_num, planes).Solve();
+}
+
+auto DrmKmsPlan::GetPlaneCaps(
+    const std::vector<std::shared_ptr<BindingOwner<DrmPlane>>> &planes,
+    const std::vector<LayerData *> &layers) -> std::vector<PlaneCaps> {
+  std::vector<PlaneCaps> caps(planes.size());
+
+  for (size_t i = 0; i < planes.size(); i++) {
+    auto *plane = planes[i]->Get();
+    auto &zpos = plane->GetZPosProperty();
+    caps[i].fixed_zpos = !zpos || zpos.is_immutable();
+
+    caps[i].valid_for_layer.resize(layers.size());
+    for (size_t l = 0; l < layers.size(); l++) {
+      /* Buffer information is not known before the first import, let the
+       * TEST_ONLY commit decide in that case.
+       */
+      caps[i].valid_for_layer[l] = !layers[l]->bi ||
+                                   plane->IsValidForLayer(layers[l]);
+    }
+  }
+
+  return caps;
+}
+
 auto DrmKmsPlan::CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
                                   std::vector<LayerData> composition)
     -> std::unique_ptr<DrmKmsPlan> {
@@ -30,23 +141,25 @@ auto DrmKmsPlan::CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
 
   auto avail_planes = pipe.GetUsablePlanes();
 
-  int z_pos = 0;
+  std::vector<LayerData *> layers;
+  layers.reserve(composition.size());
   for (auto &dhl : composition) {
-    std::shared_ptr<BindingOwner<DrmPlane>> plane;
-
-    /* Skip unsupported planes */
-    do {
-      if (avail_planes.empty()) {
-        return {};
-      }
+    layers.emplace_back(&dhl);
+  }
 
-      plane = *avail_planes.begin();
-      avail_planes.erase(avail_planes.begin());
-    } while (!plane->Get()->IsValidForLayer(&dhl));
+  auto assignment = AssignPlanes(composition.size(),
+                                 GetPlaneCaps(avail_planes, layers));
+  if (!assignment) {
+    ALOGV("Unable to map %zu layers to %zu planes", composition.size(),
+          avail_planes.size());
+    return {};
+  }
 
+  int z_pos = 0;
+  for (size_t i = 0; i < composition.size(); i++) {
     LayerToPlaneJoining joining = {
-        .layer = std::move(dhl),
-        .plane = plane,
+        .layer = std::move(composition[i]),
+        .plane = avail_planes[(*assignment)[i]],
         .z_pos = z_pos++,
     };
 
@@ -17,7 +17,9 @@
 #ifndef ANDROID_DRM_KMS_PLAN_H_
 #define ANDROID_DRM_KMS_PLAN_H_
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "LayerData.h"
@@ -38,6 +40,30 @@ struct DrmKmsPlan {
   static auto CreateDrmKmsPlan(DrmDisplayPipeline &pipe,
                                std::vector<LayerData> composition)
       -> std::unique_ptr<DrmKmsPlan>;
+
+  /* Layer-to-plane matching problem. Kept free of DRM objects to allow
+   * testing the allocator with synthetic plane capability tables.
+   */
+  struct PlaneCaps {
+    /* Layers (in z-order) this plane is able to scan out */
+    std::vector<bool> valid_for_layer;
+    /* Plane can't be restacked (immutable or missing zpos property) */
+    bool fixed_zpos{};
+  };
+
+  /* Returns plane index for every layer or std::nullopt if layers can't be
+   * mapped to planes. Planes with fixed zpos are never stacked against the
+   * order of the plane list. Among all valid assignments the one using the
+   * lowest plane indices for the bottom layers is returned, so the result is
+   * deterministic.
+   */
+  static auto AssignPlanes(size_t layers_num,
+                           const std::vector<PlaneCaps> &planes)
+      -> std::optional<std::vector<size_t>>;
+
+  static auto GetPlaneCaps(
+      const std::vector<std::shared_ptr<BindingOwner<DrmPlane>>> &planes,
+      const std::vector<LayerData *> &layers) -> std::vector<PlaneCaps>;
 };
 
 }  // namespace android
@@ -27,6 +27,7 @@
 
 #include "bufferinfo/BufferInfo.h"
 #include "drm/DrmFbImporter.h"
+#include "utils/DamageTracker.h"
 #include "utils/UniqueFd.h"
 
 namespace android {
@@ -68,6 +69,8 @@ struct LayerData {
     clonned.bi = bi;
     clonned.fb = fb;
     clonned.pi = pi;
+    clonned.damage = damage;
+    clonned.damage_source = damage_source;
     clonned.acquire_fence = std::move(acquire_fence);
     return clonned;
   }
@@ -75,6 +78,14 @@ struct LayerData {
   std::optional<BufferInfo> bi;
   std::shared_ptr<DrmFbIdHandle> fb;
   PresentInfo pi;
+  /* Area of the buffer changed since the plane scanned it out last time,
+   * empty if the buffer is the one presented with the previous frame.
+   */
+  Damage damage;
+  /* Layer the damage is tracked by, the plane applies it only if it showed
+   * the same layer with the previous frame. 0 if unknown.
+   */
+  uint64_t damage_source{};
   UniqueFd acquire_fence;
 };
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-color-adjustment"
+
+#include "ColorAdjustmentWatcher.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "utils/log.h"
+
+namespace android {
+
+constexpr int kAndroidPriorityBackground = 10;
+constexpr char kColorDir[] = "/data/vendor/color";
+constexpr int kMinRetryMs = 1000;
+constexpr int kMaxRetryMs = 60000;
+
+ColorAdjustmentWatcher::ColorAdjustmentWatcher()
+    : Worker("color-adjustment", kAndroidPriorityBackground) {
+}
+
+ColorAdjustmentWatcher::~ColorAdjustmentWatcher() {
+  if (wake_fd_) {
+    uint64_t value = 1;
+    if (write(wake_fd_.Get(), &value, sizeof(value)) != sizeof(value)) {
+      ALOGE("Failed to wake up the color watcher, errno: %d", errno);
+    }
+  }
+  Exit();
+}
+
+auto ColorAdjustmentWatcher::Init() -> int {
+  Reload();
+
+  inotify_fd_ = UniqueFd(inotify_init1(IN_CLOEXEC));
+  wake_fd_ = UniqueFd(eventfd(0, EFD_CLOEXEC));
+  if (!inotify_fd_ || !wake_fd_) {
+    ALOGE("Failed to create the color watcher, errno: %d", errno);
+    return -errno;
+  }
+
+  if (!AddWatch()) {
+    ALOGW("Unable to watch %s, errno: %d, retrying", kColorDir, errno);
+  }
+
+  return InitWorker();
+}
+
+auto ColorAdjustmentWatcher::AddWatch() -> bool {
+  watch_ = inotify_add_watch(inotify_fd_.Get(), kColorDir,
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+  if (watch_ < 0) {
+    retry_ms_ = retry_ms_ == 0 ? kMinRetryMs
+                               : std::min(retry_ms_ * 2, kMaxRetryMs);
+    return false;
+  }
+
+  retry_ms_ = 0;
+  return true;
+}
+
+auto ColorAdjustmentWatcher::Get() -> ColorAdjustment {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return adjustment_;
+}
+
+/* Returns -ENOENT if the setting file is not present */
+static auto ReadSetting(const char *name, std::string &value) -> int {
+  auto path = std::string(kColorDir) + "/" + name;
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    return -ENOENT;
+  }
+
+  std::array<char, 16> buf{};
+  auto read_bytes = fread(buf.data(), 1, buf.size() - 1, file);
+  fclose(file);
+  if (read_bytes == 0) {
+    ALOGE("COLOR_ fread %s error", name);
+    return -EIO;
+  }
+
+  value = buf.data();
+  return 0;
+}
+
+/* 0 - 255 per channel, out of range values are neutral */
+static auto ToChannels(int value) -> uint32_t {
+  constexpr uint32_t kNeutral = 0x80;
+  constexpr int kMax = 0xFF;
+  auto c = value < 0 || value > kMax ? kNeutral : uint32_t(value);
+  return (c << 16) | (c << 8) | c;
+}
+
+void ColorAdjustmentWatcher::Reload() {
+  /* Missing settings are neutral, unreadable ones are left as they were */
+  auto previous = Get();
+  ColorAdjustment adjustment{};
+  std::string value;
+
+  int ret = ReadSetting("saturation", value);
+  if (ret == 0) {
+    auto saturation = atof(value.c_str()) / 100;
+    adjustment.saturation = saturation < 0.75 || saturation > 1.25 ? 1.0
+                                                                   : saturation;
+  } else if (ret != -ENOENT) {
+    adjustment.saturation = previous.saturation;
+  }
+
+  ret = ReadSetting("hue", value);
+  if (ret == 0) {
+    auto hue = atof(value.c_str());
+    adjustment.hue = hue < 0.0 || hue > 359.0 ? 0.0 : hue;
+  } else if (ret != -ENOENT) {
+    adjustment.hue = previous.hue;
+  }
+
+  ret = ReadSetting("brightness", value);
+  if (ret == 0) {
+    adjustment.brightness_c = ToChannels(atoi(value.c_str()));
+  } else if (ret != -ENOENT) {
+    adjustment.brightness_c = previous.brightness_c;
+  }
+
+  ret = ReadSetting("contrast", value);
+  if (ret == 0) {
+    adjustment.contrast_c = ToChannels(atoi(value.c_str()));
+  } else if (ret != -ENOENT) {
+    adjustment.contrast_c = previous.contrast_c;
+  }
+
+  /* The commits re-apply the color state on a new generation only */
+  if (GetGeneration() != 0 && adjustment == previous) {
+    return;
+  }
+
+  ALOGD("COLOR_ hue=%f saturation=%f brightness=0x%6x contrast=0x%6x",
+        adjustment.hue, adjustment.saturation, adjustment.brightness_c,
+        adjustment.contrast_c);
+
+  Lock();
+  adjustment_ = adjustment;
+  generation_.fetch_add(1, std::memory_order_release);
+  Unlock();
+}
+
+void ColorAdjustmentWatcher::Routine() {
+  std::array<struct pollfd, 2> fds{};
+  fds[0].fd = inotify_fd_.Get();
+  fds[0].events = POLLIN;
+  fds[1].fd = wake_fd_.Get();
+  fds[1].events = POLLIN;
+
+  int ret = poll(fds.data(), fds.size(), watch_ < 0 ? retry_ms_ : -1);
+  if (ret < 0) {
+    if (errno != EINTR) {
+      ALOGE("Failed to wait for color setting changes, errno: %d", errno);
+    }
+    return;
+  }
+
+  /* Only written on exit */
+  if ((fds[1].revents & POLLIN) != 0) {
+    return;
+  }
+
+  if (ret == 0) {
+    /* The settings may have been created without the watch */
+    if (AddWatch()) {
+      ALOGI("Watching %s", kColorDir);
+    }
+    Reload();
+    return;
+  }
+
+  /* Any number of changes results in a single reload */
+  alignas(struct inotify_event) std::array<char, 4096> events{};
+  auto len = read(inotify_fd_.Get(), events.data(), events.size());
+  if (len < 0) {
+    ALOGE("Failed to read inotify events, errno: %d", errno);
+    return;
+  }
+
+  for (ssize_t i = 0; i < len;) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto *event = reinterpret_cast<const struct inotify_event *>(
+        &events[i]);
+    /* The directory is gone (removed or unmounted) */
+    if ((event->mask & IN_IGNORED) != 0 && event->wd == watch_) {
+      ALOGW("Lost the watch of %s, retrying", kColorDir);
+      AddWatch();
+    }
+    i += ssize_t(sizeof(struct inotify_event) + event->len);
+  }
+
+  Reload();
+}
+
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_COLOR_ADJUSTMENT_WATCHER_H_
+#define ANDROID_COLOR_ADJUSTMENT_WATCHER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "utils/UniqueFd.h"
+#include "utils/Worker.h"
+
+namespace android {
+
+/* User color settings, see ColorAdjustmentWatcher */
+struct ColorAdjustment {
+  /* Degrees */
+  double hue = 0.0;
+  double saturation = 1.0;
+  /* Per channel 0xRRGGBB, 0x80 is neutral */
+  uint32_t brightness_c = 0x808080;
+  uint32_t contrast_c = 0x808080;
+
+  auto operator==(const ColorAdjustment &other) const -> bool {
+    return hue == other.hue && saturation == other.saturation &&
+           brightness_c == other.brightness_c &&
+           contrast_c == other.contrast_c;
+  }
+};
+
+/*
+ * Loads the color settings from the files under /data/vendor/color once and
+ * reloads them whenever the files change, so that the present path only
+ * checks the generation.
+ *
+ * The directory may not exist yet (or /data may not be mounted) when the
+ * HWC starts, or may be removed later. The watch is then retried with a
+ * backoff, reloading the settings on every attempt.
+ */
+class ColorAdjustmentWatcher : public Worker {
+ public:
+  ColorAdjustmentWatcher();
+  ~ColorAdjustmentWatcher() override;
+  ColorAdjustmentWatcher(const ColorAdjustmentWatcher &) = delete;
+  ColorAdjustmentWatcher(ColorAdjustmentWatcher &&) = delete;
+  auto operator=(const ColorAdjustmentWatcher &) = delete;
+  auto operator=(ColorAdjustmentWatcher &&) = delete;
+
+  auto Init() -> int;
+
+  /* Bumped whenever the settings change, never 0 */
+  auto GetGeneration() const -> uint64_t {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  auto Get() -> ColorAdjustment;
+
+ protected:
+  void Routine() override;
+
+ private:
+  void Reload();
+  auto AddWatch() -> bool;
+
+  UniqueFd inotify_fd_;
+  UniqueFd wake_fd_;
+  /* Worker thread only */
+  int watch_ = -1;
+  int retry_ms_{};
+
+  ColorAdjustment adjustment_;
+  std::atomic<uint64_t> generation_{};
+};
+
+}  // namespace android
+
+#endif
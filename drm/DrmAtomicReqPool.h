@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DRM_ATOMIC_REQ_POOL_H_
+#define ANDROID_DRM_ATOMIC_REQ_POOL_H_
+
+#include <xf86drmMode.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "DrmUnique.h"
+
+namespace android {
+
+/*
+ * Atomic requests reused between the commits of a pipeline.
+ *
+ * libdrm grows the item array of a request by reallocating it while the
+ * properties are added. A pooled request is rewound instead of freed, so it
+ * keeps its array, which is grown up front to the expected number of
+ * properties.
+ */
+class DrmAtomicReqPool {
+ public:
+  explicit DrmAtomicReqPool(int capacity) : capacity_(capacity) {
+    free_.reserve(kMaxFree);
+  }
+
+  ~DrmAtomicReqPool() {
+    for (auto *req : free_) {
+      drmModeAtomicFree(req);
+    }
+  }
+
+  DrmAtomicReqPool(const DrmAtomicReqPool &) = delete;
+  DrmAtomicReqPool(DrmAtomicReqPool &&) = delete;
+  auto operator=(const DrmAtomicReqPool &) = delete;
+  auto operator=(DrmAtomicReqPool &&) = delete;
+
+  /* Empty request, returned to the pool once released. Must not outlive the
+   * pool.
+   */
+  auto Get() -> DrmModeAtomicReqUnique {
+    drmModeAtomicReq *req = nullptr;
+    if (!free_.empty()) {
+      req = free_.back();
+      free_.pop_back();
+    } else {
+      req = Allocate();
+    }
+
+    return {req, [this](drmModeAtomicReq *it) { Put(it); }};
+  }
+
+ private:
+  static constexpr size_t kMaxFree = 4;
+
+  auto Allocate() -> drmModeAtomicReq * {
+    auto *req = drmModeAtomicAlloc();
+    if (req == nullptr) {
+      return nullptr;
+    }
+
+    /* Items beyond the cursor are never committed */
+    for (int i = 0; i < capacity_; i++) {
+      if (drmModeAtomicAddProperty(req, UINT32_MAX, UINT32_MAX, 0) < 0) {
+        break;
+      }
+    }
+    drmModeAtomicSetCursor(req, 0);
+
+    return req;
+  }
+
+  void Put(drmModeAtomicReq *req) {
+    if (req == nullptr) {
+      return;
+    }
+
+    if (free_.size() >= kMaxFree) {
+      drmModeAtomicFree(req);
+      return;
+    }
+
+    drmModeAtomicSetCursor(req, 0);
+    free_.emplace_back(req);
+  }
+
+  const int capacity_;
+  std::vector<drmModeAtomicReq *> free_;
+};
+
+}  // namespace android
+
+#endif
@@ -24,29 +24,71 @@
 #include <drm/drm_mode.h>
 #include <pthread.h>
 #include <sched.h>
-#include <sync/sync.h>
 #include <utils/Trace.h>
 
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <sstream>
 #include <vector>
 
 #include "drm/DrmCrtc.h"
 #include "drm/DrmDevice.h"
+#include "drm/DrmEventDispatcher.h"
 #include "drm/DrmPlane.h"
 #include "drm/DrmUnique.h"
+#include "utils/GammaLut.h"
 #include "utils/log.h"
 
 namespace android {
 
+auto DrmAtomicStateManager::GetAtomicPropertiesMax(DrmDisplayPipeline &pipe)
+    -> int {
+  int planes_num = 0;
+  for (const auto &plane : pipe.device->GetPlanes()) {
+    if (plane->IsCrtcSupported(*pipe.crtc->Get())) {
+      planes_num++;
+    }
+  }
+
+  return kCrtcPropertiesMax +
+         planes_num * int(DrmPlane::GetAtomicPropertiesMax());
+}
+
+DrmAtomicStateManager::DrmAtomicStateManager(DrmDisplayPipeline *pipe)
+    : pipe_(pipe),
+      atomic_req_pool_(GetAtomicPropertiesMax(*pipe)),
+      flip_tracker_(std::make_shared<FlipTracker>()) {
+  flip_tracker_->st_man = this;
+  pipe_->device->GetEventDispatcher().SetFlipHandler(
+      pipe_->crtc->Get()->GetId(),
+      [tracker = flip_tracker_](int64_t timestamp) {
+        OnPageFlip(*tracker, timestamp);
+      });
+}
+
+DrmAtomicStateManager::~DrmAtomicStateManager() {
+  pipe_->device->GetEventDispatcher().SetFlipHandler(
+      pipe_->crtc->Get()->GetId(), {});
+
+  /* Handler which is already running must not touch the manager */
+  const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+  flip_tracker_->st_man = nullptr;
+}
+
+void DrmAtomicStateManager::SetFrameLock(InstrumentedMutex *frame_lock) {
+  const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+  flip_tracker_->frame_lock = frame_lock;
+}
+
 // NOLINTNEXTLINE (readability-function-cognitive-complexity): Fixme
 auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   ATRACE_CALL();
 
-  if (args.active && *args.active == active_frame_state_.crtc_active_state) {
+  if (args.active && *args.active == LatestFrameState().crtc_active_state) {
     /* Don't set the same state twice */
     args.active.reset();
   }
@@ -56,18 +98,35 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
     return 0;
   }
 
-  if (!active_frame_state_.crtc_active_state) {
+  if (!LatestFrameState().crtc_active_state) {
     /* Force activate display */
     args.active = true;
   }
 
+  auto *drm = pipe_->device;
+
+  std::vector<uint64_t> test_signature;
+  if (args.test_only) {
+    if (test_commit_cache_generation_ != drm->GetKmsConfigGeneration() ||
+        test_commit_cache_.size() >= kTestCommitCacheMaxSize) {
+      test_commit_cache_.clear();
+      test_commit_cache_generation_ = drm->GetKmsConfigGeneration();
+    }
+
+    test_signature = GetTestCommitSignature(args);
+    auto it = test_commit_cache_.find(test_signature);
+    if (it != test_commit_cache_.end()) {
+      return it->second;
+    }
+  }
+
   auto new_frame_state = NewFrameState();
+  const auto prev_planes_count = new_frame_state.used_planes.size();
 
-  auto *drm = pipe_->device;
   auto *connector = pipe_->connector->Get();
   auto *crtc = pipe_->crtc->Get();
 
-  auto pset = MakeDrmModeAtomicReqUnique();
+  auto pset = atomic_req_pool_.Get();
   if (!pset) {
     ALOGE("Failed to allocate property set");
     return -ENOMEM;
@@ -134,14 +193,16 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   if (drm->IsHdrSupportedDevice()) {
     hdr_md& hdr_metadata =  connector->GetHdrMatedata();
     if (has_hdr_layer && hdr_metadata.valid) {
-      struct hdr_output_metadata final_hdr_metadata;
-      uint32_t id;
+      /* Zeroed, the padding is a part of the blob cache key */
+      struct hdr_output_metadata final_hdr_metadata {};
       connector->PrepareHdrMetadata(&hdr_metadata, &final_hdr_metadata);
-      drmModeCreatePropertyBlob(drm->GetFd(), (void *)&final_hdr_metadata,
-                                sizeof(final_hdr_metadata), &id);
-      int ret = drmModeAtomicAddProperty(pset.get(), connector->GetId(),
-                               connector->GetHdrOpMetadataProp().id(), id) < 0;
-      if (ret)
+      new_frame_state.hdr_blob = drm->GetPropertyBlobCache()
+                                     .Get(&final_hdr_metadata,
+                                          sizeof(final_hdr_metadata));
+      if (!new_frame_state.hdr_blob ||
+          drmModeAtomicAddProperty(pset.get(), connector->GetId(),
+                                   connector->GetHdrOpMetadataProp().id(),
+                                   *new_frame_state.hdr_blob) < 0)
         ALOGE("Failed to add hdr property to plane");
 
       hdr_mdata_set_ = true;
@@ -175,46 +236,92 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
 
   if (args.test_only) {
-    return drmModeAtomicCommit(drm->GetFd(), pset.get(),
-                               flags | DRM_MODE_ATOMIC_TEST_ONLY, drm);
+    int err = drmModeAtomicCommit(drm->GetFd(), pset.get(),
+                                  flags | DRM_MODE_ATOMIC_TEST_ONLY, drm);
+    test_commit_cache_[std::move(test_signature)] = err;
+    return err;
   }
 
-  if (last_present_fence_) {
-    ATRACE_NAME("WaitPriorFramePresented");
-
-    constexpr int kTimeoutMs = 500;
-    int err = sync_wait(last_present_fence_.Get(), kTimeoutMs);
-    if (err != 0) {
-      ALOGE("sync_wait(fd=%i) returned: %i (errno: %i)",
-            last_present_fence_.Get(), err, errno);
-    }
-
-    CleanupPriorFrameResources();
+  if (nonblock && drm->HasNonblockingCommits()) {
+    /* Completion is reported by the page-flip event */
+    flags |= DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+  } else {
+    nonblock = false;
   }
 
-  if (nonblock && drm->GetName() == "i915") {
-    flags |= DRM_MODE_ATOMIC_NONBLOCK;
+  /* A blocking commit becomes the active frame once it returns, so the
+   * frames in flight must be retired before it.
+   */
+  WaitForFrameSlot(nonblock ? kMaxFramesInFlight : 1);
+
+  /* Set on activation as well, the pipeline may have been reset */
+  auto *color_watcher = drm->GetColorAdjustmentWatcher();
+  uint64_t color_generation = color_generation_;
+  ColorBlobs color_blobs;
+  if (args.color_adjustment && color_watcher != nullptr &&
+      (color_watcher->GetGeneration() != color_generation_ || args.active)) {
+    color_generation = color_watcher->GetGeneration();
+    if (AtomicSetColorAdjustment(*pset, color_watcher->Get(), color_blobs) !=
+        0) {
+      ALOGE("COLOR_ Failed to set the color adjustment");
+      return -EINVAL;
+    }
   }
 
-  if (args.color_adjustment == true) {
-    SetColorSaturationHue();
-    SetColorBrightnessContrast();
+  uint64_t sequence = 0;
+  if (nonblock) {
+    /* The event may arrive before the commit call returns */
+    const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+    sequence = flip_tracker_->frames_committed++;
   }
 
-  int err = drmModeAtomicCommit(drm->GetFd(), pset.get(), flags, drm);
+  int err = drmModeAtomicCommit(drm->GetFd(), pset.get(), flags,
+                                &drm->GetEventDispatcher());
 
   if (err != 0) {
     ALOGE("Failed to commit pset ret=%d\n", err);
+    if (nonblock) {
+      const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+      flip_tracker_->frames_committed--;
+    }
     return err;
   }
 
+  commits_count_++;
+
+  if (color_generation != color_generation_) {
+    color_generation_ = color_generation;
+    color_blobs_ = std::move(color_blobs);
+  }
+
+  if (args.composition) {
+    for (auto &joining : args.composition->plan) {
+      joining.plane->Get()->AtomicStateCommitted();
+    }
+    for (auto &plane : unused_planes) {
+      plane->Get()->AtomicStateCommitted();
+    }
+  }
+
+  /* Plane ownership or CRTC configuration has changed */
+  if (args.active || args.display_mode ||
+      (args.composition && (!unused_planes.empty() ||
+                            new_frame_state.used_planes.size() !=
+                                prev_planes_count))) {
+    drm->BumpKmsConfigGeneration();
+  }
+
+  new_frame_state.frame_no = args.frame_no;
+  new_frame_state.commit_done_ns = ResourceManager::GetTimeMonotonicNs();
+
   if (nonblock) {
-    last_present_fence_ = UniqueFd::Dup(out_fence);
-    staged_frame_state_ = std::move(new_frame_state);
-    frames_staged_++;
-    ptt_->Notify();
+    /* Retired once flipped, can't happen before the frame lock is released */
+    frames_in_flight_[sequence % kMaxFramesInFlight] = std::move(
+        new_frame_state);
   } else {
+    /* Blocking commit returns once the frame is on the screen */
     active_frame_state_ = std::move(new_frame_state);
+    AddPresentTimings(active_frame_state_, active_frame_state_.commit_done_ns);
   }
 
   if (args.display_mode) {
@@ -228,76 +335,169 @@ auto DrmAtomicStateManager::CommitFrame(AtomicCommitArgs &args) -> int {
   return 0;
 }
 
-PresentTrackerThread::PresentTrackerThread(DrmAtomicStateManager *st_man)
-    : st_man_(st_man),
-      mutex_(&st_man_->pipe_->device->GetResMan().GetMainLock()) {
-  pt_ = std::thread(&PresentTrackerThread::PresentTrackerThreadFn, this);
-}
+auto DrmAtomicStateManager::GetTestCommitSignature(
+    const AtomicCommitArgs &args) -> std::vector<uint64_t> {
+  std::vector<uint64_t> sig;
 
-PresentTrackerThread::~PresentTrackerThread() {
-  ALOGI("PresentTrackerThread successfully destroyed");
-}
+  auto add_float = [&sig](float value) {
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    sig.emplace_back(bits);
+  };
 
-void PresentTrackerThread::PresentTrackerThreadFn() {
-  /* object should be destroyed on thread exit */
-  auto self = std::unique_ptr<PresentTrackerThread>(this);
+  sig.emplace_back(args.active ? (*args.active ? 2 : 1) : 0);
 
-  int tracking_at_the_moment = -1;
+  if (args.display_mode) {
+    auto &mode = *args.display_mode;
+    sig.insert(sig.end(),
+               {mode.clock(), mode.h_display(), mode.h_sync_start(),
+                mode.h_sync_end(), mode.h_total(), mode.h_skew(),
+                mode.v_display(), mode.v_sync_start(), mode.v_sync_end(),
+                mode.v_total(), mode.v_scan(), mode.flags(), mode.type()});
+  } else {
+    sig.emplace_back(0);
+  }
 
-  for (;;) {
-    UniqueFd present_fence;
+  /* Planes, which are going to be disabled depend on the active state */
+  for (const auto &plane : LatestFrameState().used_planes) {
+    sig.emplace_back(plane->Get()->GetId());
+  }
+  sig.emplace_back(UINT64_MAX);
 
-    {
-      std::unique_lock lk(*mutex_);
-      cv_.wait(lk, [&] {
-        return st_man_ == nullptr ||
-               st_man_->frames_staged_ > tracking_at_the_moment;
-      });
+  if (pipe_->device->IsHdrSupportedDevice()) {
+    sig.emplace_back(pipe_->connector->Get()->GetHdrMatedata().valid ? 1 : 0);
+  }
 
-      if (st_man_ == nullptr) {
-        break;
-      }
+  if (!args.composition) {
+    return sig;
+  }
 
-      tracking_at_the_moment = st_man_->frames_staged_;
+  for (auto &joining : args.composition->plan) {
+    auto &layer = joining.layer;
+    sig.emplace_back(joining.plane->Get()->GetId());
+    sig.emplace_back(joining.z_pos);
+    sig.emplace_back(layer.fb ? 1 : 0);
 
-      present_fence = UniqueFd::Dup(st_man_->last_present_fence_.Get());
-      if (!present_fence) {
-        continue;
+    if (layer.bi) {
+      auto &bi = *layer.bi;
+      sig.insert(sig.end(), {bi.width, bi.height, bi.format});
+      for (int i = 0; i < kBufferMaxPlanes; i++) {
+        sig.insert(sig.end(), {bi.pitches[i], bi.offsets[i], bi.modifiers[i]});
       }
+      sig.insert(sig.end(), {uint64_t(bi.color_space),
+                             uint64_t(bi.sample_range),
+                             uint64_t(bi.blend_mode)});
     }
 
-    {
-      ATRACE_NAME("AsyncWaitForBuffersSwap");
-      constexpr int kTimeoutMs = 500;
-      int err = sync_wait(present_fence.Get(), kTimeoutMs);
-      if (err != 0) {
-        ALOGE("sync_wait(fd=%i) returned: %i (errno: %i)", present_fence.Get(),
-              err, errno);
-      }
-    }
+    auto &pi = layer.pi;
+    sig.insert(sig.end(), {pi.transform, pi.alpha});
+    add_float(pi.source_crop.left);
+    add_float(pi.source_crop.top);
+    add_float(pi.source_crop.right);
+    add_float(pi.source_crop.bottom);
+    sig.insert(sig.end(), {uint64_t(uint32_t(pi.display_frame.left)),
+                           uint64_t(uint32_t(pi.display_frame.top)),
+                           uint64_t(uint32_t(pi.display_frame.right)),
+                           uint64_t(uint32_t(pi.display_frame.bottom))});
+  }
 
-    {
-      std::unique_lock lk(*mutex_);
-      if (st_man_ == nullptr) {
-        break;
-      }
+  return sig;
+}
 
-      /* If resources is already cleaned-up by main thread, skip */
-      if (tracking_at_the_moment > st_man_->frames_tracked_) {
-        st_man_->CleanupPriorFrameResources();
-      }
+/* Runs on the event dispatcher thread, must not block on the frame lock */
+void DrmAtomicStateManager::OnPageFlip(FlipTracker &tracker,
+                                       int64_t timestamp) {
+  const std::lock_guard<std::mutex> lock(tracker.mutex);
+  if (tracker.frames_flipped >= tracker.frames_committed) {
+    /* Late event of a frame given up on */
+    return;
+  }
+
+  tracker.flip_ns[tracker.frames_flipped % kMaxFramesInFlight] = timestamp;
+  tracker.frames_flipped++;
+  tracker.flipped.notify_all();
+
+  if (tracker.st_man != nullptr && tracker.frame_lock != nullptr &&
+      tracker.frame_lock->try_lock()) {
+    tracker.st_man->RetireFlippedFramesLocked();
+    tracker.frame_lock->unlock();
+  }
+}
+
+auto DrmAtomicStateManager::LatestFrameState() -> const KmsState & {
+  const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+  auto frames_committed = flip_tracker_->frames_committed;
+  if (frames_retired_ < frames_committed) {
+    return frames_in_flight_[(frames_committed - 1) % kMaxFramesInFlight];
+  }
+  return active_frame_state_;
+}
+
+/* Usually the oldest frame is already flipped by now and this does not
+ * block.
+ */
+void DrmAtomicStateManager::WaitForFrameSlot(uint64_t max_frames_in_flight) {
+  std::unique_lock<std::mutex> lock(flip_tracker_->mutex);
+  auto &tracker = *flip_tracker_;
+  auto has_slot = [&tracker, max_frames_in_flight] {
+    return tracker.frames_committed - tracker.frames_flipped <
+           max_frames_in_flight;
+  };
+
+  if (!has_slot()) {
+    ATRACE_NAME("WaitPriorFramePresented");
+
+    constexpr auto kTimeout = std::chrono::milliseconds(500);
+    while (!tracker.flipped.wait_for(lock, kTimeout, has_slot)) {
+      ALOGE("Page-flip event of frame %u timed out",
+            frames_in_flight_[tracker.frames_flipped % kMaxFramesInFlight]
+                .frame_no);
+      tracker.flip_ns[tracker.frames_flipped % kMaxFramesInFlight] =
+          ResourceManager::GetTimeMonotonicNs();
+      tracker.frames_flipped++;
     }
   }
+
+  RetireFlippedFramesLocked();
+}
+
+void DrmAtomicStateManager::RetireFlippedFrames() {
+  const std::lock_guard<std::mutex> lock(flip_tracker_->mutex);
+  RetireFlippedFramesLocked();
+}
+
+/* Requires both the frame lock and the lock of the flip tracker */
+void DrmAtomicStateManager::RetireFlippedFramesLocked() {
+  while (frames_retired_ < flip_tracker_->frames_flipped) {
+    CleanupPriorFrameResources(
+        flip_tracker_->flip_ns[frames_retired_ % kMaxFramesInFlight]);
+  }
 }
 
-void DrmAtomicStateManager::CleanupPriorFrameResources() {
-  assert(frames_staged_ - frames_tracked_ == 1);
-  assert(last_present_fence_);
+void DrmAtomicStateManager::CleanupPriorFrameResources(
+    int64_t present_fence_ns) {
+  assert(frames_retired_ < flip_tracker_->frames_committed);
 
   ATRACE_NAME("CleanupPriorFrameResources");
-  frames_tracked_++;
-  active_frame_state_ = std::move(staged_frame_state_);
-  last_present_fence_ = {};
+  active_frame_state_ = std::move(
+      frames_in_flight_[frames_retired_ % kMaxFramesInFlight]);
+  frames_retired_++;
+
+  AddPresentTimings(active_frame_state_, present_fence_ns);
+}
+
+/* Release timestamp marks the moment buffers of the prior frame are dropped */
+void DrmAtomicStateManager::AddPresentTimings(const KmsState &frame,
+                                              int64_t present_fence_ns) {
+  if (present_timings_.size() >= kPresentTimingsMaxSize) {
+    present_timings_.erase(present_timings_.begin());
+  }
+
+  present_timings_.emplace_back(
+      PresentTimings{.frame_no = frame.frame_no,
+                     .commit_done_ns = frame.commit_done_ns,
+                     .present_fence_ns = present_fence_ns,
+                     .release_ns = ResourceManager::GetTimeMonotonicNs()});
 }
 
 auto DrmAtomicStateManager::ExecuteAtomicCommit(AtomicCommitArgs &args) -> int {
@@ -322,6 +522,23 @@ auto DrmAtomicStateManager::ExecuteAtomicCommit(AtomicCommitArgs &args) -> int {
   return err;
 }  // namespace android
 
+auto DrmAtomicStateManager::HasPendingState(const AtomicCommitArgs &args)
+    -> bool {
+  if (args.display_mode || args.active) {
+    return true;
+  }
+
+  auto *color_watcher = pipe_->device->GetColorAdjustmentWatcher();
+  if (args.color_adjustment && color_watcher != nullptr &&
+      color_watcher->GetGeneration() != color_generation_) {
+    return true;
+  }
+
+  /* HDR metadata is set or cleared by the commits using it */
+  return pipe_->device->IsHdrSupportedDevice() &&
+         pipe_->connector->Get()->GetHdrMatedata().valid;
+}
+
 auto DrmAtomicStateManager::ActivateDisplayUsingDPMS() -> int {
   return drmModeConnectorSetProperty(pipe_->device->GetFd(),
                                      pipe_->connector->Get()->GetId(),
@@ -359,320 +576,94 @@ void DrmAtomicStateManager::GenerateHueSaturationMatrix(double hue, double satur
   MatrixMult3x3(result_2, rgb2ycbcr709, coeff);
 }
 
-auto DrmAtomicStateManager::SetColorTransformMatrix(
-  double *color_transform_matrix,
-  int32_t color_transform_hint) ->int {
-  FILE *file_saturation = NULL;
-  FILE *file_hue = NULL;
-  int read_bytes;
-  char buf[4096] = {};
-  double hue = 0.0;
-  double saturation = 100;
+void DrmAtomicStateManager::BuildColorCtm(const ColorAdjustment &adjustment,
+                                          struct drm_color_ctm &ctm) {
   double coeff[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
 
-  struct drm_color_ctm *ctm =
-    (struct drm_color_ctm *)malloc(sizeof(struct drm_color_ctm));
-  if (!ctm) {
-    ALOGE("Cannot allocate ctm memory");
-    return -ENOMEM;
-  }
-
-  file_saturation = fopen("/data/vendor/color/saturation", "r+");
-  if (file_saturation != NULL) {
-    read_bytes = fread(buf, 1, 8, file_saturation);
-    if (read_bytes <= 0) {
-      ALOGE("COLOR_ fread saturation error");
-      free(ctm);
-      fclose(file_saturation);
-      return -EINVAL;
-    }
-    saturation = atof(buf);
-    fclose(file_saturation);
-  }
-
-  file_hue = fopen("/data/vendor/color/hue", "r+");
-  if (file_hue != NULL) {
-    read_bytes = fread(buf, 1, 8, file_hue);
-    if (read_bytes <= 0) {
-      ALOGE("COLOR_ fread hue error");
-      free(ctm);
-      fclose(file_hue);
-      return -EINVAL;
-    }
-    hue = atof(buf);
-    fclose(file_hue);
-  }
-
-  if (hue < 0.0 || hue > 359.0) {
-    hue = 0.0;
-  }
-
-  saturation = saturation/100;
-  if (saturation < 0.75 || saturation > 1.25) {
-    saturation = 1.0;
-  }
-
-  ALOGD("COLOR_ hue=%f", hue);
-  ALOGD("COLOR_ saturation=%f", saturation);
-
-  GenerateHueSaturationMatrix(hue, saturation, coeff);
+  GenerateHueSaturationMatrix(adjustment.hue, adjustment.saturation, coeff);
 
+  /* S31.32 sign-magnitude, transposed */
   for (int i = 0; i < 3; i++) {
     for (int j = 0; j < 3; j++) {
-      color_transform_matrix[i * 4 + j] = coeff[j][i];
-    }
-  }
-
-  switch (color_transform_hint) {
-    case HAL_COLOR_TRANSFORM_IDENTITY: {
-      memset(ctm->matrix, 0, sizeof(ctm->matrix));
-      for (int i = 0; i < 3; i++) {
-        ctm->matrix[i * 3 + i] = (1ll << 32);
-      }
-
-      ApplyPendingCTM(ctm);
-      break;
-    }
-    case HAL_COLOR_TRANSFORM_ARBITRARY_MATRIX: {
-      for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-          if (color_transform_matrix[i * 4 + j] < 0) {
-            ctm->matrix[i * 3 + j] =
-                (int64_t) (-color_transform_matrix[i * 4 + j] *
-                ((int64_t) 1L << 32));
-            ctm->matrix[i * 3 + j] |= 1ULL << 63;
-          } else {
-            ctm->matrix[i * 3 + j] =
-              (int64_t) (color_transform_matrix[i * 4 + j] *
-              ((int64_t) 1L << 32));
-          }
-        }
+      if (coeff[j][i] < 0) {
+        ctm.matrix[i * 3 + j] =
+            (int64_t) (-coeff[j][i] * ((int64_t) 1L << 32));
+        ctm.matrix[i * 3 + j] |= 1ULL << 63;
+      } else {
+        ctm.matrix[i * 3 + j] =
+          (int64_t) (coeff[j][i] * ((int64_t) 1L << 32));
       }
-
-      ApplyPendingCTM(ctm);
-      break;
     }
   }
-  free(ctm);
-  return 0;
 }
 
-auto DrmAtomicStateManager::ApplyPendingCTM(
-  struct drm_color_ctm *ctm) -> int {
-  if (pipe_->crtc->Get()->GetCtmProperty().id() == 0) {
-    ALOGE("GetCtmProperty().id() == 0");
-    return -EINVAL;
-  }
+auto DrmAtomicStateManager::AtomicSetColorAdjustment(
+    drmModeAtomicReq &pset, const ColorAdjustment &adjustment,
+    ColorBlobs &blobs) -> int {
+  auto *crtc = pipe_->crtc->Get();
+  auto &blob_cache = pipe_->device->GetPropertyBlobCache();
 
-  uint32_t ctm_id = 0;
-  drmModeCreatePropertyBlob(pipe_->device->GetFd(), ctm, sizeof(drm_color_ctm), &ctm_id);
-  if (ctm_id == 0) {
+  struct drm_color_ctm ctm {};
+  BuildColorCtm(adjustment, ctm);
+  blobs.ctm = blob_cache.Get(&ctm, sizeof(ctm));
+  if (!blobs.ctm) {
     ALOGE("COLOR_ ctm_id == 0");
     return -EINVAL;
   }
 
-  drmModeObjectSetProperty(pipe_->device->GetFd(), pipe_->crtc->Get()->GetId(), DRM_MODE_OBJECT_CRTC,
-                           pipe_->crtc->Get()->GetCtmProperty().id(), ctm_id);
-  drmModeDestroyPropertyBlob(pipe_->device->GetFd(), ctm_id);
-
-  return 0;
-}
-
-float DrmAtomicStateManager::TransformContrastBrightness(float value, float brightness,
-                                              float contrast) {
-  float result;
-  result = (value - 0.5) * contrast + 0.5 + brightness;
-
-  if (result < 0.0) {
-    result = 0.0;
-  }
-  if (result > 1.0) {
-    result = 1.0;
+  int ret = 0;
+  uint64_t lut_size = 0;
+  std::tie(ret, lut_size) = crtc->GetGammaLutSizeProperty().value();
+
+  std::vector<struct drm_color_lut> lut;
+  BuildGammaLut(adjustment, lut_size, lut);
+  /* Empty LUT resets the gamma */
+  if (!lut.empty()) {
+    blobs.lut = blob_cache.Get(lut.data(), sizeof(lut[0]) * lut.size());
+    if (!blobs.lut) {
+      ALOGE("COLOR_ lut_blob_id == 0");
+      return -EINVAL;
+    }
   }
-  return result;
-}
-
-float DrmAtomicStateManager::TransformGamma(float value, float gamma) {
-  float result;
 
-  result = pow(value, gamma);
-  if (result < 0.0) {
-    result = 0.0;
-  }
-  if (result > 1.0) {
-    result = 1.0;
+  if (!crtc->GetCtmProperty().AtomicSet(pset, *blobs.ctm) ||
+      !crtc->GetGammaLutProperty().AtomicSet(pset,
+                                             blobs.lut ? *blobs.lut : 0)) {
+    return -EINVAL;
   }
 
-  return result;
+  return 0;
 }
 
-auto DrmAtomicStateManager::SetColorCorrection(struct gamma_colors gamma,
-                                    uint32_t contrast_c,
-                                    uint32_t brightness_c) ->int{
-  struct drm_color_lut *lut;
-  float brightness[3];
-  float contrast[3];
-  uint8_t temp[3];
-  uint64_t lut_size = 0;
-  int ret = 0;
-
-  std::tie(ret, lut_size) = pipe_->crtc->Get()->GetGammaLutSizeProperty().value();
+void DrmAtomicStateManager::BuildGammaLut(
+    const ColorAdjustment &adjustment, uint64_t lut_size,
+    std::vector<struct drm_color_lut> &lut) {
+  uint32_t contrast_c = adjustment.contrast_c;
+  uint32_t brightness_c = adjustment.brightness_c;
 
   ALOGD("COLOR_ contrast_c=0x%6x", contrast_c);
   ALOGD("COLOR_ brightness_c=0x%6x", brightness_c);
 
   /* reset lut when contrast and brightness are all 0 */
   if (contrast_c == 0 && brightness_c == 0) {
-    lut = NULL;
-    ApplyPendingLUT(lut, lut_size);
-    free(lut);
-    return 0;
-  }
-
-  lut = (struct drm_color_lut *)malloc(sizeof(struct drm_color_lut) * lut_size);
-  if (!lut) {
-    ALOGE("Cannot allocate LUT memory");
-    return -ENOMEM;
+    lut.clear();
+    return;
   }
 
-  /* Unpack brightness values for each channel */
-  temp[0] = (brightness_c >> 16) & 0xFF;
-  temp[1] = (brightness_c >> 8) & 0xFF;
-  temp[2] = (brightness_c) & 0xFF;
-
-  /* Map brightness from -128 - 127 range into -0.5 - 0.5 range */
-  brightness[0] = (float)(temp[0]) / 255 - 0.5;
-  brightness[1] = (float)(temp[1]) / 255 - 0.5;
-  brightness[2] = (float)(temp[2]) / 255 - 0.5;
-
-  /* Unpack contrast values for each channel */
-  temp[0] = (contrast_c >> 16) & 0xFF;
-  temp[1] = (contrast_c >> 8) & 0xFF;
-  temp[2] = (contrast_c) & 0xFF;
-
-  /* Map contrast from 0 - 255 range into 0.0 - 2.0 range */
-  contrast[0] = (float)(temp[0]) / 128;
-  contrast[1] = (float)(temp[1]) / 128;
-  contrast[2] = (float)(temp[2]) / 128;
-
-  for (uint64_t i = 0; i < lut_size; i++) {
-    /* Set lut[0] as 0 always as the darkest color should has brightness 0 */
-    if (i == 0) {
-      lut[i].red = 0;
-      lut[i].green = 0;
-      lut[i].blue = 0;
-      continue;
-    }
-
-    lut[i].red = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                         (float)(i) / lut_size,
-                                          brightness[0], contrast[0]),
-                                          gamma.red);
-    lut[i].green = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                            (float)(i) / lut_size,
-                                             brightness[1], contrast[1]),
-                                             gamma.green);
-    lut[i].blue = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                          (float)(i) / lut_size,
-                                           brightness[2], contrast[2]),
-                                           gamma.blue);
-  }
-
-  ApplyPendingLUT(lut, lut_size);
-  free(lut);
-  return 0;
-}
-
-auto DrmAtomicStateManager::ApplyPendingLUT(struct drm_color_lut *lut, uint64_t lut_size) -> int {
-  uint32_t lut_blob_id = 0;
-
-  if (pipe_->crtc->Get()->GetGammaLutProperty().id() == 0) {
-    ALOGE("GetGammaLutProperty().id() == 0");
-    return -EINVAL;
-  }
+  std::array<GammaCurve, 3> curves{};
+  for (int i = 0; i < 3; i++) {
+    /* Channels are packed as 0xRRGGBB */
+    int shift = (2 - i) * 8;
 
-  drmModeCreatePropertyBlob(
-    pipe_->device->GetFd(), lut, sizeof(struct drm_color_lut) * lut_size, &lut_blob_id);
-  if (lut_blob_id == 0) {
-    ALOGE("COLOR_ lut_blob_id == 0");
-    return -EINVAL;
+    /* Map brightness from -128 - 127 range into -0.5 - 0.5 range */
+    curves[i].brightness = (float)((brightness_c >> shift) & 0xFF) / 255 - 0.5;
 
+    /* Map contrast from 0 - 255 range into 0.0 - 2.0 range */
+    curves[i].contrast = (float)((contrast_c >> shift) & 0xFF) / 128;
   }
 
-  drmModeObjectSetProperty(pipe_->device->GetFd(), pipe_->crtc->Get()->GetId(), DRM_MODE_OBJECT_CRTC,
-                           pipe_->crtc->Get()->GetGammaLutProperty().id(), lut_blob_id);
-  drmModeDestroyPropertyBlob(pipe_->device->GetFd(), lut_blob_id);
-  return 0;
-}
-
-auto DrmAtomicStateManager::SetColorSaturationHue(void) ->int{
-  double color_transform_matrix[16] = {1.0, 0.0, 0.0, 0.0,
-                                       0.0, 1.0, 0.0, 0.0,
-                                       0.0, 0.0, 1.0, 0.0,
-                                       0.0, 0.0, 0.0, 1.0};
-
-  int32_t color_transform_hint = HAL_COLOR_TRANSFORM_ARBITRARY_MATRIX;
-
-  SetColorTransformMatrix(color_transform_matrix,
-                          color_transform_hint);
-  return 0;
+  lut.resize(lut_size);
+  android::BuildGammaLut(curves, lut.size(), lut.data());
 }
 
-auto DrmAtomicStateManager::SetColorBrightnessContrast(void) ->int{
-  struct gamma_colors gamma;
-  int read_bytes;
-  FILE *file_brightness = NULL;
-  FILE *file_contrast   = NULL;
-  char buf[4096]        = {};
-  uint32_t contrast_c   = 0x808080;
-  uint32_t brightness_c = 0x808080;
-
-  file_brightness = fopen("/data/vendor/color/brightness", "r+");
-  if (file_brightness != NULL) {
-    read_bytes = fread(buf, 1, 8, file_brightness);
-    if (read_bytes <= 0) {
-      ALOGE("COLOR_ fread brightness error");
-      fclose(file_brightness);
-      return -EINVAL;
-    }
-    if (atoi(buf) < 0 || atoi(buf) > 255) {
-      brightness_c = 0x80;
-    } else {
-      brightness_c = atoi(buf) &0xFF;
-    }
-
-    brightness_c = ((brightness_c<< 16) |
-                    (brightness_c << 8) |
-                    (brightness_c));
-    fclose(file_brightness);
-  }
-
-  file_contrast = fopen("/data/vendor/color/contrast", "r+");
-  if (file_contrast != NULL) {
-    read_bytes = fread(buf, 1, 8, file_contrast);
-    if (read_bytes <= 0) {
-      ALOGE("COLOR_ fread contrast error");
-      fclose(file_contrast);
-      return -EINVAL;
-    }
-    if (atoi(buf) < 0 || atoi(buf) > 255) {
-      contrast_c = 0x80;
-    } else {
-      contrast_c = atoi(buf) & 0xFF;
-    }
-
-    contrast_c =  ((contrast_c<< 16) |
-                   (contrast_c << 8) |
-                   (contrast_c));
-    fclose(file_contrast);
-  }
-
-  gamma.red   = 1;
-  gamma.green = 1;
-  gamma.blue  = 1;
-
-  SetColorCorrection(gamma, contrast_c, brightness_c);
-
-  return 0;
-}
 }  // namespace android
@@ -19,17 +19,25 @@
 
 #include <pthread.h>
 
+#include <array>
+#include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <tuple>
+#include <vector>
 
 #include "compositor/DrmKmsPlan.h"
 #include "compositor/LayerData.h"
+#include "drm/ColorAdjustmentWatcher.h"
+#include "drm/DrmAtomicReqPool.h"
 #include "drm/DrmPlane.h"
 #include "drm/ResourceManager.h"
 #include "drm/VSyncWorker.h"
+#include "utils/InstrumentedMutex.h"
 #include "utils/cta_hdr_defs.h"
 
 namespace android {
@@ -41,6 +49,8 @@ struct AtomicCommitArgs {
   std::optional<bool> active;
   std::shared_ptr<DrmKmsPlan> composition;
   bool color_adjustment = false;
+  /* Used to match presentation timings with the frame */
+  uint32_t frame_no = 0;
 
   /* out */
   UniqueFd out_fence;
@@ -51,65 +61,46 @@ struct AtomicCommitArgs {
   }
 };
 
-struct gamma_colors {
-  float red;
-  float green;
-  float blue;
-};
-
-class PresentTrackerThread {
+class DrmAtomicStateManager {
  public:
-  explicit PresentTrackerThread(DrmAtomicStateManager *st_man);
-
-  ~PresentTrackerThread();
-
-  void Stop() {
-    /* Exit thread by signalling that object is no longer valid */
-    st_man_ = nullptr;
-    Notify();
-    pt_.detach();
-  }
+  explicit DrmAtomicStateManager(DrmDisplayPipeline *pipe);
 
-  void Notify() {
-    cv_.notify_all();
-  }
-
- private:
-  DrmAtomicStateManager *st_man_{};
-
-  void PresentTrackerThreadFn();
+  DrmAtomicStateManager(const DrmAtomicStateManager &) = delete;
+  ~DrmAtomicStateManager();
 
-  std::condition_variable cv_;
-  std::thread pt_;
-  std::mutex *mutex_;
-};
+  auto ExecuteAtomicCommit(AtomicCommitArgs &args) -> int;
 
-class DrmAtomicStateManager {
-  friend class PresentTrackerThread;
+  /* Lock held by the callers of the manager (the frame path of the display
+   * the pipeline is bound to), nullptr while unbound. Call with it held.
+   */
+  void SetFrameLock(InstrumentedMutex *frame_lock);
 
- public:
-  explicit DrmAtomicStateManager(DrmDisplayPipeline *pipe)
-      : pipe_(pipe),
-        ptt_(std::make_unique<PresentTrackerThread>(this).release()){};
+  /* Increased by every applied commit, whatever the caller */
+  auto GetCommitsCount() const {
+    return commits_count_;
+  }
 
-  DrmAtomicStateManager(const DrmAtomicStateManager &) = delete;
-  ~DrmAtomicStateManager() {
-    ptt_->Stop();
+  /* Whether a commit of args would change more than its composition, e.g.
+   * the color adjustment got reloaded. Otherwise the same composition as the
+   * last committed one can be skipped.
+   */
+  auto HasPendingState(const AtomicCommitArgs &args) -> bool;
+
+  /* Timestamps (CLOCK_MONOTONIC) of the frames presented since last call */
+  struct PresentTimings {
+    uint32_t frame_no;
+    int64_t commit_done_ns;
+    int64_t present_fence_ns;
+    int64_t release_ns;
+  };
+  auto TakePresentTimings() -> std::vector<PresentTimings> {
+    RetireFlippedFrames();
+    std::vector<PresentTimings> timings;
+    timings.swap(present_timings_);
+    return timings;
   }
 
-  auto ExecuteAtomicCommit(AtomicCommitArgs &args) -> int;
   auto ActivateDisplayUsingDPMS() -> int;
-  auto SetColorSaturationHue(void) ->int;
-  auto SetColorBrightnessContrast(void) ->int;
-  auto SetColorTransformMatrix(
-      double *color_transform_matrix,
-      int32_t color_transform_hint) -> int;
-  auto ApplyPendingCTM(struct drm_color_ctm *ctm) -> int;
-
-  auto SetColorCorrection(struct gamma_colors gamma,
-                                    uint32_t contrast_c,
-                                    uint32_t brightness_c) ->int;
-  auto ApplyPendingLUT(struct drm_color_lut *lut,  uint64_t lut_size) -> int;
 
  private:
   auto CommitFrame(AtomicCommitArgs &args) -> int;
@@ -121,41 +112,106 @@ class DrmAtomicStateManager {
      * otherwise picture will blink */
     std::vector<std::shared_ptr<DrmFbIdHandle>> used_framebuffers;
 
-    DrmModeUserPropertyBlobUnique mode_blob;
+    DrmPropertyBlobShared mode_blob;
+    DrmPropertyBlobShared hdr_blob;
 
     int release_fence_pt_index{};
 
+    uint32_t frame_no{};
+    int64_t commit_done_ns{};
+
     /* To avoid setting the inactive state twice, which will fail the commit */
     bool crtc_active_state{};
   } active_frame_state_;
 
+  /* The next frame replaces the newest committed one, which may still be in
+   * flight. Planes it uses are disabled unless the next frame reuses them.
+   */
+  auto LatestFrameState() -> const KmsState &;
+
   auto NewFrameState() -> KmsState {
-    auto *prev_frame_state = &active_frame_state_;
+    const auto &prev_frame_state = LatestFrameState();
     return (KmsState){
-        .used_planes = prev_frame_state->used_planes,
-        .crtc_active_state = prev_frame_state->crtc_active_state,
+        .used_planes = prev_frame_state.used_planes,
+        .crtc_active_state = prev_frame_state.crtc_active_state,
     };
   }
 
   DrmDisplayPipeline *const pipe_;
 
-  void CleanupPriorFrameResources();
+  /* Sized for every plane the CRTC can use */
+  static constexpr int kCrtcPropertiesMax = 8;
+  static auto GetAtomicPropertiesMax(DrmDisplayPipeline &pipe) -> int;
+  DrmAtomicReqPool atomic_req_pool_;
+
+  /* TEST_ONLY verdicts for recently validated frames. The key contains every
+   * input of the test commit, which may affect the verdict. Buffers
+   * themselves are not part of the key, so the verdict is reused while only
+   * the content of the layers changes (e.g. video playback).
+   */
+  static constexpr size_t kTestCommitCacheMaxSize = 32;
+  auto GetTestCommitSignature(const AtomicCommitArgs &args)
+      -> std::vector<uint64_t>;
+  std::map<std::vector<uint64_t>, int> test_commit_cache_;
+  uint64_t test_commit_cache_generation_{};
+
+  /* The kernel rejects a nonblocking commit until the prior one has flipped.
+   * Frames in flight are retired in order, each once it is flipped.
+   */
+  static constexpr uint64_t kMaxFramesInFlight = 1;
+
+  /* Page-flip completion of the frames in flight. Shared with the event
+   * handler, which may outlive the manager. The handler retires the frames
+   * itself when the frame lock is free, otherwise the next call holding it
+   * does.
+   */
+  struct FlipTracker {
+    std::mutex mutex;
+    std::condition_variable flipped;
+    DrmAtomicStateManager *st_man{};
+    InstrumentedMutex *frame_lock{};
+    /* Events arrive in the order of the commits */
+    uint64_t frames_committed{};
+    uint64_t frames_flipped{};
+    std::array<int64_t, kMaxFramesInFlight> flip_ns{};
+  };
+  static void OnPageFlip(FlipTracker &tracker, int64_t timestamp);
+  void WaitForFrameSlot(uint64_t max_frames_in_flight);
+  void RetireFlippedFrames();
+  void RetireFlippedFramesLocked();
+
+  /* Color adjustment is a part of the commit which follows its reload */
+  struct ColorBlobs {
+    DrmPropertyBlobShared ctm;
+    DrmPropertyBlobShared lut;
+  };
+  auto AtomicSetColorAdjustment(drmModeAtomicReq &pset,
+                                const ColorAdjustment &adjustment,
+                                ColorBlobs &blobs) -> int;
+  void BuildColorCtm(const ColorAdjustment &adjustment,
+                     struct drm_color_ctm &ctm);
+  void BuildGammaLut(const ColorAdjustment &adjustment, uint64_t lut_size,
+                     std::vector<struct drm_color_lut> &lut);
+
+  void CleanupPriorFrameResources(int64_t present_fence_ns);
+  void AddPresentTimings(const KmsState &frame, int64_t present_fence_ns);
   int64_t FloatToFixedPoint(float value);
   void GenerateHueSaturationMatrix(double hue, double saturation, double coeff[3][3]);
   void MatrixMult3x3(const double matrix_1[3][3], const double matrix_2[3][3], double result[3][3]);
 
-  float TransformContrastBrightness(float value, float brightness,
-                                                float contrast);
-  float TransformGamma(float value, float gamma);
-
-
   /* Present (swap) tracking */
-  PresentTrackerThread *ptt_;
-  KmsState staged_frame_state_;
-  UniqueFd last_present_fence_;
-  int frames_staged_{};
-  int frames_tracked_{};
+  std::shared_ptr<FlipTracker> flip_tracker_;
+  /* Indexed by the sequence number of the frame */
+  std::array<KmsState, kMaxFramesInFlight> frames_in_flight_;
+  uint64_t frames_retired_{};
+  uint64_t commits_count_{};
+
+  static constexpr size_t kPresentTimingsMaxSize = 64;
+  std::vector<PresentTimings> present_timings_;
   bool hdr_mdata_set_ = false;
+  /* Applied color adjustment, kept so that the same one reuses the blobs */
+  uint64_t color_generation_{};
+  ColorBlobs color_blobs_;
 };
 
 }  // namespace android
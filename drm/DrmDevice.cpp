@@ -25,7 +25,10 @@
 #include <cstdint>
 #include <string>
 
+#include "drm/ColorAdjustmentWatcher.h"
 #include "drm/DrmAtomicStateManager.h"
+#include "drm/DrmEventDispatcher.h"
+#include "drm/DrmFbPrefetcher.h"
 #include "drm/DrmPlane.h"
 #include "drm/ResourceManager.h"
 #include "utils/log.h"
@@ -51,8 +54,13 @@ auto DrmDevice::CreateInstance(std::string const &path,
 
 DrmDevice::DrmDevice(ResourceManager *res_man) : res_man_(res_man) {
   drm_fb_importer_ = std::make_unique<DrmFbImporter>(*this);
+  drm_fb_prefetcher_ = std::make_unique<DrmFbPrefetcher>(*drm_fb_importer_);
+  event_dispatcher_ = std::make_unique<DrmEventDispatcher>(*this);
+  blob_cache_ = std::make_unique<DrmPropertyBlobCache>(*this);
 }
 
+DrmDevice::~DrmDevice() = default;
+
 auto DrmDevice::Init(const char *path) -> int {
   /* TODO: Use drmOpenControl here instead */
   fd_ = UniqueFd(open(path, O_RDWR | O_CLOEXEC));
@@ -122,6 +130,12 @@ auto DrmDevice::Init(const char *path) -> int {
   property_get("vendor.hwcomposer.color.adjustment.enabling", property, "0");
   color_adjustment_enabling_ = atoi(property) != 0 ? true : false;
   ALOGD("COLOR_ The property 'vendor.hwcomposer.color.adjustment.enabling' value is %d", color_adjustment_enabling_);
+  if (color_adjustment_enabling_) {
+    color_adjustment_watcher_ = std::make_unique<ColorAdjustmentWatcher>();
+    if (color_adjustment_watcher_->Init() != 0) {
+      ALOGE("COLOR_ Failed to watch the color settings");
+    }
+  }
 
   for (int i = 0; i < res->count_crtcs; ++i) {
     // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
@@ -178,6 +192,24 @@ auto DrmDevice::Init(const char *path) -> int {
     }
   }
 
+  ret = event_dispatcher_->Init();
+  if (ret != 0) {
+    ALOGW("No DRM event dispatcher, vsync is synthetic %d", ret);
+  }
+
+  /* Completion of a nonblocking commit is reported by its page-flip event,
+   * which has to name the CRTC.
+   */
+  cap_value = 0;
+  if (drmGetCap(GetFd(), DRM_CAP_CRTC_IN_VBLANK_EVENT, &cap_value) != 0) {
+    cap_value = 0;
+  }
+  memset(property, 0, PROPERTY_VALUE_MAX);
+  property_get("vendor.hwc.drm.nonblocking_commits", property, "1");
+  nonblocking_commits_ = ret == 0 && cap_value != 0 && atoi(property) != 0;
+  ALOGI("Nonblocking commits are %s",
+        nonblocking_commits_ ? "enabled" : "disabled");
+
   return 0;
 }
 
@@ -17,6 +17,7 @@
 #ifndef ANDROID_DRM_H_
 #define ANDROID_DRM_H_
 
+#include <atomic>
 #include <cstdint>
 #include <map>
 #include <tuple>
@@ -25,18 +26,23 @@
 #include "DrmCrtc.h"
 #include "DrmEncoder.h"
 #include "DrmFbImporter.h"
+#include "DrmPropertyBlobCache.h"
+#include "utils/InstrumentedMutex.h"
 #include "utils/UniqueFd.h"
 
 #define DRM_FORMAT_NV12_Y_TILED_INTEL fourcc_code('9', '9', '9', '6')
 namespace android {
 
+class ColorAdjustmentWatcher;
+class DrmEventDispatcher;
 class DrmFbImporter;
+class DrmFbPrefetcher;
 class DrmPlane;
 class ResourceManager;
 
 class DrmDevice {
  public:
-  ~DrmDevice() = default;
+  ~DrmDevice();
 
   static auto CreateInstance(std::string const &path, ResourceManager *res_man)
       -> std::unique_ptr<DrmDevice>;
@@ -66,6 +72,11 @@ class DrmDevice {
     return color_adjustment_enabling_;
   }
 
+  /* nullptr unless the color adjustment is enabled */
+  auto *GetColorAdjustmentWatcher() const {
+    return color_adjustment_watcher_.get();
+  }
+
   std::string GetName() const;
 
   bool IsHdrSupportedDevice();
@@ -73,14 +84,31 @@ class DrmDevice {
   auto RegisterUserPropertyBlob(void *data, size_t length) const
       -> DrmModeUserPropertyBlobUnique;
 
+  auto &GetPropertyBlobCache() const {
+    return *blob_cache_;
+  }
+
   auto HasAddFb2ModifiersSupport() const {
     return HasAddFb2ModifiersSupport_;
   }
 
+  /* Commits may return before the flip, see DrmAtomicStateManager */
+  auto HasNonblockingCommits() const {
+    return nonblocking_commits_;
+  }
+
   auto &GetDrmFbImporter() {
     return *drm_fb_importer_;
   }
 
+  auto &GetDrmFbPrefetcher() {
+    return *drm_fb_prefetcher_;
+  }
+
+  auto &GetEventDispatcher() {
+    return *event_dispatcher_;
+  }
+
   auto FindCrtcById(uint32_t id) const -> DrmCrtc * {
     for (const auto &crtc : crtcs_) {
       if (crtc->GetId() == id) {
@@ -105,6 +133,24 @@ class DrmDevice {
   int GetProperty(uint32_t obj_id, uint32_t obj_type, const char *prop_name,
                   DrmProperty *property) const;
 
+  /* Bumped on changes of the KMS configuration (hotplug, modeset, plane
+   * ownership), which may affect TEST_ONLY verdicts of any pipeline.
+   */
+  auto GetKmsConfigGeneration() const {
+    return kms_config_generation_.load(std::memory_order_relaxed);
+  }
+
+  void BumpKmsConfigGeneration() {
+    kms_config_generation_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /* Overlay planes are shared by the displays of the device, which bind them
+   * from their frame paths. Taken after the display lock.
+   */
+  auto &GetPlaneOwnershipLock() {
+    return plane_ownership_lock_;
+  }
+
  private:
   explicit DrmDevice(ResourceManager *res_man);
   auto Init(const char *path) -> int;
@@ -127,8 +173,16 @@ class DrmDevice {
   std::pair<uint32_t, uint32_t> max_resolution_;
 
   bool HasAddFb2ModifiersSupport_{};
+  bool nonblocking_commits_{};
+
+  std::atomic<uint64_t> kms_config_generation_{};
+  InstrumentedMutex plane_ownership_lock_;
 
   std::unique_ptr<DrmFbImporter> drm_fb_importer_;
+  std::unique_ptr<DrmFbPrefetcher> drm_fb_prefetcher_;
+  std::unique_ptr<DrmEventDispatcher> event_dispatcher_;
+  std::unique_ptr<DrmPropertyBlobCache> blob_cache_;
+  std::unique_ptr<ColorAdjustmentWatcher> color_adjustment_watcher_;
 
   ResourceManager *const res_man_;
  public:
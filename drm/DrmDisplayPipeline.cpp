@@ -101,6 +101,8 @@ static auto TryCreatePipeline(DrmDevice &dev, DrmConnector &connector,
   pipe->atomic_state_manager = std::make_unique<DrmAtomicStateManager>(
       pipe.get());
 
+  dev.BumpKmsConfigGeneration();
+
   return pipe;
 }
 
@@ -176,6 +178,8 @@ auto DrmDisplayPipeline::GetUsablePlanes()
   static bool use_overlay_planes = ReadUseOverlayProperty();
 
   if (use_overlay_planes) {
+    const std::lock_guard<InstrumentedMutex> lock(
+        device->GetPlaneOwnershipLock());
     int32_t planes_num = device->planes_num_ - 1;
     for (const auto &plane : device->GetPlanes()) {
       if (plane->IsCrtcSupported(*crtc->Get())) {
@@ -217,6 +221,8 @@ auto DrmDisplayPipeline::AtomicDisablePipeline() -> int {
     return -EINVAL;
   }
 
+  device->BumpKmsConfigGeneration();
+
   return 0;
 }
 }  // namespace android
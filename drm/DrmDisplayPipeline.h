@@ -36,11 +36,9 @@ class BindingOwner;
 
 template <class O>
 class PipelineBindable {
-  friend class BindingOwner<O>;
-
  public:
   auto *GetPipeline() {
-    return bound_pipeline_;
+    return owner_object_.expired() ? nullptr : bound_pipeline_;
   }
 
   auto BindPipeline(DrmDisplayPipeline *pipeline,
@@ -48,7 +46,10 @@ class PipelineBindable {
       -> std::shared_ptr<BindingOwner<O>>;
 
  private:
-  DrmDisplayPipeline *bound_pipeline_;
+  /* Valid while the owner object lives, its release doesn't touch the
+   * bindable, which may get bound again by another thread meanwhile
+   */
+  DrmDisplayPipeline *bound_pipeline_{};
   std::weak_ptr<BindingOwner<O>> owner_object_;
 };
 
@@ -56,9 +57,6 @@ template <class B>
 class BindingOwner {
  public:
   explicit BindingOwner(B *pb) : bindable_(pb){};
-  ~BindingOwner() {
-    bindable_->bound_pipeline_ = nullptr;
-  }
 
   B *Get() {
     return bindable_;
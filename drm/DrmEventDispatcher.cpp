@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-drm-event-dispatcher"
+
+#include "DrmEventDispatcher.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include <array>
+#include <cerrno>
+
+#include "DrmDevice.h"
+#include "utils/log.h"
+
+namespace android {
+
+constexpr int kHalPriorityUrgentDisplay = -8;
+constexpr int64_t kOneSecondNs = 1000LL * 1000 * 1000;
+constexpr int64_t kOneMicrosecondNs = 1000;
+
+DrmEventDispatcher::DrmEventDispatcher(DrmDevice &drm)
+    : Worker("drm-event-dispatcher", kHalPriorityUrgentDisplay),
+      drm_(&drm),
+      notifier_(*this) {
+}
+
+DrmEventDispatcher::~DrmEventDispatcher() {
+  if (wake_fd_) {
+    uint64_t value = 1;
+    if (write(wake_fd_.Get(), &value, sizeof(value)) != sizeof(value)) {
+      ALOGE("Failed to wake up the dispatcher, errno: %d", errno);
+    }
+  }
+  Exit();
+}
+
+auto DrmEventDispatcher::Init() -> int {
+  epoll_fd_ = UniqueFd(epoll_create1(EPOLL_CLOEXEC));
+  wake_fd_ = UniqueFd(eventfd(0, EFD_CLOEXEC));
+  if (!epoll_fd_ || !wake_fd_) {
+    ALOGE("Failed to create the event loop, errno: %d", errno);
+    return -errno;
+  }
+
+  for (int fd : {drm_->GetFd(), wake_fd_.Get()}) {
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_.Get(), EPOLL_CTL_ADD, fd, &ev) != 0) {
+      ALOGE("Failed to poll fd %d, errno: %d", fd, errno);
+      return -errno;
+    }
+  }
+
+  int ret = notifier_.Init();
+  if (ret != 0) {
+    return ret;
+  }
+
+  return InitWorker();
+}
+
+DrmEventDispatcher::VblankNotifier::VblankNotifier(
+    DrmEventDispatcher &dispatcher)
+    : Worker("drm-vblank-notifier", kHalPriorityUrgentDisplay),
+      dispatcher_(&dispatcher) {
+}
+
+DrmEventDispatcher::VblankNotifier::~VblankNotifier() {
+  Exit();
+}
+
+void DrmEventDispatcher::VblankNotifier::Post() {
+  Lock();
+  posted_ = true;
+  Unlock();
+  Signal();
+}
+
+void DrmEventDispatcher::VblankNotifier::Routine() {
+  Lock();
+  if (!posted_ && WaitForSignalOrExitLocked() == -EINTR) {
+    Unlock();
+    return;
+  }
+  posted_ = false;
+  Unlock();
+
+  dispatcher_->NotifyVblanks();
+}
+
+auto DrmEventDispatcher::GetCrtcVblankLocked(uint32_t crtc_index)
+    -> CrtcVblank & {
+  auto &vbl = vblank_[crtc_index];
+  vbl.dispatcher = this;
+  vbl.crtc_index = crtc_index;
+  return vbl;
+}
+
+void DrmEventDispatcher::SetVblankHandler(uint32_t crtc_index,
+                                          VblankHandler handler) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  auto &vbl = GetCrtcVblankLocked(crtc_index);
+  vbl.handler = std::move(handler);
+  if (!vbl.handler) {
+    vbl.enabled = false;
+  }
+}
+
+void DrmEventDispatcher::SetFlipHandler(uint32_t crtc_id,
+                                        FlipHandler handler) {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  if (handler) {
+    flip_handlers_[crtc_id] = std::move(handler);
+  } else {
+    flip_handlers_.erase(crtc_id);
+  }
+}
+
+void DrmEventDispatcher::WaitForHandlers() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto id = std::this_thread::get_id();
+  if (id == thread_id_ || id == notifier_thread_id_) {
+    return;
+  }
+  handler_done_.wait(lock, [this] { return running_ == 0; });
+}
+
+auto DrmEventDispatcher::EnableVblank(uint32_t crtc_index, bool enable)
+    -> int {
+  if (!initialized()) {
+    return -ENODEV;
+  }
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  auto &vbl = GetCrtcVblankLocked(crtc_index);
+  vbl.enabled = enable && vbl.handler;
+  if (!vbl.enabled || vbl.armed) {
+    return 0;
+  }
+
+  int ret = ArmVblankLocked(vbl);
+  if (ret != 0) {
+    vbl.enabled = false;
+  } else {
+    vbl.pending_stop = false;
+  }
+  return ret;
+}
+
+auto DrmEventDispatcher::ArmVblankLocked(CrtcVblank &vbl) -> int {
+  uint32_t high_crtc = (vbl.crtc_index << DRM_VBLANK_HIGH_CRTC_SHIFT);
+
+  drmVBlank vblank{};
+  vblank.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
+                                           DRM_VBLANK_EVENT |
+                                           (high_crtc &
+                                            DRM_VBLANK_HIGH_CRTC_MASK));
+  vblank.request.sequence = 1;
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  vblank.request.signal = reinterpret_cast<unsigned long>(&vbl);
+
+  int ret = drmWaitVBlank(drm_->GetFd(), &vblank);
+  vbl.armed = ret == 0;
+  return ret;
+}
+
+template <typename F>
+void DrmEventDispatcher::RunHandlerLocked(std::unique_lock<std::mutex> &lock,
+                                          F &&handler) {
+  running_++;
+  lock.unlock();
+
+  handler();
+
+  lock.lock();
+  running_--;
+  lock.unlock();
+  handler_done_.notify_all();
+}
+
+void DrmEventDispatcher::VblankEventHandler(int /*fd*/,
+                                            unsigned int /*sequence*/,
+                                            unsigned int tv_sec,
+                                            unsigned int tv_usec,
+                                            void *user_data) {
+  auto *vbl = static_cast<CrtcVblank *>(user_data);
+  vbl->dispatcher->OnVblank(*vbl, int64_t(tv_sec) * kOneSecondNs +
+                                      int64_t(tv_usec) * kOneMicrosecondNs);
+}
+
+void DrmEventDispatcher::OnVblank(CrtcVblank &vbl, int64_t timestamp) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  vbl.armed = false;
+  if (!vbl.enabled) {
+    return;
+  }
+
+  /* Request the next one before notifying, so it isn't missed */
+  if (ArmVblankLocked(vbl) != 0) {
+    vbl.enabled = false;
+    vbl.pending_stop = true;
+  }
+
+  vbl.pending = true;
+  vbl.pending_timestamp = timestamp;
+  lock.unlock();
+
+  notifier_.Post();
+}
+
+/* Runs on the notifier thread */
+void DrmEventDispatcher::NotifyVblanks() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  notifier_thread_id_ = std::this_thread::get_id();
+
+  for (auto &it : vblank_) {
+    auto &vbl = it.second;
+    if (!vbl.pending) {
+      continue;
+    }
+
+    auto timestamp = vbl.pending_timestamp;
+    bool stopped = vbl.pending_stop;
+    vbl.pending = false;
+    vbl.pending_stop = false;
+    if (!vbl.handler) {
+      continue;
+    }
+
+    auto handler = vbl.handler;
+    RunHandlerLocked(lock, [&] {
+      handler(timestamp);
+      if (stopped) {
+        handler(-1);
+      }
+    });
+    lock.lock();
+  }
+}
+
+void DrmEventDispatcher::PageFlipEventHandler(int /*fd*/,
+                                              unsigned int /*sequence*/,
+                                              unsigned int tv_sec,
+                                              unsigned int tv_usec,
+                                              unsigned int crtc_id,
+                                              void *user_data) {
+  auto *dispatcher = static_cast<DrmEventDispatcher *>(user_data);
+  dispatcher->OnFlip(crtc_id, int64_t(tv_sec) * kOneSecondNs +
+                                  int64_t(tv_usec) * kOneMicrosecondNs);
+}
+
+void DrmEventDispatcher::OnFlip(uint32_t crtc_id, int64_t timestamp) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = flip_handlers_.find(crtc_id);
+  if (it == flip_handlers_.end()) {
+    return;
+  }
+
+  auto handler = it->second;
+  RunHandlerLocked(lock, [&] { handler(timestamp); });
+}
+
+void DrmEventDispatcher::Routine() {
+  Lock();
+  thread_id_ = std::this_thread::get_id();
+  Unlock();
+
+  std::array<struct epoll_event, 2> events{};
+  int count = epoll_wait(epoll_fd_.Get(), events.data(), events.size(), -1);
+  if (count < 0) {
+    if (errno != EINTR) {
+      ALOGE("Failed to wait for events, errno: %d", errno);
+    }
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    /* Only written on exit, left set until the thread is joined */
+    if (events[i].data.fd == wake_fd_.Get()) {
+      return;
+    }
+  }
+
+  drmEventContext ctx{};
+  ctx.version = 3;
+  ctx.vblank_handler = VblankEventHandler;
+  ctx.page_flip_handler2 = PageFlipEventHandler;
+  drmHandleEvent(drm_->GetFd(), &ctx);
+}
+
+}  // namespace android
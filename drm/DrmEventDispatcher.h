@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DRM_EVENT_DISPATCHER_H_
+#define ANDROID_DRM_EVENT_DISPATCHER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "utils/UniqueFd.h"
+#include "utils/Worker.h"
+
+namespace android {
+
+class DrmDevice;
+
+/*
+ * Single thread per DRM device reading the events of all its CRTCs.
+ *
+ * Vblank events are requested from the kernel one at a time and re-armed
+ * as they arrive, so a CRTC costs nothing while its vblank delivery is
+ * disabled and the timestamps come straight from the kernel.
+ *
+ * Page-flip events are requested by the atomic commits themselves
+ * (DRM_MODE_PAGE_FLIP_EVENT), such commits have to pass the dispatcher as
+ * user_data. Flip handlers run on the dispatcher thread and must not block.
+ * Vblank handlers may block (e.g. on the display lock, while the composer waits
+ * for a flip), so they run on a separate notifier thread.
+ */
+class DrmEventDispatcher : public Worker {
+ public:
+  /* Called with the vblank timestamp, or with -1 once the events can't be
+   * delivered anymore (e.g. the CRTC got disabled).
+   */
+  using VblankHandler = std::function<void(int64_t /*timestamp_ns*/)>;
+  /* Called with the timestamp of the vblank the new frame got scanned out at,
+   * must not block.
+   */
+  using FlipHandler = std::function<void(int64_t /*timestamp_ns*/)>;
+
+  explicit DrmEventDispatcher(DrmDevice &drm);
+  ~DrmEventDispatcher() override;
+  DrmEventDispatcher(const DrmEventDispatcher &) = delete;
+  DrmEventDispatcher(DrmEventDispatcher &&) = delete;
+  auto operator=(const DrmEventDispatcher &) = delete;
+  auto operator=(DrmEventDispatcher &&) = delete;
+
+  auto Init() -> int;
+
+  /* Empty handler removes the previous one, which may still be running */
+  void SetVblankHandler(uint32_t crtc_index, VblankHandler handler);
+
+  /* Empty handler removes the previous one, which may still be running */
+  void SetFlipHandler(uint32_t crtc_id, FlipHandler handler);
+
+  /* Returns once no handler is running. Must not be called while holding a
+   * lock taken by the handlers.
+   */
+  void WaitForHandlers();
+
+  /* Returns an error if the vblank events can't be requested */
+  auto EnableVblank(uint32_t crtc_index, bool enable) -> int;
+
+ protected:
+  void Routine() override;
+
+ private:
+  class VblankNotifier : public Worker {
+   public:
+    explicit VblankNotifier(DrmEventDispatcher &dispatcher);
+    ~VblankNotifier() override;
+    VblankNotifier(const VblankNotifier &) = delete;
+    VblankNotifier(VblankNotifier &&) = delete;
+    auto operator=(const VblankNotifier &) = delete;
+    auto operator=(VblankNotifier &&) = delete;
+
+    auto Init() -> int {
+      return InitWorker();
+    }
+    void Post();
+
+   protected:
+    void Routine() override;
+
+   private:
+    DrmEventDispatcher *const dispatcher_;
+    bool posted_{};
+  };
+
+  struct CrtcVblank {
+    DrmEventDispatcher *dispatcher;
+    uint32_t crtc_index;
+    VblankHandler handler;
+    bool enabled;
+    /* Event requested and not received yet */
+    bool armed;
+    /* Received and not notified yet, only the latest one is kept */
+    bool pending;
+    bool pending_stop;
+    int64_t pending_timestamp;
+  };
+
+  auto GetCrtcVblankLocked(uint32_t crtc_index) -> CrtcVblank &;
+  auto ArmVblankLocked(CrtcVblank &vbl) -> int;
+  void OnVblank(CrtcVblank &vbl, int64_t timestamp);
+  void NotifyVblanks();
+  void OnFlip(uint32_t crtc_id, int64_t timestamp);
+  /* Runs the handler with the lock released, tracks it for WaitForHandlers().
+   * Returns with the lock released.
+   */
+  template <typename F>
+  void RunHandlerLocked(std::unique_lock<std::mutex> &lock, F &&handler);
+
+  static void VblankEventHandler(int fd, unsigned int sequence,
+                                 unsigned int tv_sec, unsigned int tv_usec,
+                                 void *user_data);
+  static void PageFlipEventHandler(int fd, unsigned int sequence,
+                                   unsigned int tv_sec, unsigned int tv_usec,
+                                   unsigned int crtc_id, void *user_data);
+
+  DrmDevice *const drm_;
+  UniqueFd epoll_fd_;
+  UniqueFd wake_fd_;
+
+  /* Nodes are never erased, kernel events refer to them */
+  std::map<uint32_t /*crtc_index*/, CrtcVblank> vblank_;
+  std::map<uint32_t /*crtc_id*/, FlipHandler> flip_handlers_;
+  VblankNotifier notifier_;
+  int running_{};
+  std::condition_variable handler_done_;
+  std::thread::id thread_id_;
+  std::thread::id notifier_thread_id_;
+};
+
+}  // namespace android
+
+#endif
@@ -26,8 +26,12 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <algorithm>
 #include <cinttypes>
+#include <set>
+#include <sstream>
 #include <system_error>
+#include <vector>
 
 #include "utils/log.h"
 #include "utils/properties.h"
@@ -93,11 +97,20 @@ auto DrmFbIdHandle::CreateInstance(BufferInfo *bo, GemHandle first_gem_handle,
   return local;
 }
 
+static void CloseGemHandle(DrmDevice &drm, GemHandle handle) {
+  struct drm_gem_close gem_close {};
+  gem_close.handle = handle;
+  int32_t err = drmIoctl(drm.GetFd(), DRM_IOCTL_GEM_CLOSE, &gem_close);
+  if (err != 0) {
+    ALOGE("Failed to close gem handle %d, errno: %d", handle, errno);
+  }
+}
+
 DrmFbIdHandle::~DrmFbIdHandle() {
   ATRACE_NAME("Close FB and dmabufs");
 
   /* Destroy framebuffer object */
-  if (drmModeRmFB(drm_->GetFd(), fb_id_) != 0) {
+  if (fb_id_ != 0 && drmModeRmFB(drm_->GetFd(), fb_id_) != 0) {
     ALOGE("Failed to rm fb");
   }
 
@@ -109,7 +122,6 @@ DrmFbIdHandle::~DrmFbIdHandle() {
    * Probably we should offer similar approach to users (at least on user
    * request via system properties)
    */
-  struct drm_gem_close gem_close {};
   for (size_t i = 0; i < gem_handles_.size(); i++) {
     /* Don't close invalid handle. Close handle only once in cases
      * where several YUV planes located in the single buffer. */
@@ -117,16 +129,59 @@ DrmFbIdHandle::~DrmFbIdHandle() {
         (i != 0 && gem_handles_[i] == gem_handles_[0])) {
       continue;
     }
-    gem_close.handle = gem_handles_[i];
-    int32_t err = drmIoctl(drm_->GetFd(), DRM_IOCTL_GEM_CLOSE, &gem_close);
-    if (err != 0) {
-      ALOGE("Failed to close gem handle %d, errno: %d", gem_handles_[i], errno);
-    }
+    CloseGemHandle(*drm_, gem_handles_[i]);
   }
 }
 
+auto DrmFbIdHandle::Detach() -> Resources {
+  Resources res{.fb_id = fb_id_, .gem_handles = gem_handles_};
+  fb_id_ = 0;
+  gem_handles_ = {};
+  return res;
+}
+
+/* Originally defined in system/core/libsystem/include/system/thread_defs.h */
+constexpr int kAndroidPriorityBackground = 10;
+
+static auto ReadCacheProperty(const char *name, const char *default_value)
+    -> uint64_t {
+  char value[PROPERTY_VALUE_MAX];
+  property_get(name, value, default_value);
+  constexpr int kStrtoullBase = 10;
+  return strtoull(value, nullptr, kStrtoullBase);
+}
+
+/* Memory kept alive by the framebuffer */
+static auto EstimateBufferSize(const BufferInfo &bo) -> uint64_t {
+  uint64_t size = 0;
+  for (size_t i = 0; i < kBufferMaxPlanes && bo.pitches[i] != 0; i++) {
+    size += bo.sizes[i] != 0 ? bo.sizes[i]
+                             : uint64_t(bo.pitches[i]) * bo.height;
+  }
+  return size;
+}
+
+DrmFbImporter::DrmFbImporter(DrmDevice &drm)
+    : drm_(&drm),
+      capacity_(ReadCacheProperty("vendor.hwc.drm.fb_cache_size", "128")),
+      budget_bytes_(
+          ReadCacheProperty("vendor.hwc.drm.fb_cache_budget_mb", "256")
+          << 20),
+      reap_worker_(this) {
+}
+
+DrmFbImporter::~DrmFbImporter() {
+  reap_worker_.Exit();
+  Reap();
+}
+
 auto DrmFbImporter::GetOrCreateFbId(BufferInfo *bo)
     -> std::shared_ptr<DrmFbIdHandle> {
+  /* GEM handles are shared by all the framebuffers of the buffer, do not let
+   * them be closed by eviction in between of the import and the lookup.
+   */
+  const std::lock_guard<std::mutex> lock(cache_lock_);
+
   /* Lookup DrmFbIdHandle in cache first. First handle serves as a cache key. */
   GemHandle first_handle = 0;
   int32_t err = drmPrimeFDToHandle(drm_->GetFd(), bo->prime_fds[0],
@@ -137,28 +192,174 @@ auto DrmFbImporter::GetOrCreateFbId(BufferInfo *bo)
     return {};
   }
 
-  auto drm_fb_id_cached = drm_fb_id_handle_cache_.find(first_handle);
-
-  if (drm_fb_id_cached != drm_fb_id_handle_cache_.end()) {
-    if (auto drm_fb_id_handle_shared = drm_fb_id_cached->second) {
-      return drm_fb_id_handle_shared;
-    }
-    drm_fb_id_handle_cache_.erase(drm_fb_id_cached);
-  }
-
-  /* Cleanup cached empty weak pointers */
-  const int minimal_cleanup_size = 128;
-  if (drm_fb_id_handle_cache_.size() > minimal_cleanup_size) {
-    CleanupEmptyCacheElements();
+  auto cached = cache_.find(first_handle);
+  if (cached != cache_.end()) {
+    cached->second.last_used = ++generation_;
+    hits_++;
+    return cached->second.fb;
   }
+  misses_++;
 
   /* No DrmFbIdHandle found in cache, create framebuffer object */
   auto fb_id_handle = DrmFbIdHandle::CreateInstance(bo, first_handle, *drm_);
   if (fb_id_handle) {
-    drm_fb_id_handle_cache_[first_handle] = fb_id_handle;
+    auto size = EstimateBufferSize(*bo);
+    cache_[first_handle] = {.fb = fb_id_handle,
+                            .size = size,
+                            .last_used = ++generation_};
+    cache_bytes_ += size;
+
+    if (IsOverLimitsLocked()) {
+      reap_worker_.Request();
+    }
   }
 
   return fb_id_handle;
 }
 
+auto DrmFbImporter::IsOverLimitsLocked() const -> bool {
+  return cache_.size() > capacity_ ||
+         (budget_bytes_ != 0 && cache_bytes_ > budget_bytes_);
+}
+
+void DrmFbImporter::Trim() {
+  ATRACE_NAME("Trim FB cache");
+  const std::lock_guard<std::mutex> lock(cache_lock_);
+
+  if (!IsOverLimitsLocked()) {
+    return;
+  }
+
+  /* Only the cache holds a reference, no one can take a new one without
+   * the cache lock.
+   */
+  std::vector<std::pair<uint64_t /*last_used*/, GemHandle>> candidates;
+  for (auto &[handle, entry] : cache_) {
+    if (entry.fb.use_count() == 1) {
+      candidates.emplace_back(entry.last_used, handle);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  for (auto &candidate : candidates) {
+    if (!IsOverLimitsLocked() ||
+        release_backlog_.size() >= kReleaseBacklogMax) {
+      break;
+    }
+    auto entry = cache_.find(candidate.second);
+    release_backlog_.emplace_back(entry->second.fb->Detach());
+    cache_bytes_ -= entry->second.size;
+    cache_.erase(entry);
+    evictions_++;
+  }
+}
+
+auto DrmFbImporter::Reap() -> bool {
+  std::vector<DrmFbIdHandle::Resources> batch;
+  {
+    const std::lock_guard<std::mutex> lock(cache_lock_);
+    batch.swap(release_backlog_);
+  }
+
+  if (batch.empty()) {
+    return false;
+  }
+
+  ATRACE_NAME("Release evicted FBs");
+
+  /* Framebuffer ids are never shared, no need to hold the lock */
+  for (auto &res : batch) {
+    if (drmModeRmFB(drm_->GetFd(), res.fb_id) != 0) {
+      ALOGE("Failed to rm fb %u", res.fb_id);
+    }
+  }
+
+  /* GEM handles are per buffer, the buffer could have been imported again
+   * since the eviction. Such handles belong to the new framebuffer now.
+   */
+  const std::lock_guard<std::mutex> lock(cache_lock_);
+  std::set<GemHandle> handles;
+  for (auto &res : batch) {
+    handles.insert(res.gem_handles.begin(), res.gem_handles.end());
+  }
+  handles.erase(0);
+  for (auto &entry : cache_) {
+    for (auto handle : entry.second.fb->GetGemHandles()) {
+      handles.erase(handle);
+    }
+  }
+
+  for (auto handle : handles) {
+    CloseGemHandle(*drm_, handle);
+  }
+  released_ += batch.size();
+
+  return true;
+}
+
+auto DrmFbImporter::GetCacheStats() -> CacheStats {
+  const std::lock_guard<std::mutex> lock(cache_lock_);
+
+  size_t pinned = 0;
+  for (auto &entry : cache_) {
+    pinned += entry.second.fb.use_count() > 1 ? 1 : 0;
+  }
+
+  return {.hits = hits_,
+          .misses = misses_,
+          .evictions = evictions_,
+          .entries = cache_.size(),
+          .pinned_entries = pinned,
+          .bytes = cache_bytes_,
+          .released = released_,
+          .release_backlog = release_backlog_.size()};
+}
+
+auto DrmFbImporter::Dump() -> std::string {
+  auto stats = GetCacheStats();
+
+  std::stringstream ss;
+  ss << "  Framebuffer cache: " << stats.entries << " entries ("
+     << stats.pinned_entries << " in use), " << (stats.bytes >> 20) << " MiB"
+     << " [limits: " << capacity_ << " entries, " << (budget_bytes_ >> 20)
+     << " MiB]\n"
+     << "  Framebuffer cache hits / misses / evictions: " << stats.hits
+     << " / " << stats.misses << " / " << stats.evictions << "\n"
+     << "  Framebuffers released: " << stats.released << " (backlog "
+     << stats.release_backlog << ")\n";
+  return ss.str();
+}
+
+DrmFbImporter::ReapWorker::ReapWorker(DrmFbImporter *importer)
+    : Worker("fb-cache-reaper", kAndroidPriorityBackground),
+      importer_(importer) {
+  InitWorker();
+}
+
+DrmFbImporter::ReapWorker::~ReapWorker() {
+  Exit();
+}
+
+void DrmFbImporter::ReapWorker::Request() {
+  Lock();
+  requested_ = true;
+  Unlock();
+  Signal();
+}
+
+void DrmFbImporter::ReapWorker::Routine() {
+  Lock();
+  if (!requested_ && WaitForSignalOrExitLocked() == -EINTR) {
+    Unlock();
+    return;
+  }
+  requested_ = false;
+  Unlock();
+
+  /* Eviction pauses while the backlog is full, resume once it is drained */
+  do {
+    importer_->Trim();
+  } while (importer_->Reap());
+}
+
 }  // namespace android
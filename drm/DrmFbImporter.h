@@ -22,9 +22,13 @@
 
 #include <array>
 #include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "bufferinfo/BufferInfo.h"
 #include "drm/DrmDevice.h"
+#include "utils/Worker.h"
 
 #ifndef DRM_FORMAT_INVALID
 #define DRM_FORMAT_INVALID 0
@@ -49,6 +53,21 @@ class DrmFbIdHandle {
     return fb_id_;
   }
 
+  auto GetGemHandles [[nodiscard]] () const
+      -> const std::array<GemHandle, kBufferMaxPlanes> & {
+    return gem_handles_;
+  }
+
+  struct Resources {
+    uint32_t fb_id;
+    std::array<GemHandle, kBufferMaxPlanes> gem_handles;
+  };
+
+  /* Hands the framebuffer and the GEM handles over to the caller, nothing is
+   * released by the destructor afterwards.
+   */
+  auto Detach() -> Resources;
+
  private:
   explicit DrmFbIdHandle(DrmDevice &drm) : drm_(&drm){};
 
@@ -58,10 +77,23 @@ class DrmFbIdHandle {
   std::array<GemHandle, kBufferMaxPlanes> gem_handles_{};
 };
 
+/*
+ * Framebuffers are cached by the GEM handle of the first buffer plane. Every
+ * cached framebuffer keeps its buffer memory alive, so the cache is bounded
+ * by the number of entries (vendor.hwc.drm.fb_cache_size) and by the
+ * estimated size of the buffers (vendor.hwc.drm.fb_cache_budget_mb, 0 - no
+ * limit). Entries referenced outside of the cache (by KMS states or layers)
+ * are pinned, the least recently used of the rest are evicted by a
+ * background worker, so lookups on the present path never release anything.
+ *
+ * Evicted framebuffers are queued to the same worker, which removes them in
+ * batches out of the cache lock (drmModeRmFB may wait for a vblank). The
+ * backlog is bounded, eviction pauses while it is full.
+ */
 class DrmFbImporter {
  public:
-  explicit DrmFbImporter(DrmDevice &drm) : drm_(&drm){};
-  ~DrmFbImporter() = default;
+  explicit DrmFbImporter(DrmDevice &drm);
+  ~DrmFbImporter();
   DrmFbImporter(const DrmFbImporter &) = delete;
   DrmFbImporter(DrmFbImporter &&) = delete;
   auto operator=(const DrmFbImporter &) = delete;
@@ -69,17 +101,69 @@ class DrmFbImporter {
 
   auto GetOrCreateFbId(BufferInfo *bo) -> std::shared_ptr<DrmFbIdHandle>;
 
+  struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t pinned_entries;
+    uint64_t bytes;
+    uint64_t released;
+    size_t release_backlog;
+  };
+  auto GetCacheStats() -> CacheStats;
+  auto Dump() -> std::string;
+
  private:
-  void CleanupEmptyCacheElements() {
-    for (auto it = drm_fb_id_handle_cache_.begin();
-         it != drm_fb_id_handle_cache_.end();) {
-      it = drm_fb_id_handle_cache_.erase(it);
-    }
-  }
+  struct CacheEntry {
+    std::shared_ptr<DrmFbIdHandle> fb;
+    /* Estimated size of the buffer memory */
+    uint64_t size;
+    /* Lookup generation of the last use */
+    uint64_t last_used;
+  };
+
+  class ReapWorker : public Worker {
+   public:
+    explicit ReapWorker(DrmFbImporter *importer);
+    ~ReapWorker() override;
+
+    void Request();
+
+   protected:
+    void Routine() override;
+
+   private:
+    DrmFbImporter *const importer_;
+    bool requested_{};
+  };
+
+  static constexpr size_t kReleaseBacklogMax = 64;
+
+  auto IsOverLimitsLocked() const -> bool;
+  /* Evicts unpinned entries, least recently used first */
+  void Trim();
+  /* Releases the evicted framebuffers, returns false if nothing was queued */
+  auto Reap() -> bool;
 
   DrmDevice *const drm_;
 
-  std::map<GemHandle, std::shared_ptr<DrmFbIdHandle>> drm_fb_id_handle_cache_;
+  std::mutex cache_lock_;
+  std::map<GemHandle, CacheEntry> cache_;
+  uint64_t generation_{};
+  uint64_t cache_bytes_{};
+  size_t capacity_{};
+  uint64_t budget_bytes_{};
+
+  std::vector<DrmFbIdHandle::Resources> release_backlog_;
+
+  uint64_t hits_{};
+  uint64_t misses_{};
+  uint64_t evictions_{};
+  uint64_t released_{};
+
+  /* Last member, the thread is stopped before the cache is destroyed */
+  ReapWorker reap_worker_;
 };
 
 }  // namespace android
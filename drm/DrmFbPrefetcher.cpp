@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define LOG_TAG "hwc-fb-prefetcher"
+
+#include "DrmFbPrefetcher.h"
+
+#include <cutils/native_handle.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "utils/log.h"
+#include "utils/properties.h"
+
+namespace android {
+
+constexpr int kHalPriorityUrgentDisplay = -8;
+
+DrmFbPrefetcher::DrmFbPrefetcher(DrmFbImporter &importer)
+    : Worker("fb-prefetch", kHalPriorityUrgentDisplay), importer_(&importer) {
+  char value[PROPERTY_VALUE_MAX];
+  property_get("vendor.hwc.drm.fb_prefetch", value, "1");
+  enabled_ = strcmp(value, "0") != 0;
+  if (enabled_) {
+    InitWorker();
+  }
+}
+
+DrmFbPrefetcher::~DrmFbPrefetcher() {
+  Exit();
+
+  for (auto &job : queue_) {
+    native_handle_close(job.handle);
+    native_handle_delete(job.handle);
+  }
+}
+
+void DrmFbPrefetcher::Prefetch(buffer_handle_t handle,
+                               BufferUniqueId unique_id) {
+  if (!enabled_ || handle == nullptr) {
+    return;
+  }
+
+  Lock();
+  auto queued = std::any_of(queue_.begin(), queue_.end(), [&](auto &job) {
+    return job.unique_id == unique_id;
+  });
+  auto ready = std::any_of(results_.begin(), results_.end(), [&](auto &res) {
+    return res.first == unique_id;
+  });
+  if (queued || ready || in_flight_ == unique_id ||
+      queue_.size() >= kQueueMax) {
+    Unlock();
+    return;
+  }
+  Unlock();
+
+  /* Duplicates the fds, keep it out of the lock */
+  auto *clone = native_handle_clone(handle);
+  if (clone == nullptr) {
+    ALOGW("Unable to clone buffer handle (0x%p)", handle);
+    return;
+  }
+
+  Lock();
+  queue_.push_back({.unique_id = unique_id, .handle = clone});
+  Unlock();
+  Signal();
+}
+
+auto DrmFbPrefetcher::Take(BufferUniqueId unique_id)
+    -> std::optional<Result> {
+  if (!enabled_) {
+    return {};
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [&] { return in_flight_ != unique_id; });
+
+  auto result = std::find_if(results_.begin(), results_.end(),
+                             [&](auto &res) { return res.first == unique_id; });
+  if (result != results_.end()) {
+    auto taken = std::move(result->second);
+    results_.erase(result);
+    taken_++;
+    return taken;
+  }
+
+  /* Not started yet, importing right away is faster than waiting */
+  auto job = std::find_if(queue_.begin(), queue_.end(),
+                          [&](auto &j) { return j.unique_id == unique_id; });
+  if (job != queue_.end()) {
+    native_handle_close(job->handle);
+    native_handle_delete(job->handle);
+    queue_.erase(job);
+  }
+
+  return {};
+}
+
+auto DrmFbPrefetcher::Import(buffer_handle_t handle, BufferUniqueId unique_id)
+    -> Result {
+  ATRACE_NAME("Prefetch FB");
+
+  Result result{};
+  result.bi = BufferInfoGetter::GetInstance()->GetCachedBoInfo(handle,
+                                                               unique_id);
+  if (!result.bi) {
+    return result;
+  }
+
+  result.fb = importer_->GetOrCreateFbId(&result.bi.value());
+
+  /* The fds are closed together with the cloned handle */
+  std::fill(std::begin(result.bi->prime_fds), std::end(result.bi->prime_fds),
+            0);
+
+  return result;
+}
+
+void DrmFbPrefetcher::Routine() {
+  Lock();
+  if (queue_.empty() && WaitForSignalOrExitLocked() == -EINTR) {
+    Unlock();
+    return;
+  }
+  if (queue_.empty()) {
+    Unlock();
+    return;
+  }
+  auto job = queue_.front();
+  queue_.pop_front();
+  in_flight_ = job.unique_id;
+  Unlock();
+
+  auto result = Import(job.handle, job.unique_id);
+  native_handle_close(job.handle);
+  native_handle_delete(job.handle);
+
+  Lock();
+  in_flight_.reset();
+  results_.emplace_back(job.unique_id, std::move(result));
+  prefetched_++;
+  if (results_.size() > kResultsMax) {
+    /* Replaced before presenting */
+    results_.pop_front();
+    dropped_++;
+  }
+  Unlock();
+
+  /* Wakes up Take() */
+  Signal();
+}
+
+auto DrmFbPrefetcher::Dump() -> std::string {
+  Lock();
+  std::stringstream ss;
+  ss << "  Framebuffer prefetch: " << (enabled_ ? "enabled" : "disabled")
+     << ", prefetched / taken / dropped: " << prefetched_ << " / " << taken_
+     << " / " << dropped_ << "\n";
+  Unlock();
+  return ss.str();
+}
+
+}  // namespace android
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRM_DRMFBPREFETCHER_H_
+#define DRM_DRMFBPREFETCHER_H_
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "bufferinfo/BufferInfoGetter.h"
+#include "drm/DrmFbImporter.h"
+#include "utils/Worker.h"
+
+namespace android {
+
+/*
+ * Imports buffers in background as soon as they are set to a layer, so that
+ * the present path only collects the framebuffers.
+ *
+ * The buffer handle is owned by the client and may be released right after
+ * it is replaced, so the worker imports a clone of it. Both the queue and the
+ * results not collected yet are bounded, anything not prefetched in time is
+ * imported synchronously by the layer as before.
+ */
+class DrmFbPrefetcher : public Worker {
+ public:
+  struct Result {
+    std::optional<BufferInfo> bi;
+    std::shared_ptr<DrmFbIdHandle> fb;
+  };
+
+  explicit DrmFbPrefetcher(DrmFbImporter &importer);
+  ~DrmFbPrefetcher() override;
+  DrmFbPrefetcher(const DrmFbPrefetcher &) = delete;
+  DrmFbPrefetcher(DrmFbPrefetcher &&) = delete;
+  auto operator=(const DrmFbPrefetcher &) = delete;
+  auto operator=(DrmFbPrefetcher &&) = delete;
+
+  void Prefetch(buffer_handle_t handle, BufferUniqueId unique_id);
+
+  /* Returns the import result of the buffer, if it is being imported right
+   * now waits for it.
+   */
+  auto Take(BufferUniqueId unique_id) -> std::optional<Result>;
+
+  auto Dump() -> std::string;
+
+ protected:
+  void Routine() override;
+
+ private:
+  static constexpr size_t kQueueMax = 8;
+  static constexpr size_t kResultsMax = 8;
+
+  struct Job {
+    BufferUniqueId unique_id;
+    native_handle_t *handle;
+  };
+
+  auto Import(buffer_handle_t handle, BufferUniqueId unique_id) -> Result;
+
+  DrmFbImporter *const importer_;
+  bool enabled_{};
+
+  std::deque<Job> queue_;
+  std::optional<BufferUniqueId> in_flight_;
+  std::deque<std::pair<BufferUniqueId, Result>> results_;
+
+  uint64_t prefetched_{};
+  uint64_t taken_{};
+  uint64_t dropped_{};
+};
+
+}  // namespace android
+
+#endif
@@ -121,8 +121,7 @@ void DrmMode::SetId(uint32_t id) {
   id_ = id;
 }
 
-auto DrmMode::CreateModeBlob(const DrmDevice &drm)
-    -> DrmModeUserPropertyBlobUnique {
+auto DrmMode::CreateModeBlob(const DrmDevice &drm) -> DrmPropertyBlobShared {
   struct drm_mode_modeinfo drm_mode = {
       .clock = clock_,
       .hdisplay = h_display_,
@@ -141,8 +140,8 @@ auto DrmMode::CreateModeBlob(const DrmDevice &drm)
   };
   strncpy(drm_mode.name, name_.c_str(), DRM_DISPLAY_MODE_LEN);
 
-  return drm.RegisterUserPropertyBlob(&drm_mode,
-                                       sizeof(struct drm_mode_modeinfo));
+  return drm.GetPropertyBlobCache().Get(&drm_mode,
+                                         sizeof(struct drm_mode_modeinfo));
 }
 
 }  // namespace android
@@ -119,6 +119,9 @@ int DrmPlane::Init() {
 
   GetPlaneProperty("IN_FENCE_FD", in_fence_fd_property_, Presence::kOptional);
 
+  GetPlaneProperty("FB_DAMAGE_CLIPS", fb_damage_clips_property_,
+                   Presence::kOptional);
+
   if (HasNonRgbFormat()) {
     if (GetPlaneProperty("COLOR_ENCODING", color_encoding_propery_,
                          Presence::kOptional)) {
@@ -216,6 +219,17 @@ static uint64_t ToDrmRotation(LayerTransform transform) {
   return rotation;
 }
 
+const std::array<DrmProperty DrmPlane::*, 16> DrmPlane::kStateProperties = {
+    &DrmPlane::crtc_property_,          &DrmPlane::fb_property_,
+    &DrmPlane::crtc_x_property_,        &DrmPlane::crtc_y_property_,
+    &DrmPlane::crtc_w_property_,        &DrmPlane::crtc_h_property_,
+    &DrmPlane::src_x_property_,         &DrmPlane::src_y_property_,
+    &DrmPlane::src_w_property_,         &DrmPlane::src_h_property_,
+    &DrmPlane::zpos_property_,          &DrmPlane::rotation_property_,
+    &DrmPlane::alpha_property_,         &DrmPlane::blend_property_,
+    &DrmPlane::color_encoding_propery_, &DrmPlane::color_range_property_,
+};
+
 /* Convert float to 16.16 fixed point */
 static int To1616FixPt(float in) {
   constexpr int kBitShift = 16;
@@ -229,61 +243,92 @@ auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
     return -EINVAL;
   }
 
+  DropStagedState();
+
   if (zpos_property_ && !zpos_property_.is_immutable()) {
     uint64_t min_zpos = 0;
 
     // Ignore ret and use min_zpos as 0 by default
     std::tie(std::ignore, min_zpos) = zpos_property_.range_min();
 
-    if (!zpos_property_.AtomicSet(pset, zpos + min_zpos)) {
+    if (!zpos_property_.AtomicSetChanged(pset, zpos + min_zpos)) {
       return -EINVAL;
     }
   }
 
+  /* The fence is a new one for every frame */
   if (layer.acquire_fence &&
       !in_fence_fd_property_.AtomicSet(pset, layer.acquire_fence.Get())) {
     return -EINVAL;
   }
 
+  /* Without clips the whole buffer is updated. The damage is relative to
+   * the prior buffers of the layer, so it is useless if the plane showed
+   * another layer last time.
+   */
+  DrmPropertyBlobShared damage_blob;
+  staged_damage_source_ = layer.damage_source;
+  if (fb_damage_clips_property_ && layer.damage &&
+      !IsDamageEmpty(*layer.damage) && layer.damage_source != 0 &&
+      layer.damage_source == damage_source_) {
+    auto &damage = *layer.damage;
+    drm_mode_rect clip = {.x1 = damage.left,
+                          .y1 = damage.top,
+                          .x2 = damage.right,
+                          .y2 = damage.bottom};
+    damage_blob = drm_->GetPropertyBlobCache().Get(&clip, sizeof(clip));
+    if (damage_blob &&
+        !fb_damage_clips_property_.AtomicSet(pset, *damage_blob)) {
+      return -EINVAL;
+    }
+  }
+  damage_blob_ = std::move(damage_blob);
+
   auto &disp = layer.pi.display_frame;
   auto &src = layer.pi.source_crop;
-  if (!crtc_property_.AtomicSet(pset, crtc_id) ||
-      !fb_property_.AtomicSet(pset, layer.fb->GetFbId()) ||
-      !crtc_x_property_.AtomicSet(pset, disp.left) ||
-      !crtc_y_property_.AtomicSet(pset, disp.top) ||
-      !crtc_w_property_.AtomicSet(pset, disp.right - disp.left) ||
-      !crtc_h_property_.AtomicSet(pset, disp.bottom - disp.top) ||
-      !src_x_property_.AtomicSet(pset, To1616FixPt(src.left)) ||
-      !src_y_property_.AtomicSet(pset, To1616FixPt(src.top)) ||
-      !src_w_property_.AtomicSet(pset, To1616FixPt(src.right - src.left)) ||
-      !src_h_property_.AtomicSet(pset, To1616FixPt(src.bottom - src.top))) {
+  if (!crtc_property_.AtomicSetChanged(pset, crtc_id) ||
+      !fb_property_.AtomicSetChanged(pset, layer.fb->GetFbId()) ||
+      !crtc_x_property_.AtomicSetChanged(pset, disp.left) ||
+      !crtc_y_property_.AtomicSetChanged(pset, disp.top) ||
+      !crtc_w_property_.AtomicSetChanged(pset, disp.right - disp.left) ||
+      !crtc_h_property_.AtomicSetChanged(pset, disp.bottom - disp.top) ||
+      !src_x_property_.AtomicSetChanged(pset, To1616FixPt(src.left)) ||
+      !src_y_property_.AtomicSetChanged(pset, To1616FixPt(src.top)) ||
+      !src_w_property_.AtomicSetChanged(pset,
+                                        To1616FixPt(src.right - src.left)) ||
+      !src_h_property_.AtomicSetChanged(pset,
+                                        To1616FixPt(src.bottom - src.top))) {
     return -EINVAL;
   }
 
   if (rotation_property_ &&
-      !rotation_property_.AtomicSet(pset, ToDrmRotation(layer.pi.transform))) {
+      !rotation_property_
+           .AtomicSetChanged(pset, ToDrmRotation(layer.pi.transform))) {
     return -EINVAL;
   }
 
-  if (alpha_property_ && !alpha_property_.AtomicSet(pset, layer.pi.alpha)) {
+  if (alpha_property_ &&
+      !alpha_property_.AtomicSetChanged(pset, layer.pi.alpha)) {
     return -EINVAL;
   }
 
   if (blending_enum_map_.count(layer.bi->blend_mode) != 0 &&
-      !blend_property_.AtomicSet(pset,
-                                 blending_enum_map_[layer.bi->blend_mode])) {
+      !blend_property_
+           .AtomicSetChanged(pset, blending_enum_map_[layer.bi->blend_mode])) {
     return -EINVAL;
   }
 
   if (color_encoding_enum_map_.count(layer.bi->color_space) != 0 &&
       !color_encoding_propery_
-           .AtomicSet(pset, color_encoding_enum_map_[layer.bi->color_space])) {
+           .AtomicSetChanged(pset,
+                             color_encoding_enum_map_[layer.bi->color_space])) {
     return -EINVAL;
   }
 
   if (color_range_enum_map_.count(layer.bi->sample_range) != 0 &&
       !color_range_property_
-           .AtomicSet(pset, color_range_enum_map_[layer.bi->sample_range])) {
+           .AtomicSetChanged(pset,
+                             color_range_enum_map_[layer.bi->sample_range])) {
     return -EINVAL;
   }
 
@@ -291,13 +336,31 @@ auto DrmPlane::AtomicSetState(drmModeAtomicReq &pset, LayerData &layer,
 }
 
 auto DrmPlane::AtomicDisablePlane(drmModeAtomicReq &pset) -> int {
-  if (!crtc_property_.AtomicSet(pset, 0) || !fb_property_.AtomicSet(pset, 0)) {
+  DropStagedState();
+  damage_blob_ = {};
+  staged_damage_source_ = 0;
+
+  if (!crtc_property_.AtomicSetChanged(pset, 0) ||
+      !fb_property_.AtomicSetChanged(pset, 0)) {
     return -EINVAL;
   }
 
   return 0;
 }
 
+void DrmPlane::AtomicStateCommitted() {
+  for (auto property : kStateProperties) {
+    (this->*property).CommitStaged();
+  }
+  damage_source_ = staged_damage_source_;
+}
+
+void DrmPlane::DropStagedState() {
+  for (auto property : kStateProperties) {
+    (this->*property).DropStaged();
+  }
+}
+
 auto DrmPlane::GetPlaneProperty(const char *prop_name, DrmProperty &property,
                                 Presence presence) -> bool {
   int err = drm_->GetProperty(GetId(), DRM_MODE_OBJECT_PLANE, prop_name,
@@ -19,10 +19,12 @@
 #include <cstdint>
 #include <xf86drmMode.h>
 
+#include <array>
 #include <vector>
 
 #include "DrmCrtc.h"
 #include "DrmProperty.h"
+#include "DrmPropertyBlobCache.h"
 #include "compositor/LayerData.h"
 
 namespace android {
@@ -51,6 +53,15 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
   auto AtomicSetState(drmModeAtomicReq &pset, LayerData &layer, uint32_t zpos,
                       uint32_t crtc_id) -> int;
   auto AtomicDisablePlane(drmModeAtomicReq &pset) -> int;
+  /* Properties not changed since the last committed request are left out of
+   * the new ones. Call once the request built by the last AtomicSetState() or
+   * AtomicDisablePlane() got applied.
+   */
+  void AtomicStateCommitted();
+  /* Upper bound of the properties set by AtomicSetState() */
+  static auto GetAtomicPropertiesMax() -> size_t {
+    return kStateProperties.size() + 2;
+  }
   auto &GetZPosProperty() const {
     return zpos_property_;
   }
@@ -70,6 +81,12 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
   auto Init() -> int;
   auto GetPlaneProperty(const char *prop_name, DrmProperty &property,
                         Presence presence = Presence::kMandatory) -> bool;
+  void DropStagedState();
+
+  /* Shadowed properties, IN_FENCE_FD and FB_DAMAGE_CLIPS are set for every
+   * frame
+   */
+  static const std::array<DrmProperty DrmPlane::*, 16> kStateProperties;
 
   uint32_t type_{};
 
@@ -90,9 +107,16 @@ class DrmPlane : public PipelineBindable<DrmPlane> {
   DrmProperty alpha_property_;
   DrmProperty blend_property_;
   DrmProperty in_fence_fd_property_;
+  DrmProperty fb_damage_clips_property_;
   DrmProperty color_encoding_propery_;
   DrmProperty color_range_property_;
 
+  /* Kept until the next request, the same damage reuses the blob */
+  DrmPropertyBlobShared damage_blob_;
+  /* Layer shown by the plane, see LayerData::damage_source */
+  uint64_t damage_source_{};
+  uint64_t staged_damage_source_{};
+
   std::map<BufferBlendMode, uint64_t> blending_enum_map_;
   std::map<BufferColorSpace, uint64_t> color_encoding_enum_map_;
   std::map<BufferSampleRange, uint64_t> color_range_enum_map_;
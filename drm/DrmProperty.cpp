@@ -152,4 +152,22 @@ auto DrmProperty::AtomicSet(drmModeAtomicReq &pset, uint64_t value) const
   return true;
 }
 
+auto DrmProperty::AtomicSetChanged(drmModeAtomicReq &pset, uint64_t value)
+    -> bool {
+  if (committed_value_ == value) {
+    staged_value_.reset();
+    return true;
+  }
+
+  staged_value_ = value;
+  return AtomicSet(pset, value);
+}
+
+void DrmProperty::CommitStaged() {
+  if (staged_value_) {
+    committed_value_ = staged_value_;
+    staged_value_.reset();
+  }
+}
+
 }  // namespace android
@@ -20,6 +20,7 @@
 #include <xf86drmMode.h>
 
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -57,6 +58,17 @@ class DrmProperty {
   [[nodiscard]] auto AtomicSet(drmModeAtomicReq &pset, uint64_t value) const
       -> bool;
 
+  /* Same as AtomicSet(), but skips the value last committed to the object.
+   * A new value is staged, CommitStaged() makes it the committed one once
+   * the request is applied by the kernel.
+   */
+  [[nodiscard]] auto AtomicSetChanged(drmModeAtomicReq &pset, uint64_t value)
+      -> bool;
+  void CommitStaged();
+  void DropStaged() {
+    staged_value_.reset();
+  }
+
   template <class E>
   auto AddEnumToMap(const std::string &name, E key, std::map<E, uint64_t> &map)
       -> bool;
@@ -86,6 +98,10 @@ class DrmProperty {
   std::vector<uint64_t> values_;
   std::vector<DrmPropertyEnum> enums_;
   std::vector<uint32_t> blob_ids_;
+
+  /* Unknown until the first commit, the initial value may be stale */
+  std::optional<uint64_t> committed_value_;
+  std::optional<uint64_t> staged_value_;
 };
 
 template <class E>
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DrmPropertyBlobCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "DrmDevice.h"
+
+namespace android {
+
+auto DrmPropertyBlobCache::Get(const void *data, size_t length)
+    -> DrmPropertyBlobShared {
+  if (data == nullptr || length == 0) {
+    return {};
+  }
+
+  auto hash = std::hash<std::string_view>{}(
+      std::string_view(static_cast<const char *>(data), length));
+
+  const std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : entries_) {
+    if (entry.hash != hash || entry.data.size() != length ||
+        memcmp(entry.data.data(), data, length) != 0) {
+      continue;
+    }
+
+    auto blob = entry.blob.lock();
+    if (blob) {
+      return blob;
+    }
+  }
+
+  entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                [](auto &entry) {
+                                  return entry.blob.expired();
+                                }),
+                 entries_.end());
+
+  Entry entry{.hash = hash};
+  auto *bytes = static_cast<const uint8_t *>(data);
+  entry.data.assign(bytes, bytes + length);
+
+  DrmPropertyBlobShared blob = drm_->RegisterUserPropertyBlob(entry.data.data(),
+                                                              length);
+  if (!blob) {
+    return {};
+  }
+
+  entry.blob = blob;
+  entries_.emplace_back(std::move(entry));
+  return blob;
+}
+
+}  // namespace android
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DRM_PROPERTY_BLOB_CACHE_H_
+#define ANDROID_DRM_PROPERTY_BLOB_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace android {
+
+class DrmDevice;
+
+using DrmPropertyBlobShared = std::shared_ptr<const uint32_t /*id*/>;
+
+/*
+ * User property blobs (modes, HDR metadata, color matrices and LUTs) shared
+ * by their contents.
+ *
+ * A blob is destroyed once nothing holds it anymore, frame states hold the
+ * blobs they commit until they are retired. Meanwhile the same contents get
+ * the same blob id, without an ioctl.
+ */
+class DrmPropertyBlobCache {
+ public:
+  explicit DrmPropertyBlobCache(DrmDevice &drm) : drm_(&drm) {
+  }
+
+  auto Get(const void *data, size_t length) -> DrmPropertyBlobShared;
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::vector<uint8_t> data;
+    std::weak_ptr<const uint32_t> blob;
+  };
+
+  DrmDevice *const drm_;
+
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+};
+
+}  // namespace android
+
+#endif
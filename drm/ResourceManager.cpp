@@ -123,7 +123,7 @@ void ResourceManager::Init() {
   }
 
   uevent_listener_.RegisterHotplugHandler([this] {
-    const std::lock_guard<std::mutex> lock(GetMainLock());
+    const std::lock_guard<InstrumentedMutex> lock(GetMainLock());
     UpdateFrontendDisplays();
   });
 
@@ -159,7 +159,11 @@ void ResourceManager::UpdateFrontendDisplays() {
   auto ordered_connectors = GetOrderedConnectors();
 
   for (auto *conn : ordered_connectors) {
-    conn->UpdateModes();
+    {
+      /* The modes are used by the frame path of the attached display */
+      auto lock = LockFrontendDisplay(conn);
+      conn->UpdateModes();
+    }
     bool connected = conn->IsConnected();
     bool attached = attached_pipelines_.count(conn) != 0;
 
@@ -175,7 +179,10 @@ void ResourceManager::UpdateFrontendDisplays() {
         }
       } else {
         auto &pipeline = attached_pipelines_[conn];
-        pipeline->AtomicDisablePipeline();
+        {
+          auto lock = LockFrontendDisplay(conn);
+          pipeline->AtomicDisablePipeline();
+        }
         frontend_interface_->UnbindDisplay(pipeline.get());
         attached_pipelines_.erase(conn);
       }
@@ -195,6 +202,8 @@ void ResourceManager::UpdateFrontendDisplays() {
           ALOGW("Connector %u link status bad", conn->GetId());
           HwcDisplay *display = frontend_interface_->GetDisplay(pipeline.get());
           if (display) {
+            const std::lock_guard<InstrumentedMutex> lock(
+                display->GetDisplayLock());
             display->SetPowerMode(static_cast<int32_t>(HWC2::PowerMode::Off));
             display->ChosePreferredConfig();
             display->SetPowerMode(static_cast<int32_t>(HWC2::PowerMode::On));
@@ -217,6 +226,21 @@ void ResourceManager::DetachAllFrontendDisplays() {
   frontend_interface_->FinalizeDisplayBinding();
 }
 
+auto ResourceManager::LockFrontendDisplay(DrmConnector *conn)
+    -> std::unique_lock<InstrumentedMutex> {
+  auto pipeline = attached_pipelines_.find(conn);
+  if (pipeline == attached_pipelines_.end()) {
+    return {};
+  }
+
+  auto *display = frontend_interface_->GetDisplay(pipeline->second.get());
+  if (display == nullptr) {
+    return {};
+  }
+
+  return std::unique_lock<InstrumentedMutex>(display->GetDisplayLock());
+}
+
 auto ResourceManager::GetOrderedConnectors() -> std::vector<DrmConnector *> {
   /* Put internal displays first then external to
    * ensure Internal will take Primary slot
@@ -18,11 +18,13 @@
 #define RESOURCEMANAGER_H
 
 #include <cstring>
+#include <mutex>
 
 #include "DrmDevice.h"
 #include "DrmDisplayPipeline.h"
 #include "DrmFbImporter.h"
 #include "UEventListener.h"
+#include "utils/InstrumentedMutex.h"
 
 namespace android {
 class HwcDisplay;
@@ -53,6 +55,9 @@ class ResourceManager {
     return scale_with_gpu_;
   }
 
+  /* Serializes hotplug and display topology changes, see HwcDisplay for the
+   * locking of the frame path.
+   */
   auto &GetMainLock() {
     return main_lock_;
   }
@@ -63,6 +68,8 @@ class ResourceManager {
   auto GetOrderedConnectors() -> std::vector<DrmConnector *>;
   void UpdateFrontendDisplays();
   void DetachAllFrontendDisplays();
+  auto LockFrontendDisplay(DrmConnector *conn)
+      -> std::unique_lock<InstrumentedMutex>;
 
   std::vector<std::unique_ptr<DrmDevice>> drms_;
 
@@ -70,7 +77,7 @@ class ResourceManager {
 
   UEventListener uevent_listener_;
 
-  std::mutex main_lock_;
+  InstrumentedMutex main_lock_;
 
   std::map<DrmConnector *, std::unique_ptr<DrmDisplayPipeline>>
       attached_pipelines_;
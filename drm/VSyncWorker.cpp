@@ -25,30 +25,125 @@
 #include <cstring>
 #include <ctime>
 
+#include "drm/DrmEventDispatcher.h"
 #include "utils/log.h"
 
 namespace android {
 
 VSyncWorker::VSyncWorker() : Worker("vsync", HAL_PRIORITY_URGENT_DISPLAY){};
 
+VSyncWorker::~VSyncWorker() {
+  VSyncControl(false);
+  Init(nullptr, {});
+  for (auto *device : event_devices_) {
+    device->GetEventDispatcher().WaitForHandlers();
+  }
+  Exit();
+}
+
+static auto GetCrtcIndex(DrmDisplayPipeline *pipe) -> uint32_t {
+  return pipe->crtc->Get()->GetIndexInResArray();
+}
+
 auto VSyncWorker::Init(DrmDisplayPipeline *pipe,
                        std::function<void(uint64_t /*timestamp*/)> callback)
     -> int {
+  Lock();
+  auto *prev_pipe = pipe_;
   pipe_ = pipe;
   callback_ = std::move(callback);
+  vblank_events_ = false;
+  Unlock();
 
-  return InitWorker();
+  if (prev_pipe != nullptr) {
+    prev_pipe->device->GetEventDispatcher().SetVblankHandler(
+        GetCrtcIndex(prev_pipe), {});
+  }
+
+  if (pipe != nullptr) {
+    event_devices_.insert(pipe->device);
+    pipe->device->GetEventDispatcher().SetVblankHandler(
+        GetCrtcIndex(pipe),
+        [this](int64_t timestamp) { OnVblankEvent(timestamp); });
+  }
+
+  if (enabled_) {
+    VSyncControl(true);
+  }
+
+  return 0;
 }
 
 void VSyncWorker::VSyncControl(bool enabled) {
   Lock();
   enabled_ = enabled;
   last_timestamp_ = -1;
+  auto *pipe = pipe_;
+  Unlock();
+
+  if (!enabled) {
+    if (pipe != nullptr) {
+      pipe->device->GetEventDispatcher().EnableVblank(GetCrtcIndex(pipe),
+                                                      false);
+    }
+    Lock();
+    vblank_events_ = false;
+    Unlock();
+    return;
+  }
+
+  if (!EnableVblankEvents(pipe)) {
+    StartSynthetic();
+  }
+}
+
+auto VSyncWorker::EnableVblankEvents(DrmDisplayPipeline *pipe) -> bool {
+  if (pipe == nullptr ||
+      pipe->device->GetEventDispatcher().EnableVblank(GetCrtcIndex(pipe),
+                                                      true) != 0) {
+    return false;
+  }
+
+  Lock();
+  vblank_events_ = true;
+  Unlock();
+  return true;
+}
+
+void VSyncWorker::StartSynthetic() {
+  Lock();
+  vblank_events_ = false;
   Unlock();
 
+  /* The thread is created on the first use only */
+  InitWorker();
   Signal();
 }
 
+void VSyncWorker::OnVblankEvent(int64_t timestamp) {
+  if (timestamp < 0) {
+    /* The CRTC stopped delivering the events */
+    if (enabled_) {
+      StartSynthetic();
+    }
+    return;
+  }
+
+  if (!enabled_)
+    return;
+
+  /* Init() may replace the callback meanwhile */
+  Lock();
+  auto callback = callback_;
+  Unlock();
+
+  if (callback) {
+    callback(timestamp);
+  }
+
+  last_timestamp_ = timestamp;
+}
+
 /*
  * Returns the timestamp of the next vsync in phase with last_timestamp_.
  * For example:
@@ -104,7 +199,7 @@ void VSyncWorker::Routine() {
   int ret = 0;
 
   Lock();
-  if (!enabled_) {
+  if (!enabled_ || vblank_events_) {
     ret = WaitForSignalOrExitLocked();
     if (ret == -EINTR) {
       Unlock();
@@ -113,35 +208,23 @@ void VSyncWorker::Routine() {
   }
 
   auto *pipe = pipe_;
+  bool synthetic = enabled_ && !vblank_events_;
   Unlock();
 
-  ret = -EAGAIN;
-  int64_t timestamp = 0;
-  drmVBlank vblank{};
-
-  if (pipe != nullptr) {
-    uint32_t high_crtc = (pipe->crtc->Get()->GetIndexInResArray()
-                          << DRM_VBLANK_HIGH_CRTC_SHIFT);
-
-    vblank.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
-                                             (high_crtc &
-                                              DRM_VBLANK_HIGH_CRTC_MASK));
-    vblank.request.sequence = 1;
-
-    ret = drmWaitVBlank(pipe->device->GetFd(), &vblank);
-    if (ret == -EINTR)
-      return;
+  if (!synthetic) {
+    return;
   }
 
-  if (ret) {
-    ret = SyntheticWaitVBlank(&timestamp);
-    if (ret)
-      return;
-  } else {
-    timestamp = (int64_t)vblank.reply.tval_sec * kOneSecondNs +
-                (int64_t)vblank.reply.tval_usec * 1000;
+  /* Switch back to the vblank events once the CRTC can deliver them */
+  if (EnableVblankEvents(pipe)) {
+    return;
   }
 
+  int64_t timestamp = 0;
+  ret = SyntheticWaitVBlank(&timestamp);
+  if (ret)
+    return;
+
   if (!enabled_)
     return;
 
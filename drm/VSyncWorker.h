@@ -25,16 +25,22 @@
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <set>
 
 #include "DrmDevice.h"
 #include "utils/Worker.h"
 
 namespace android {
 
+/*
+ * Delivers vsync of the display. Vblank events of the CRTC come from the
+ * device event dispatcher, the own thread is only started to generate
+ * synthetic vsync when there is no CRTC or it can't provide the events.
+ */
 class VSyncWorker : public Worker {
  public:
   VSyncWorker();
-  ~VSyncWorker() override = default;
+  ~VSyncWorker() override;
 
   auto Init(DrmDisplayPipeline *pipe,
             std::function<void(uint64_t /*timestamp*/)> callback) -> int;
@@ -48,10 +54,19 @@ class VSyncWorker : public Worker {
   int64_t GetPhasedVSync(int64_t frame_ns, int64_t current) const;
   int SyntheticWaitVBlank(int64_t *timestamp);
 
+  /* Switches to the vblank events of the CRTC, returns false if impossible */
+  auto EnableVblankEvents(DrmDisplayPipeline *pipe) -> bool;
+  void OnVblankEvent(int64_t timestamp);
+  void StartSynthetic();
+
   std::function<void(uint64_t /*timestamp*/)> callback_;
 
   DrmDisplayPipeline *pipe_ = nullptr;
+  /* Devices whose dispatchers may still run the vblank handler */
+  std::set<DrmDevice *> event_devices_;
   std::atomic_bool enabled_ = false;
+  /* Vsync is delivered by the event dispatcher */
+  bool vblank_events_ = false;
   int64_t last_timestamp_ = -1;
 };
 }  // namespace android
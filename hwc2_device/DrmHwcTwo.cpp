@@ -61,13 +61,14 @@ void DrmHwcTwo::FinalizeDisplayBinding() {
   const int kTimeForSFToDisposeDisplayUs = 200000;
   usleep(kTimeForSFToDisposeDisplayUs);
   mutex.lock();
-  std::vector<std::unique_ptr<HwcDisplay>> for_disposal;
+  std::vector<std::shared_ptr<HwcDisplay>> for_disposal;
   for (auto handle : displays_for_removal_list_) {
-    for_disposal.emplace_back(
-        std::unique_ptr<HwcDisplay>(displays_[handle].release()));
+    for_disposal.emplace_back(std::move(displays_[handle]));
     displays_.erase(handle);
   }
-  /* Destroy HwcDisplays while unlocked to avoid vsyncworker deadlocks */
+  /* Destroy HwcDisplays while unlocked to avoid vsyncworker deadlocks. The
+   * HWC2 calls which found a display before its removal destroy it once done.
+   */
   mutex.unlock();
   for_disposal.clear();
   mutex.lock();
@@ -168,8 +169,18 @@ void DrmHwcTwo::Dump(uint32_t *outSize, char *outBuffer) {
 
   output << "-- drm_hwcomposer --\n\n";
 
-  for (auto &disp : displays_)
+  for (auto &disp : displays_) {
+    const std::lock_guard<InstrumentedMutex> lock(
+        disp.second->GetDisplayLock());
     output << disp.second->Dump();
+  }
+
+  constexpr int64_t kNsInUs = 1000;
+  auto &main_lock = GetResMan().GetMainLock();
+  output << "Main lock hold / wait p99 (us): "
+         << main_lock.GetHoldTimes().Percentile(99) / kNsInUs << " / "
+         << main_lock.GetWaitTimes().Percentile(99) / kNsInUs << " ("
+         << main_lock.GetWaitTimes().Count() << " contended)\n";
 
   mDumpString = output.str();
   *outSize = static_cast<uint32_t>(mDumpString.size());
@@ -192,29 +203,39 @@ HWC2::Error DrmHwcTwo::RegisterCallback(int32_t descriptor,
         resource_manager_.DeInit();
         /* Headless display may still be here. Remove it! */
         if (displays_.count(kPrimaryDisplay) != 0) {
-          displays_[kPrimaryDisplay]->Deinit();
+          auto display = std::move(displays_[kPrimaryDisplay]);
+          displays_.erase(kPrimaryDisplay);
+          {
+            const std::lock_guard<InstrumentedMutex> lock(
+                display->GetDisplayLock());
+            display->Deinit();
+          }
           auto &mutex = GetResMan().GetMainLock();
           mutex.unlock();
-          displays_.erase(kPrimaryDisplay);
+          display.reset();
           mutex.lock();
         }
       }
       break;
     }
     case HWC2::Callback::Refresh: {
+      const std::lock_guard<std::mutex> lock(callback_lock_);
       refresh_callback_ = std::make_pair(HWC2_PFN_REFRESH(function), data);
       break;
     }
     case HWC2::Callback::Vsync: {
+      const std::lock_guard<std::mutex> lock(callback_lock_);
       vsync_callback_ = std::make_pair(HWC2_PFN_VSYNC(function), data);
       break;
     }
 #if PLATFORM_SDK_VERSION > 29
     case HWC2::Callback::Vsync_2_4: {
+      const std::lock_guard<std::mutex> lock(callback_lock_);
       vsync_2_4_callback_ = std::make_pair(HWC2_PFN_VSYNC_2_4(function), data);
       break;
     }
     case HWC2::Callback::VsyncPeriodTimingChanged: {
+      const std::lock_guard<std::mutex> lock(callback_lock_);
       period_timing_changed_callback_ = std::
           make_pair(HWC2_PFN_VSYNC_PERIOD_TIMING_CHANGED(function), data);
       break;
@@ -251,6 +272,7 @@ void DrmHwcTwo::SendHotplugEventToClient(hwc2_display_t displayid,
 void DrmHwcTwo::SendVsyncEventToClient(
     hwc2_display_t displayid, int64_t timestamp,
     [[maybe_unused]] uint32_t vsync_period) const {
+  const std::lock_guard<std::mutex> lock(callback_lock_);
   /* vsync callback */
 #if PLATFORM_SDK_VERSION > 29
   if (vsync_2_4_callback_.first != nullptr &&
@@ -269,6 +291,7 @@ void DrmHwcTwo::SendVsyncPeriodTimingChangedEventToClient(
     [[maybe_unused]] hwc2_display_t displayid,
     [[maybe_unused]] int64_t timestamp) const {
 #if PLATFORM_SDK_VERSION > 29
+  const std::lock_guard<std::mutex> lock(callback_lock_);
   hwc_vsync_period_change_timeline_t timeline = {
       .newVsyncAppliedTimeNanos = timestamp,
       .refreshRequired = false,
@@ -282,4 +305,12 @@ void DrmHwcTwo::SendVsyncPeriodTimingChangedEventToClient(
 #endif
 }
 
+void DrmHwcTwo::SendRefreshEventToClient(hwc2_display_t displayid) const {
+  const std::lock_guard<std::mutex> lock(callback_lock_);
+  if (refresh_callback_.first != nullptr &&
+      refresh_callback_.second != nullptr) {
+    refresh_callback_.first(refresh_callback_.second, displayid);
+  }
+}
+
 }  // namespace android
@@ -29,7 +29,11 @@ class DrmHwcTwo : public PipelineToFrontendBindingInterface {
   DrmHwcTwo();
   ~DrmHwcTwo() override = default;
 
+  /* Under the main lock */
   std::pair<HWC2_PFN_HOTPLUG, hwc2_callback_data_t> hotplug_callback_{};
+  /* Under the callback lock, the events come from the frame path of any
+   * display
+   */
   std::pair<HWC2_PFN_VSYNC, hwc2_callback_data_t> vsync_callback_{};
 #if PLATFORM_SDK_VERSION > 29
   std::pair<HWC2_PFN_VSYNC_2_4, hwc2_callback_data_t> vsync_2_4_callback_{};
@@ -53,6 +57,17 @@ class DrmHwcTwo : public PipelineToFrontendBindingInterface {
                : nullptr;
   }
 
+  /* For the HWC2 calls, which hold the lock of the display instead of the
+   * main lock
+   */
+  auto FindDisplay(hwc2_display_t display_handle)
+      -> std::shared_ptr<HwcDisplay> {
+    const std::lock_guard<InstrumentedMutex> lock(
+        resource_manager_.GetMainLock());
+    auto display = displays_.find(display_handle);
+    return display != displays_.end() ? display->second : nullptr;
+  }
+
   HwcDisplay *GetDisplay(DrmDisplayPipeline *pipeline) override;
 
   auto &GetResMan() {
@@ -72,12 +87,15 @@ class DrmHwcTwo : public PipelineToFrontendBindingInterface {
                               uint32_t vsync_period) const;
   void SendVsyncPeriodTimingChangedEventToClient(hwc2_display_t displayid,
                                                  int64_t timestamp) const;
+  void SendRefreshEventToClient(hwc2_display_t displayid) const;
 
  private:
   void SendHotplugEventToClient(hwc2_display_t displayid, bool connected);
 
+  mutable std::mutex callback_lock_;
+
   ResourceManager resource_manager_;
-  std::map<hwc2_display_t, std::unique_ptr<HwcDisplay>> displays_;
+  std::map<hwc2_display_t, std::shared_ptr<HwcDisplay>> displays_;
   std::map<DrmDisplayPipeline *, hwc2_display_t> display_handles_;
 
   std::string mDumpString;
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-flattening"
+
+#include "FlatteningPolicy.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "drm/ResourceManager.h"
+#include "utils/properties.h"
+
+namespace android {
+
+constexpr int kAndroidPriorityBackground = 10;
+
+static auto ReadIntProperty(const char *name, const char *default_value)
+    -> int64_t {
+  char value[PROPERTY_VALUE_MAX];
+  property_get(name, value, default_value);
+  constexpr int kStrtolBase = 10;
+  return std::max(int64_t(strtol(value, nullptr, kStrtolBase)), int64_t(0));
+}
+
+auto FlatteningPolicy::ReadConfig() -> Config {
+  /* 1 sec, 60 vsyncs @60FPS */
+  constexpr int64_t kNsInMs = 1000000;
+  return {.idle_ns = ReadIntProperty("vendor.hwc.drm.flattening_idle_ms",
+                                     "1000") *
+                     kNsInMs,
+          .min_layers = size_t(
+              ReadIntProperty("vendor.hwc.drm.flattening_min_layers", "2"))};
+}
+
+auto FlatteningPolicy::Evaluate(
+    const std::vector<const LayerActivity *> &layers, int64_t now_ns)
+    -> std::tuple<int, size_t> {
+  next_evaluation_ns_ = 0;
+  if (config_.idle_ns == 0 || layers.size() < config_.min_layers) {
+    return {-1, 0};
+  }
+
+  int best_start = -1;
+  size_t best_size = 0;
+  int start = -1;
+  for (size_t z_order = 0; z_order <= layers.size(); z_order++) {
+    bool is_static = false;
+    if (z_order < layers.size()) {
+      auto static_ns = layers[z_order]->last_update_ns + config_.idle_ns;
+      is_static = static_ns <= now_ns;
+      if (!is_static && (next_evaluation_ns_ == 0 ||
+                         static_ns < next_evaluation_ns_)) {
+        next_evaluation_ns_ = static_ns;
+      }
+    }
+
+    if (is_static) {
+      if (start < 0) {
+        start = int(z_order);
+      }
+      continue;
+    }
+
+    if (start >= 0 && z_order - start > best_size) {
+      best_start = start;
+      best_size = z_order - start;
+    }
+    start = -1;
+  }
+
+  if (best_size < std::max(config_.min_layers, size_t(1))) {
+    return {-1, 0};
+  }
+
+  return {best_start, best_size};
+}
+
+FlatteningTimer::FlatteningTimer(std::function<void()> handler)
+    : Worker("flattening", kAndroidPriorityBackground),
+      handler_(std::move(handler)) {
+}
+
+FlatteningTimer::~FlatteningTimer() {
+  Exit();
+}
+
+void FlatteningTimer::Arm(int64_t deadline_ns) {
+  Lock();
+  /* Otherwise the thread checks the new deadline once it wakes up */
+  bool wake = deadline_ns != 0 &&
+              (deadline_ns_ == 0 || deadline_ns < deadline_ns_);
+  deadline_ns_ = deadline_ns;
+  Unlock();
+
+  if (wake) {
+    Signal();
+  }
+}
+
+void FlatteningTimer::Routine() {
+  Lock();
+  if (deadline_ns_ == 0) {
+    WaitForSignalOrExitLocked();
+    Unlock();
+    return;
+  }
+
+  auto now = ResourceManager::GetTimeMonotonicNs();
+  if (now < deadline_ns_) {
+    WaitForSignalOrExitLocked(deadline_ns_ - now);
+    Unlock();
+    return;
+  }
+
+  deadline_ns_ = 0;
+  Unlock();
+
+  handler_();
+}
+
+}  // namespace android
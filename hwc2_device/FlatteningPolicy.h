@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWC2_DEVICE_FLATTENING_POLICY_H
+#define ANDROID_HWC2_DEVICE_FLATTENING_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include "utils/Worker.h"
+
+namespace android {
+
+/* Content (buffer or geometry) updates of a layer */
+struct LayerActivity {
+  int64_t last_update_ns{};
+  /* Moving average of the time between the updates, 0 until the second one */
+  int64_t update_interval_ns{};
+
+  void Update(int64_t now_ns) {
+    if (last_update_ns != 0) {
+      auto interval = now_ns - last_update_ns;
+      update_interval_ns = update_interval_ns == 0
+                               ? interval
+                               : (update_interval_ns * 7 + interval) / 8;
+    }
+    last_update_ns = now_ns;
+  }
+};
+
+/*
+ * Chooses the layers to flatten, i.e. to compose by the client into the
+ * client target, which stays the same while these layers don't change.
+ *
+ * A layer is static once it hasn't been updated for the idle time. The
+ * longest run (in z-order) of static layers is flattened, the layers updated
+ * more often (video, cursor) stay on the planes.
+ */
+class FlatteningPolicy {
+ public:
+  struct Config {
+    /* 0 disables the flattening */
+    int64_t idle_ns;
+    /* Shorter runs of static layers are not worth the client composition */
+    size_t min_layers;
+  };
+
+  /* vendor.hwc.drm.flattening_idle_ms and
+   * vendor.hwc.drm.flattening_min_layers
+   */
+  static auto ReadConfig() -> Config;
+
+  explicit FlatteningPolicy(Config config) : config_(config) {
+  }
+
+  auto GetConfig() const -> const Config & {
+    return config_;
+  }
+
+  /* Activity of the layers in z-order. Returns the range {start, size} of
+   * the layers to flatten, {-1, 0} if none.
+   */
+  auto Evaluate(const std::vector<const LayerActivity *> &layers,
+                int64_t now_ns) -> std::tuple<int, size_t>;
+
+  /* Time the result may change at without any update, 0 if never */
+  auto GetNextEvaluationNs() const {
+    return next_evaluation_ns_;
+  }
+
+ private:
+  const Config config_;
+  int64_t next_evaluation_ns_{};
+};
+
+/* Calls the handler once the deadline set last has passed */
+class FlatteningTimer : public Worker {
+ public:
+  explicit FlatteningTimer(std::function<void()> handler);
+  ~FlatteningTimer() override;
+  FlatteningTimer(const FlatteningTimer &) = delete;
+  FlatteningTimer(FlatteningTimer &&) = delete;
+  auto operator=(const FlatteningTimer &) = delete;
+  auto operator=(FlatteningTimer &&) = delete;
+
+  auto Init() -> int {
+    return InitWorker();
+  }
+
+  /* CLOCK_MONOTONIC, 0 cancels the timer */
+  void Arm(int64_t deadline_ns);
+
+ protected:
+  void Routine() override;
+
+ private:
+  const std::function<void()> handler_;
+  int64_t deadline_ns_{};
+};
+
+}  // namespace android
+
+#endif
@@ -23,6 +23,7 @@
 #include "backend/Backend.h"
 #include "backend/BackendManager.h"
 #include "bufferinfo/BufferInfoGetter.h"
+#include "drm/DrmFbPrefetcher.h"
 #include "utils/log.h"
 #include "utils/properties.h"
 #include <sync/sync.h>
@@ -43,53 +44,248 @@ std::string HwcDisplay::DumpDelta(HwcDisplay::Stats delta) {
              ? " !!! Internal failure, FIX it please\n"
              : "")
      << " Flattened frames: " << delta.frames_flattened_ << "\n"
+     << " Flattened layers: " << delta.layers_flattened_ << "\n"
+     << " Skipped frames: " << delta.frames_skipped_ << "\n"
      << " Pixel operations (free units)"
      << " : [TOTAL: " << delta.total_pixops_ << " / GPU: " << delta.gpu_pixops_
      << "]\n"
-     << " Composition efficiency: " << ratio;
+     << " Composition efficiency: " << ratio << "\n"
+     << " Latency p50 / p95 / p99 (us):\n";
+
+  constexpr int64_t kNsInUs = 1000;
+  auto dump_latency = [&ss](const char *name, const LatencyHistogram &h) {
+    ss << "  " << name << ": " << h.Percentile(50) / kNsInUs << " / "
+       << h.Percentile(95) / kNsInUs << " / " << h.Percentile(99) / kNsInUs
+       << " (" << h.Count() << " samples)\n";
+  };
+  dump_latency("Validate", delta.validate_ns_);
+  dump_latency("Present", delta.present_ns_);
+  dump_latency("Atomic commit", delta.commit_ns_);
+  dump_latency("Commit to present fence", delta.scanout_ns_);
+  dump_latency("Commit to release", delta.release_ns_);
+  dump_latency("Display lock hold", delta.lock_hold_ns_);
+  dump_latency("Display lock wait", delta.lock_wait_ns_);
 
   return ss.str();
 }
 
+auto HwcDisplay::CurrentFrameTimings() -> FrameTimings & {
+  auto &timings = frame_timings_[frame_no_ % kFrameTimingsRingSize];
+  if (timings.frame_no != frame_no_) {
+    timings = {.frame_no = frame_no_};
+  }
+  return timings;
+}
+
+/* Collect timings of the frames presented since last call */
+void HwcDisplay::UpdatePresentTimings() {
+  if (IsInHeadlessMode()) {
+    return;
+  }
+
+  for (auto &pt : GetPipe().atomic_state_manager->TakePresentTimings()) {
+    total_stats_.scanout_ns_.Record(pt.present_fence_ns - pt.commit_done_ns);
+    total_stats_.release_ns_.Record(pt.release_ns - pt.commit_done_ns);
+
+    auto &timings = frame_timings_[pt.frame_no % kFrameTimingsRingSize];
+    if (timings.frame_no == pt.frame_no) {
+      timings.present_fence_ns = pt.present_fence_ns;
+      timings.release_ns = pt.release_ns;
+    }
+  }
+}
+
+/* Binary export of the frame timings ring for host-side tools:
+ * header {char magic[4] = "HWFT"; uint32_t version; uint32_t record_size;
+ * uint32_t records_num;} followed by FrameTimings records, oldest first.
+ */
+void HwcDisplay::DumpFrameTimings() {
+  char dir[PROPERTY_VALUE_MAX];
+  property_get("vendor.hwc.drm.frame_timings_dir", dir, "");
+  if (dir[0] == '\0') {
+    return;
+  }
+
+  std::vector<FrameTimings> records;
+  records.reserve(kFrameTimingsRingSize);
+  for (uint32_t i = 0; i < kFrameTimingsRingSize; i++) {
+    /* frame_no_ slot contains the frame which is not presented yet */
+    uint32_t frame_no = frame_no_ - kFrameTimingsRingSize + i;
+    auto &timings = frame_timings_[frame_no % kFrameTimingsRingSize];
+    if (timings.frame_no == frame_no && timings.commit_done_ns != 0) {
+      records.emplace_back(timings);
+    }
+  }
+
+  struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t records_num;
+  } header = {{'H', 'W', 'F', 'T'},
+              1,
+              sizeof(FrameTimings),
+              uint32_t(records.size())};
+
+  auto path = std::string(dir) + "/frame_timings_" + std::to_string(handle_) +
+              ".bin";
+  auto fd = UniqueFd(
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (!fd) {
+    ALOGE("Failed to open %s: errno %d", path.c_str(), errno);
+    return;
+  }
+
+  auto size = sizeof(FrameTimings) * records.size();
+  if (write(fd.Get(), &header, sizeof(header)) != sizeof(header) ||
+      write(fd.Get(), records.data(), size) != ssize_t(size)) {
+    ALOGE("Failed to write %s: errno %d", path.c_str(), errno);
+  }
+}
+
+void HwcDisplay::TraceValidatedFrame(HWC2::Error validate_error) {
+  auto *records = layer_trace_.BeginFrame(uint32_t(layers_.size()));
+  if (records == nullptr) {
+    return;
+  }
+
+  auto &timings = CurrentFrameTimings();
+  auto &frame = *layer_trace_.PendingFrame();
+  frame.frame_no = frame_no_;
+  frame.display = uint32_t(handle_);
+  frame.validate_start_ns = timings.validate_start_ns;
+  frame.validate_end_ns = timings.validate_end_ns;
+  frame.validate_error = static_cast<int32_t>(validate_error);
+
+  for (auto &[id, layer] : layers_) {
+    layer.FillLayerTraceRecord(id, *records++);
+  }
+}
+
+/* Called right before the commit, while the layers still own the fences */
+void HwcDisplay::TraceAcquireFences() {
+  auto *frame = layer_trace_.PendingFrame();
+  if (frame == nullptr || frame->frame_no != frame_no_) {
+    return;
+  }
+
+  auto *records = layer_trace_.PendingLayers();
+  for (uint32_t i = 0; i < frame->layers_num; i++) {
+    auto *layer = get_layer(records[i].layer_id);
+    if (layer != nullptr) {
+      records[i].acquire_fence_ns = layer->GetAcquireFenceSignalTimeNs();
+    }
+  }
+}
+
+void HwcDisplay::TracePresentedFrame(HWC2::Error present_error) {
+  auto *frame = layer_trace_.PendingFrame();
+  if (frame == nullptr || frame->frame_no != frame_no_) {
+    return;
+  }
+
+  auto &timings = CurrentFrameTimings();
+  frame->present_start_ns = timings.present_start_ns;
+  frame->commit_done_ns = timings.commit_done_ns;
+  frame->present_error = static_cast<int32_t>(present_error);
+  layer_trace_.EndFrame();
+}
+
+/* Recording is controlled by vendor.hwc.drm.layer_trace_dir, which is checked
+ * on every dump: setting it starts recording, clearing it stops recording and
+ * releases the ring. While recording, every dump moves the recorded frames to
+ * <dir>/layer_trace_<display>_<first frame>.bin.
+ */
+void HwcDisplay::DumpLayerTrace() {
+  char dir[PROPERTY_VALUE_MAX];
+  property_get("vendor.hwc.drm.layer_trace_dir", dir, "");
+  if (dir[0] == '\0') {
+    layer_trace_.Disable();
+    return;
+  }
+
+  if (!layer_trace_.IsEnabled()) {
+    layer_trace_.Enable();
+    return;
+  }
+
+  if (layer_trace_.IsEmpty()) {
+    return;
+  }
+
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t vsync_period_ns = 0;
+  GetDisplayAttribute(configs_.active_config_id, HWC2_ATTRIBUTE_WIDTH, &width);
+  GetDisplayAttribute(configs_.active_config_id, HWC2_ATTRIBUTE_HEIGHT,
+                      &height);
+  GetDisplayVsyncPeriod(&vsync_period_ns);
+
+  LayerTraceHeader header = {.magic = kLayerTraceMagic,
+                             .version = kLayerTraceVersion,
+                             .frame_record_size = sizeof(LayerTraceFrame),
+                             .layer_record_size = sizeof(LayerTraceLayer),
+                             .display_width = uint32_t(width),
+                             .display_height = uint32_t(height),
+                             .vsync_period_ns = vsync_period_ns};
+
+  auto path = std::string(dir) + "/layer_trace_" + std::to_string(handle_) +
+              "_" + std::to_string(layer_trace_.FirstFrameNo()) + ".bin";
+  auto fd = UniqueFd(
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (!fd) {
+    ALOGE("Failed to open %s: errno %d", path.c_str(), errno);
+    return;
+  }
+
+  int ret = layer_trace_.WriteTo(fd.Get(), header);
+  if (ret != 0) {
+    ALOGE("Failed to write %s: %d", path.c_str(), ret);
+  }
+
+  layer_trace_.Clear();
+}
+
 std::string HwcDisplay::Dump() {
-  std::string flattening_state_str;
-  switch (flattenning_state_) {
-    case ClientFlattenningState::Disabled:
-      flattening_state_str = "Disabled";
-      break;
-    case ClientFlattenningState::NotRequired:
-      flattening_state_str = "Not needed";
-      break;
-    case ClientFlattenningState::Flattened:
-      flattening_state_str = "Active";
-      break;
-    case ClientFlattenningState::ClientRefreshRequested:
-      flattening_state_str = "Refresh requested";
-      break;
-    default:
-      flattening_state_str = std::to_string(flattenning_state_) +
-                             " VSync remains";
+  std::string flattening_state_str = "Disabled";
+  if (flattening_policy_.GetConfig().idle_ns != 0) {
+    flattening_state_str = std::to_string(flattened_layers_) + " of " +
+                           std::to_string(layers_.size()) + " layers";
   }
 
   std::string connector_name = IsInHeadlessMode()
                                    ? "NULL-DISPLAY"
                                    : GetPipe().connector->Get()->GetName();
 
+  UpdatePresentTimings();
+  total_stats_.lock_hold_ns_ = display_lock_.GetHoldTimes();
+  total_stats_.lock_wait_ns_ = display_lock_.GetWaitTimes();
+  DumpFrameTimings();
+  DumpLayerTrace();
+
   std::stringstream ss;
   ss << "- Display on: " << connector_name << "\n"
      << "  Flattening state: " << flattening_state_str << "\n"
+     << DumpLayerActivity()
+     << "  Layer trace: "
+     << (layer_trace_.IsEnabled() ? "Recording" : "Disabled") << "\n"
+     << (IsInHeadlessMode() ? "" : GetPipe().device->GetDrmFbImporter().Dump())
+     << (IsInHeadlessMode() ? ""
+                            : GetPipe().device->GetDrmFbPrefetcher().Dump())
      << "Statistics since system boot:\n"
      << DumpDelta(total_stats_) << "\n\n"
      << "Statistics since last dumpsys request:\n"
      << DumpDelta(total_stats_.minus(prev_stats_)) << "\n\n";
 
-  memcpy(&prev_stats_, &total_stats_, sizeof(Stats));
+  prev_stats_ = total_stats_;
   return ss.str();
 }
 
 HwcDisplay::HwcDisplay(hwc2_display_t handle, HWC2::DisplayType type,
                        DrmHwcTwo *hwc2)
-    : hwc2_(hwc2),
+    : flattening_policy_(FlatteningPolicy::ReadConfig()),
+      flattening_timer_([this]() { RequestFlatteningRefresh(); }),
+      hwc2_(hwc2),
       handle_(handle),
       type_(type),
       client_layer_(this),
@@ -105,6 +301,7 @@ HwcDisplay::HwcDisplay(hwc2_display_t handle, HWC2::DisplayType type,
 HwcDisplay::~HwcDisplay() = default;
 
 void HwcDisplay::SetPipeline(DrmDisplayPipeline *pipeline) {
+  const std::lock_guard<InstrumentedMutex> lock(display_lock_);
   Deinit();
 
   pipeline_ = pipeline;
@@ -125,9 +322,12 @@ void HwcDisplay::Deinit() {
     a_args.color_adjustment = GetPipe().device->GetColorAdjustmentEnabling();
 
     GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args);
+    GetPipe().atomic_state_manager->SetFrameLock(nullptr);
 
     vsync_worker_.Init(nullptr, [](int64_t) {});
+    flattening_timer_.Arm(0);
     current_plan_.reset();
+    presented_plan_.reset();
     backend_.reset();
   }
 
@@ -138,19 +338,16 @@ HWC2::Error HwcDisplay::Init() {
   ChosePreferredConfig();
 
   int ret = vsync_worker_.Init(pipeline_, [this](int64_t timestamp) {
-    const std::lock_guard<std::mutex> lock(hwc2_->GetResMan().GetMainLock());
+    const std::lock_guard<InstrumentedMutex> lock(display_lock_);
     if (vsync_event_en_) {
       uint32_t period_ns{};
       GetDisplayVsyncPeriod(&period_ns);
       hwc2_->SendVsyncEventToClient(handle_, timestamp, period_ns);
     }
-    if (vsync_flattening_en_) {
-      ProcessFlatenningVsyncInternal();
-    }
     if (vsync_tracking_en_) {
       last_vsync_ts_ = timestamp;
     }
-    if (!vsync_event_en_ && !vsync_flattening_en_ && !vsync_tracking_en_) {
+    if (!vsync_event_en_ && !vsync_tracking_en_) {
       vsync_worker_.VSyncControl(false);
     }
   });
@@ -159,16 +356,33 @@ HWC2::Error HwcDisplay::Init() {
     return HWC2::Error::BadDisplay;
   }
 
+  if (flattening_policy_.GetConfig().idle_ns != 0) {
+    ret = flattening_timer_.Init();
+    if (ret && ret != -EALREADY) {
+      ALOGE("Failed to create flattening timer for d=%d %d\n", int(handle_),
+            ret);
+      return HWC2::Error::BadDisplay;
+    }
+  }
+
   if (!IsInHeadlessMode()) {
     ret = BackendManager::GetInstance().SetBackendForDisplay(this);
     if (ret) {
       ALOGE("Failed to set backend for d=%d %d\n", int(handle_), ret);
       return HWC2::Error::BadDisplay;
     }
+
+    GetPipe().atomic_state_manager->SetFrameLock(&display_lock_);
   }
 
   client_layer_.SetLayerBlendMode(HWC2_BLEND_MODE_PREMULTIPLIED);
 
+  char trace_dir[PROPERTY_VALUE_MAX];
+  property_get("vendor.hwc.drm.layer_trace_dir", trace_dir, "");
+  if (trace_dir[0] != '\0') {
+    layer_trace_.Enable();
+  }
+
   return HWC2::Error::None;
 }
 
@@ -506,6 +720,51 @@ HWC2::Error HwcDisplay::GetReleaseFences(uint32_t *num_elements,
   return HWC2::Error::None;
 }
 
+auto HwcDisplay::IsPresentedFrame(const std::vector<LayerData> &layers)
+    -> bool {
+  if (!presented_plan_ ||
+      presented_commits_count_ !=
+          GetPipe().atomic_state_manager->GetCommitsCount()) {
+    return false;
+  }
+
+  auto &presented = presented_plan_->plan;
+  if (layers.size() != presented.size()) {
+    return false;
+  }
+
+  auto same_rect = [](auto &a, auto &b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right &&
+           a.bottom == b.bottom;
+  };
+
+  for (size_t i = 0; i < layers.size(); i++) {
+    auto &layer = layers[i];
+    auto &prev = presented[i].layer;
+
+    /* Damage is empty unless the layer got a buffer */
+    if (!layer.damage || !IsDamageEmpty(*layer.damage) ||
+        layer.acquire_fence || layer.fb != prev.fb) {
+      return false;
+    }
+
+    if (layer.pi.transform != prev.pi.transform ||
+        layer.pi.alpha != prev.pi.alpha ||
+        !same_rect(layer.pi.source_crop, prev.pi.source_crop) ||
+        !same_rect(layer.pi.display_frame, prev.pi.display_frame)) {
+      return false;
+    }
+
+    if (layer.bi->blend_mode != prev.bi->blend_mode ||
+        layer.bi->color_space != prev.bi->color_space ||
+        layer.bi->sample_range != prev.bi->sample_range) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
   if (IsInHeadlessMode()) {
     ALOGE("%s: Display is in headless mode, should never reach here", __func__);
@@ -558,6 +817,16 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
   if (z_map.empty())
     return HWC2::Error::BadLayer;
 
+  if (!a_args.test_only) {
+    for (auto &l : layers_) {
+      l.second.PresentSurfaceDamage(l.second.GetValidatedType() ==
+                                    HWC2::Composition::Device);
+      l.second.SwChainPresentFrame();
+    }
+    client_layer_.PresentSurfaceDamage(use_client_layer);
+    client_layer_.SwChainPresentFrame();
+  }
+
   std::vector<LayerData> composition_layers;
 
   /* Import & populate */
@@ -580,6 +849,14 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
     composition_layers.emplace_back(l.second->GetLayerData().Clone());
   }
 
+  /* Nothing changed, the previous frame stays on the screen */
+  if (!a_args.test_only && IsPresentedFrame(composition_layers) &&
+      !GetPipe().atomic_state_manager->HasPendingState(a_args)) {
+    a_args.out_fence = UniqueFd::Dup(present_fence_.Get());
+    ++total_stats_.frames_skipped_;
+    return HWC2::Error::None;
+  }
+
   /* Store plan to ensure shared planes won't be stolen by other display
    * in between of ValidateDisplay() and PresentDisplay() calls
    */
@@ -594,7 +871,12 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
 
   a_args.composition = current_plan_;
 
+  auto commit_start_ns = ResourceManager::GetTimeMonotonicNs();
   int ret = GetPipe().atomic_state_manager->ExecuteAtomicCommit(a_args);
+  if (!a_args.test_only) {
+    total_stats_.commit_ns_.Record(ResourceManager::GetTimeMonotonicNs() -
+                                   commit_start_ns);
+  }
 
   if (ret) {
     if (!a_args.test_only)
@@ -602,6 +884,12 @@ HWC2::Error HwcDisplay::CreateComposition(AtomicCommitArgs &a_args) {
     return HWC2::Error::BadParameter;
   }
 
+  if (!a_args.test_only) {
+    presented_plan_ = current_plan_;
+    presented_commits_count_ = GetPipe()
+                                   .atomic_state_manager->GetCommitsCount();
+  }
+
   if (mode_update_commited_) {
     staged_mode_.reset();
     vsync_tracking_en_ = false;
@@ -638,11 +926,32 @@ HWC2::Error HwcDisplay::PresentDisplay(int32_t *out_present_fence) {
 
   ++total_stats_.total_frames_;
 
+  auto &timings = CurrentFrameTimings();
+  timings.present_start_ns = ResourceManager::GetTimeMonotonicNs();
+
+  if (layer_trace_.IsEnabled()) {
+    TraceAcquireFences();
+  }
+
   AtomicCommitArgs a_args{};
+  a_args.frame_no = frame_no_;
   ret = CreateComposition(a_args);
 
-  if (ret != HWC2::Error::None)
+  if (ret == HWC2::Error::None) {
+    timings.commit_done_ns = ResourceManager::GetTimeMonotonicNs();
+  }
+  if (layer_trace_.IsEnabled()) {
+    TracePresentedFrame(ret);
+  }
+
+  if (ret != HWC2::Error::None) {
     ++total_stats_.failed_kms_present_;
+    presented_plan_.reset();
+    for (auto &l : layers_) {
+      l.second.DropSurfaceDamage();
+    }
+    client_layer_.DropSurfaceDamage();
+  }
 
   if (ret == HWC2::Error::BadLayer) {
     // Can we really have no client or device layers?
@@ -655,6 +964,10 @@ HWC2::Error HwcDisplay::PresentDisplay(int32_t *out_present_fence) {
   this->present_fence_ = UniqueFd::Dup(a_args.out_fence.Get());
   *out_present_fence = a_args.out_fence.Release();
 
+  total_stats_.present_ns_.Record(timings.commit_done_ns -
+                                  timings.present_start_ns);
+  UpdatePresentTimings();
+
   ++frame_no_;
   return HWC2::Error::None;
 }
@@ -683,9 +996,10 @@ HWC2::Error HwcDisplay::SetActiveConfig(hwc2_config_t config) {
 HWC2::Error HwcDisplay::SetClientTarget(buffer_handle_t target,
                                         int32_t acquire_fence,
                                         int32_t dataspace,
-                                        hwc_region_t /*damage*/) {
+                                        hwc_region_t damage) {
   client_layer_.SetLayerBuffer(target, acquire_fence);
   client_layer_.SetLayerDataspace(dataspace);
+  client_layer_.SetLayerSurfaceDamage(damage);
 
   /*
    * target can be nullptr, this does mean the Composer Service is calling
@@ -825,7 +1139,20 @@ HWC2::Error HwcDisplay::ValidateDisplay(uint32_t *num_types,
                                        HWC2::Composition::Client);
   }
 
-  return backend_->ValidateDisplay(this, num_types, num_requests);
+  auto &timings = CurrentFrameTimings();
+  timings.validate_start_ns = ResourceManager::GetTimeMonotonicNs();
+
+  auto ret = backend_->ValidateDisplay(this, num_types, num_requests);
+
+  timings.validate_end_ns = ResourceManager::GetTimeMonotonicNs();
+  total_stats_.validate_ns_.Record(timings.validate_end_ns -
+                                   timings.validate_start_ns);
+
+  if (layer_trace_.IsEnabled()) {
+    TraceValidatedFrame(ret);
+  }
+
+  return ret;
 }
 
 std::vector<HwcLayer *> HwcDisplay::GetOrderLayersByZPos() {
@@ -1054,37 +1381,46 @@ void HwcDisplay::set_backend(std::unique_ptr<Backend> backend) {
   backend_ = std::move(backend);
 }
 
-/* returns true if composition should be sent to client */
-bool HwcDisplay::ProcessClientFlatteningState(bool skip) {
-  int flattenning_state = flattenning_state_;
-  if (flattenning_state == ClientFlattenningState::Disabled) {
-    return false;
+auto HwcDisplay::ProcessClientFlatteningState(
+    const std::vector<HwcLayer *> &layers) -> std::tuple<int, size_t> {
+  std::vector<const LayerActivity *> activity;
+  activity.reserve(layers.size());
+  for (auto *layer : layers) {
+    activity.emplace_back(&layer->GetActivity());
   }
 
-  if (skip) {
-    flattenning_state_ = ClientFlattenningState::NotRequired;
-    return false;
+  auto [start, size] = flattening_policy_.Evaluate(
+      activity, ResourceManager::GetTimeMonotonicNs());
+  for (size_t z_order = 0; z_order < layers.size(); z_order++) {
+    layers[z_order]->SetFlattened(start >= 0 && z_order >= size_t(start) &&
+                                  z_order < start + size);
   }
+  flattened_layers_ = size;
 
-  if (flattenning_state == ClientFlattenningState::ClientRefreshRequested) {
-    flattenning_state_ = ClientFlattenningState::Flattened;
-    return true;
-  }
+  /* No vsync needed, the timer wakes up once the next layer turns static */
+  flattening_timer_.Arm(flattening_policy_.GetNextEvaluationNs());
 
-  vsync_flattening_en_ = true;
-  vsync_worker_.VSyncControl(true);
-  flattenning_state_ = ClientFlattenningState::VsyncCountdownMax;
-  return false;
+  return {start, size};
+}
+
+void HwcDisplay::RequestFlatteningRefresh() {
+  hwc2_->SendRefreshEventToClient(handle_);
 }
 
-void HwcDisplay::ProcessFlatenningVsyncInternal() {
-  if (flattenning_state_ > ClientFlattenningState::ClientRefreshRequested &&
-      --flattenning_state_ == ClientFlattenningState::ClientRefreshRequested &&
-      hwc2_->refresh_callback_.first != nullptr &&
-      hwc2_->refresh_callback_.second != nullptr) {
-    hwc2_->refresh_callback_.first(hwc2_->refresh_callback_.second, handle_);
-    vsync_flattening_en_ = false;
+auto HwcDisplay::DumpLayerActivity() -> std::string {
+  constexpr int64_t kNsInMs = 1000000;
+  auto now = ResourceManager::GetTimeMonotonicNs();
+
+  std::stringstream ss;
+  ss << "  Layer updates (id: last ms ago / avg interval ms):";
+  for (auto &[id, layer] : layers_) {
+    auto &activity = layer.GetActivity();
+    ss << " " << id << ": " << (now - activity.last_update_ns) / kNsInMs
+       << " / " << activity.update_interval_ns / kNsInMs
+       << (layer.IsFlattened() ? " (flattened)" : "") << ";";
   }
+  ss << "\n";
+  return ss.str();
 }
 
 }  // namespace android
@@ -27,6 +27,9 @@
 #include "drm/ResourceManager.h"
 #include "drm/VSyncWorker.h"
 #include "hwc2_device/HwcLayer.h"
+#include "utils/InstrumentedMutex.h"
+#include "utils/LatencyHistogram.h"
+#include "utils/LayerTraceRecorder.h"
 #include "utils/hwc3.h"
 using namespace aidl::android::hardware::graphics::composer3;
 
@@ -46,6 +49,15 @@ class HwcDisplay {
   /* SetPipeline should be carefully used only by DrmHwcTwo hotplug handlers */
   void SetPipeline(DrmDisplayPipeline *pipeline);
 
+  /* Serializes the frame path of the display: the HWC2 calls, the vsync
+   * and the page-flip events. The main lock, when needed, is taken first;
+   * the HWC2 calls hold it only while looking the display up. Displays are
+   * destroyed once the lock is released by the calls which found them.
+   */
+  auto &GetDisplayLock() {
+    return display_lock_;
+  }
+
   HWC2::Error CreateComposition(AtomicCommitArgs &a_args);
   std::vector<HwcLayer *> GetOrderLayersByZPos();
 
@@ -137,7 +149,16 @@ class HwcDisplay {
               gpu_pixops_ - b.gpu_pixops_,
               failed_kms_validate_ - b.failed_kms_validate_,
               failed_kms_present_ - b.failed_kms_present_,
-              frames_flattened_ - b.frames_flattened_};
+              frames_flattened_ - b.frames_flattened_,
+              layers_flattened_ - b.layers_flattened_,
+              frames_skipped_ - b.frames_skipped_,
+              validate_ns_.minus(b.validate_ns_),
+              present_ns_.minus(b.present_ns_),
+              commit_ns_.minus(b.commit_ns_),
+              scanout_ns_.minus(b.scanout_ns_),
+              release_ns_.minus(b.release_ns_),
+              lock_hold_ns_.minus(b.lock_hold_ns_),
+              lock_wait_ns_.minus(b.lock_wait_ns_)};
     }
 
     uint32_t total_frames_ = 0;
@@ -146,6 +167,36 @@ class HwcDisplay {
     uint32_t failed_kms_validate_ = 0;
     uint32_t failed_kms_present_ = 0;
     uint32_t frames_flattened_ = 0;
+    uint32_t layers_flattened_ = 0;
+    /* Same as the previous one, not committed */
+    uint32_t frames_skipped_ = 0;
+
+    /* ValidateDisplay() duration */
+    LatencyHistogram validate_ns_;
+    /* PresentDisplay() start to atomic commit return */
+    LatencyHistogram present_ns_;
+    /* Atomic commit ioctl */
+    LatencyHistogram commit_ns_;
+    /* Atomic commit return to present fence signal */
+    LatencyHistogram scanout_ns_;
+    /* Atomic commit return to release of the prior frame buffers */
+    LatencyHistogram release_ns_;
+    /* Display lock, taken from the lock itself on dump */
+    LatencyHistogram lock_hold_ns_;
+    LatencyHistogram lock_wait_ns_;
+  };
+
+  /* Per-frame pipeline timestamps (CLOCK_MONOTONIC, ns). Layout is a part of
+   * the binary export format, see DumpFrameTimings().
+   */
+  struct FrameTimings {
+    uint64_t frame_no;
+    int64_t validate_start_ns;
+    int64_t validate_end_ns;
+    int64_t present_start_ns;
+    int64_t commit_done_ns;
+    int64_t present_fence_ns;
+    int64_t release_ns;
   };
 
   const Backend *backend() const;
@@ -159,6 +210,10 @@ class HwcDisplay {
     return layers_;
   }
 
+  HwcLayer &GetClientLayer() {
+    return client_layer_;
+  }
+
   auto &GetPipe() {
     return *pipeline_;
   }
@@ -171,9 +226,11 @@ class HwcDisplay {
     return total_stats_;
   }
 
-  /* returns true if composition should be sent to client */
-  bool ProcessClientFlatteningState(bool skip);
-  void ProcessFlatenningVsyncInternal();
+  /* Marks the layers (in z-order) to flatten, returns their range
+   * {start, size}, {-1, 0} if none
+   */
+  auto ProcessClientFlatteningState(const std::vector<HwcLayer *> &layers)
+      -> std::tuple<int, size_t>;
 
   /* Headless mode required to keep SurfaceFlinger alive when all display are
    * disconnected, Without headless mode Android will continuously crash.
@@ -188,15 +245,12 @@ class HwcDisplay {
   void Deinit();
 
  private:
-  enum ClientFlattenningState : int32_t {
-    Disabled = -3,
-    NotRequired = -2,
-    Flattened = -1,
-    ClientRefreshRequested = 0,
-    VsyncCountdownMax = 60, /* 1 sec @ 60FPS */
-  };
-
-  std::atomic_int flattenning_state_{ClientFlattenningState::NotRequired};
+  FlatteningPolicy flattening_policy_;
+  /* Asks the client for a new frame once more layers can be flattened */
+  FlatteningTimer flattening_timer_;
+  size_t flattened_layers_{};
+  void RequestFlatteningRefresh();
+  auto DumpLayerActivity() -> std::string;
 
   constexpr static size_t MATRIX_SIZE = 16;
 
@@ -204,6 +258,8 @@ class HwcDisplay {
 
   DrmHwcTwo *const hwc2_;
 
+  InstrumentedMutex display_lock_;
+
   UniqueFd present_fence_;
 
   std::optional<DrmMode> staged_mode_;
@@ -216,7 +272,6 @@ class HwcDisplay {
 
   VSyncWorker vsync_worker_;
   bool vsync_event_en_{};
-  bool vsync_flattening_en_{};
   bool vsync_tracking_en_{};
   int64_t last_vsync_ts_{};
 
@@ -234,12 +289,30 @@ class HwcDisplay {
 
   std::shared_ptr<DrmKmsPlan> current_plan_;
 
+  /* Last presented frame, the identical frames which follow are skipped */
+  std::shared_ptr<DrmKmsPlan> presented_plan_;
+  uint64_t presented_commits_count_{};
+  auto IsPresentedFrame(const std::vector<LayerData> &layers) -> bool;
+
   std::optional<ClockMonotonicTimestamp> expectedPresentTime_ = std::nullopt;
   uint32_t frame_no_ = 0;
   Stats total_stats_;
   Stats prev_stats_;
   std::string DumpDelta(HwcDisplay::Stats delta);
 
+  static constexpr size_t kFrameTimingsRingSize = 256;
+  std::array<FrameTimings, kFrameTimingsRingSize> frame_timings_{};
+  auto CurrentFrameTimings() -> FrameTimings &;
+  void UpdatePresentTimings();
+  void DumpFrameTimings();
+
+  /* Layer-stack trace, see utils/LayerTrace.h */
+  LayerTraceRecorder layer_trace_;
+  void TraceValidatedFrame(HWC2::Error validate_error);
+  void TraceAcquireFences();
+  void TracePresentedFrame(HWC2::Error present_error);
+  void DumpLayerTrace();
+
   HWC2::Error Init();
 
   HWC2::Error SetActiveConfigInternal(uint32_t config, int64_t change_time);
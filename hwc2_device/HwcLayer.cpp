@@ -18,8 +18,11 @@
 
 #include "HwcLayer.h"
 
+#include <sync/sync.h>
+
 #include "HwcDisplay.h"
 #include "bufferinfo/BufferInfoGetter.h"
+#include "drm/DrmFbPrefetcher.h"
 #include "utils/log.h"
 
 namespace android {
@@ -53,9 +56,37 @@ HWC2::Error HwcLayer::SetLayerBlendMode(int32_t mode) {
  */
 HWC2::Error HwcLayer::SetLayerBuffer(buffer_handle_t buffer,
                                      int32_t acquire_fence) {
+  /* Nothing tells whether the handle is a new one */
+  return SetLayerSlotBuffer(buffer, acquire_fence, false);
+}
+
+HWC2::Error HwcLayer::SetLayerSlotBuffer(buffer_handle_t buffer,
+                                         int32_t acquire_fence, bool reused) {
   acquire_fence_ = UniqueFd(acquire_fence);
   buffer_handle_ = buffer;
   buffer_handle_updated_ = true;
+  damage_buffer_updated_ = true;
+  activity_.Update(ResourceManager::GetTimeMonotonicNs());
+
+  buffer_unique_id_ = {};
+  if (buffer_handle_ == nullptr) {
+    return HWC2::Error::None;
+  }
+  buffer_unique_id_ = buffer_id_cache_.Find(buffer_handle_, reused);
+  if (!buffer_unique_id_) {
+    buffer_unique_id_ = BufferInfoGetter::GetInstance()->GetUniqueId(
+        buffer_handle_);
+    if (buffer_unique_id_) {
+      buffer_id_cache_.Add(buffer_handle_, *buffer_unique_id_);
+    }
+  }
+
+  /* Start importing the buffer not seen before, present takes the result */
+  if (buffer_unique_id_ && IsLayerUsableAsDevice() &&
+      !SwChainIsCached(*buffer_unique_id_) && !parent_->IsInHeadlessMode()) {
+    parent_->GetPipe().device->GetDrmFbPrefetcher().Prefetch(
+        buffer_handle_, *buffer_unique_id_);
+  }
 
   return HWC2::Error::None;
 }
@@ -104,12 +135,21 @@ HWC2::Error HwcLayer::SetLayerDataspace(int32_t dataspace) {
 }
 
 HWC2::Error HwcLayer::SetLayerDisplayFrame(hwc_rect_t frame) {
+  auto &prev = layer_data_.pi.display_frame;
+  if (frame.left != prev.left || frame.top != prev.top ||
+      frame.right != prev.right || frame.bottom != prev.bottom) {
+    activity_.Update(ResourceManager::GetTimeMonotonicNs());
+  }
   layer_data_.pi.display_frame = frame;
   return HWC2::Error::None;
 }
 
 HWC2::Error HwcLayer::SetLayerPlaneAlpha(float alpha) {
-  layer_data_.pi.alpha = std::lround(alpha * UINT16_MAX);
+  uint16_t plane_alpha = std::lround(alpha * UINT16_MAX);
+  if (plane_alpha != layer_data_.pi.alpha) {
+    activity_.Update(ResourceManager::GetTimeMonotonicNs());
+  }
+  layer_data_.pi.alpha = plane_alpha;
   return HWC2::Error::None;
 }
 
@@ -121,13 +161,27 @@ HWC2::Error HwcLayer::SetLayerSidebandStream(
 }
 
 HWC2::Error HwcLayer::SetLayerSourceCrop(hwc_frect_t crop) {
+  auto &prev = layer_data_.pi.source_crop;
+  if (crop.left != prev.left || crop.top != prev.top ||
+      crop.right != prev.right || crop.bottom != prev.bottom) {
+    activity_.Update(ResourceManager::GetTimeMonotonicNs());
+  }
   layer_data_.pi.source_crop = crop;
   return HWC2::Error::None;
 }
 
-// NOLINTNEXTLINE(readability-convert-member-functions-to-static)
-HWC2::Error HwcLayer::SetLayerSurfaceDamage(hwc_region_t /*damage*/) {
-  // TODO(nobody): We don't use surface damage, marking as unsupported
+HWC2::Error HwcLayer::SetLayerSurfaceDamage(hwc_region_t damage) {
+  /* No rects means the damage is unknown, a single empty rect no damage */
+  if (damage.numRects == 0 || damage.rects == nullptr) {
+    surface_damage_ = {};
+    return HWC2::Error::None;
+  }
+
+  /* Planes take the bounding rect */
+  surface_damage_ = hwc_rect_t{};
+  for (size_t i = 0; i < damage.numRects; i++) {
+    surface_damage_ = UniteDamage(surface_damage_, damage.rects[i]);
+  }
   return HWC2::Error::None;
 }
 
@@ -151,6 +205,9 @@ HWC2::Error HwcLayer::SetLayerTransform(int32_t transform) {
       l_transform |= LayerTransform::kRotate90;
   }
 
+  if (l_transform != layer_data_.pi.transform) {
+    activity_.Update(ResourceManager::GetTimeMonotonicNs());
+  }
   layer_data_.pi.transform = static_cast<LayerTransform>(l_transform);
   return HWC2::Error::None;
 }
@@ -240,21 +297,37 @@ void HwcLayer::ImportFb() {
 
   layer_data_.fb = {};
 
-  auto unique_id = BufferInfoGetter::GetInstance()->GetUniqueId(buffer_handle_);
+  auto unique_id = buffer_unique_id_;
   if (unique_id && SwChainGetBufferFromCache(*unique_id)) {
     return;
   }
 
-  layer_data_.bi = BufferInfoGetter::GetInstance()->GetBoInfo(buffer_handle_);
+  auto &device = *parent_->GetPipe().device;
+  std::optional<DrmFbPrefetcher::Result> prefetched;
+  if (unique_id) {
+    prefetched = device.GetDrmFbPrefetcher().Take(*unique_id);
+  }
+
+  if (prefetched) {
+    layer_data_.bi = std::move(prefetched->bi);
+  } else if (unique_id) {
+    layer_data_.bi = BufferInfoGetter::GetInstance()->GetCachedBoInfo(
+        buffer_handle_, *unique_id);
+  } else {
+    layer_data_.bi = BufferInfoGetter::GetInstance()->GetBoInfo(buffer_handle_);
+  }
   if (!layer_data_.bi) {
     ALOGW("Unable to get buffer information (0x%p)", buffer_handle_);
     bi_get_failed_ = true;
     return;
   }
 
-  layer_data_
-      .fb = parent_->GetPipe().device->GetDrmFbImporter().GetOrCreateFbId(
-      &layer_data_.bi.value());
+  if (prefetched) {
+    layer_data_.fb = std::move(prefetched->fb);
+  } else {
+    layer_data_.fb = device.GetDrmFbImporter().GetOrCreateFbId(
+        &layer_data_.bi.value());
+  }
 
   if (!layer_data_.fb) {
     ALOGV("Unable to create framebuffer object for buffer 0x%p",
@@ -286,75 +359,128 @@ void HwcLayer::PopulateLayerData(bool test) {
   }
 }
 
-/* SwapChain Cache */
+void HwcLayer::PresentSurfaceDamage(bool scanout) {
+  bool buffer_updated = damage_buffer_updated_;
+  damage_buffer_updated_ = false;
+  layer_data_.damage_source = damage_source_;
 
-bool HwcLayer::SwChainGetBufferFromCache(BufferUniqueId unique_id) {
-  if (swchain_lookup_table_.count(unique_id) == 0) {
-    return false;
+  /* The history misses the buffers composed by the client */
+  if (!scanout || !buffer_unique_id_) {
+    damage_scanout_ = false;
+    damage_tracker_.Clear();
+    layer_data_.damage = {};
+    return;
   }
 
-  int seq = swchain_lookup_table_[unique_id];
-
-  if (swchain_cache_.count(seq) == 0) {
-    return false;
+  if (!damage_scanout_) {
+    damage_scanout_ = true;
+    damage_tracker_.Clear();
+    buffer_updated = true;
   }
 
-  auto& el = swchain_cache_[seq];
-  if (!el.bi) {
-    return false;
+  if (!buffer_updated) {
+    layer_data_.damage = hwc_rect_t{};
+    return;
   }
 
-  layer_data_.bi = el.bi;
-  layer_data_.fb = el.fb;
-
-  return true;
+  layer_data_.damage = damage_tracker_.Present(*buffer_unique_id_,
+                                               surface_damage_);
 }
 
-void HwcLayer::SwChainReassemble(BufferUniqueId unique_id) {
-  if (swchain_lookup_table_.count(unique_id) != 0) {
-    if (swchain_lookup_table_[unique_id] ==
-        int(swchain_lookup_table_.size()) - 1) {
-      /* Skip same buffer */
-      return;
+void HwcLayer::FillLayerTraceRecord(hwc2_layer_t layer_id,
+                                    LayerTraceLayer &record) {
+  record = {};
+  record.layer_id = layer_id;
+
+  if (buffer_handle_ != nullptr) {
+    auto *getter = BufferInfoGetter::GetInstance();
+    record.buffer_id = buffer_unique_id_.value_or(0);
+
+    /* Buffers of the CLIENT layers are never imported */
+    auto bi = layer_data_.bi;
+    if (buffer_handle_updated_ || !bi) {
+      bi = buffer_unique_id_ ? getter->GetCachedBoInfo(buffer_handle_,
+                                                       *buffer_unique_id_)
+                             : getter->GetBoInfo(buffer_handle_);
     }
-    if (swchain_lookup_table_[unique_id] == 0) {
-      swchain_reassembled_ = true;
-      return;
+    if (bi) {
+      record.buffer_width = bi->width;
+      record.buffer_height = bi->height;
+      record.buffer_format = bi->format;
     }
-    /* Tracking error */
-    SwChainClearCache();
-    return;
   }
 
-  swchain_lookup_table_[unique_id] = int(swchain_lookup_table_.size());
+  record.z_order = z_order_;
+  record.sf_type = static_cast<int32_t>(sf_type_);
+  record.validated_type = static_cast<int32_t>(validated_type_);
+
+  const auto &crop = layer_data_.pi.source_crop;
+  record.source_crop[0] = crop.left;
+  record.source_crop[1] = crop.top;
+  record.source_crop[2] = crop.right;
+  record.source_crop[3] = crop.bottom;
+
+  const auto &frame = layer_data_.pi.display_frame;
+  record.display_frame[0] = frame.left;
+  record.display_frame[1] = frame.top;
+  record.display_frame[2] = frame.right;
+  record.display_frame[3] = frame.bottom;
+
+  record.transform = layer_data_.pi.transform;
+  record.alpha = layer_data_.pi.alpha;
+  record.blend_mode = static_cast<uint8_t>(blend_mode_);
+  record.color_space = static_cast<uint8_t>(color_space_);
+  record.sample_range = static_cast<uint8_t>(sample_range_);
 }
 
-void HwcLayer::SwChainAddCurrentBuffer(BufferUniqueId unique_id) {
-  if (!swchain_reassembled_) {
-    SwChainReassemble(unique_id);
+auto HwcLayer::GetAcquireFenceSignalTimeNs() const -> int64_t {
+  if (!acquire_fence_) {
+    return 0;
   }
 
-  if (swchain_reassembled_) {
-    if (swchain_lookup_table_.count(unique_id) == 0) {
-      SwChainClearCache();
-      return;
+  auto *info = sync_file_info(acquire_fence_.Get());
+  if (info == nullptr) {
+    return -1;
+  }
+
+  int64_t signal_time_ns = -1;
+  if (info->status == 1) {
+    signal_time_ns = 0;
+    auto *fences = sync_get_fence_info(info);
+    for (uint32_t i = 0; i < info->num_fences; i++) {
+      signal_time_ns = std::max(signal_time_ns,
+                                int64_t(fences[i].timestamp_ns));
     }
+  }
 
-    int seq = swchain_lookup_table_[unique_id];
+  sync_file_info_free(info);
+  return signal_time_ns;
+}
 
-    if (swchain_cache_.count(seq) == 0) {
-      swchain_cache_[seq] = {};
-    }
+/* SwapChain Cache */
 
-    swchain_cache_[seq].bi = layer_data_.bi;
-    swchain_cache_[seq].fb = layer_data_.fb;
+bool HwcLayer::SwChainGetBufferFromCache(BufferUniqueId unique_id) {
+  auto *el = swchain_cache_.Get(unique_id);
+  if (el == nullptr) {
+    return false;
   }
+
+  layer_data_.bi = el->bi;
+  layer_data_.fb = el->fb;
+
+  return true;
+}
+
+bool HwcLayer::SwChainIsCached(BufferUniqueId unique_id) const {
+  return swchain_cache_.Contains(unique_id);
+}
+
+void HwcLayer::SwChainAddCurrentBuffer(BufferUniqueId unique_id) {
+  swchain_cache_.Add(unique_id, {.bi = layer_data_.bi, .fb = layer_data_.fb});
 }
 
 void HwcLayer::SwChainClearCache() {
-  swchain_cache_.clear();
-  swchain_lookup_table_.clear();
-  swchain_reassembled_ = false;
+  swchain_cache_.Clear();
 }
 
-}  // namespace android
\ No newline at end of file
+}  // namespace android
@@ -19,8 +19,16 @@
 
 #include <hardware/hwcomposer2.h>
 
+#include <array>
+#include <atomic>
+
+#include "bufferinfo/BufferIdCache.h"
 #include "bufferinfo/BufferInfoGetter.h"
+#include "FlatteningPolicy.h"
 #include "compositor/LayerData.h"
+#include "utils/DamageTracker.h"
+#include "utils/LayerTrace.h"
+#include "utils/SwapChainCache.h"
 
 namespace android {
 
@@ -62,10 +70,27 @@ class HwcLayer {
     return layer_data_;
   }
 
+  auto &GetActivity() const {
+    return activity_;
+  }
+
+  /* Composed by the client while it stays static */
+  bool IsFlattened() const {
+    return flattened_;
+  }
+  void SetFlattened(bool state) {
+    flattened_ = state;
+  }
+
   // Layer hooks
   HWC2::Error SetCursorPosition(int32_t /*x*/, int32_t /*y*/);
   HWC2::Error SetLayerBlendMode(int32_t mode);
   HWC2::Error SetLayerBuffer(buffer_handle_t buffer, int32_t acquire_fence);
+  /* HWC3 extension, reused if the composer passes the handle from its slot
+   * cache again, see BufferIdCache
+   */
+  HWC2::Error SetLayerSlotBuffer(buffer_handle_t buffer, int32_t acquire_fence,
+                                 bool reused);
   HWC2::Error SetLayerColor(hwc_color_t /*color*/);
   HWC2::Error SetLayerCompositionType(int32_t type);
   HWC2::Error SetLayerDataspace(int32_t dataspace);
@@ -81,6 +106,11 @@ class HwcLayer {
                                      const int32_t *keys,
                                      const float *metadata);
 
+  /* Layer trace */
+  void FillLayerTraceRecord(hwc2_layer_t layer_id, LayerTraceLayer &record);
+  /* Signal time of the acquire fence, 0 if no fence, -1 if not signaled */
+  auto GetAcquireFenceSignalTimeNs() const -> int64_t;
+
  private:
   // sf_type_ stores the initial type given to us by surfaceflinger,
   // validated_type_ stores the type after running ValidateDisplay
@@ -89,6 +119,8 @@ class HwcLayer {
 
   uint32_t z_order_ = 0;
   LayerData layer_data_;
+  LayerActivity activity_;
+  bool flattened_{};
 
   /* Should be populated to layer_data_.acquire_fence only before presenting */
   UniqueFd acquire_fence_;
@@ -104,6 +136,9 @@ class HwcLayer {
   BufferSampleRange sample_range_{};
   BufferBlendMode blend_mode_{};
   buffer_handle_t buffer_handle_{};
+  std::optional<BufferUniqueId> buffer_unique_id_;
+  /* Saves the fstat() of the buffers set again */
+  BufferIdCache buffer_id_cache_;
   bool buffer_handle_updated_{};
 
   bool prior_buffer_scanout_flag_{};
@@ -123,9 +158,34 @@ class HwcLayer {
   bool bi_get_failed_{};
   bool fb_import_failed_{};
 
+  /* Surface damage */
+ public:
+  /* Call for every presented frame before populating the layer data, with
+   * whether the layer buffer gets scanned out by a plane.
+   */
+  void PresentSurfaceDamage(bool scanout);
+  /* The frame was not presented, the buffers are damaged as a whole */
+  void DropSurfaceDamage() {
+    damage_scanout_ = false;
+  }
+
+ private:
+  Damage surface_damage_;
+  bool damage_buffer_updated_{};
+  /* Previous frame was scanned out */
+  bool damage_scanout_{};
+  DamageTracker damage_tracker_;
+  /* Unique for the life of the process, unlike the layer address */
+  static inline std::atomic<uint64_t> damage_source_counter_{};
+  uint64_t damage_source_ = ++damage_source_counter_;
+
   /* SwapChain Cache */
  public:
   void SwChainClearCache();
+  /* Call for every presented frame, releases the buffers gone idle */
+  void SwChainPresentFrame() {
+    swchain_cache_.NextFrame(buffer_unique_id_);
+  }
 
  private:
   struct SwapChainElement {
@@ -134,12 +194,10 @@ class HwcLayer {
   };
 
   bool SwChainGetBufferFromCache(BufferUniqueId unique_id);
-  void SwChainReassemble(BufferUniqueId unique_id);
+  bool SwChainIsCached(BufferUniqueId unique_id) const;
   void SwChainAddCurrentBuffer(BufferUniqueId unique_id);
 
-  std::map<int /*seq_no*/, SwapChainElement> swchain_cache_;
-  std::map<BufferUniqueId, int /*seq_no*/> swchain_lookup_table_;
-  bool swchain_reassembled_{};
+  SwapChainCache<SwapChainElement> swchain_cache_;
 };
 
 }  // namespace android
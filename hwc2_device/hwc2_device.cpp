@@ -63,7 +63,7 @@ template <typename T, typename HookType, HookType func, typename... Args>
 static T DeviceHook(hwc2_device_t *dev, Args... args) {
   ALOGV("Device hook: %s", GetFuncName(__PRETTY_FUNCTION__).c_str());
   DrmHwcTwo *hwc = ToDrmHwcTwo(dev);
-  const std::lock_guard<std::mutex> lock(hwc->GetResMan().GetMainLock());
+  const std::lock_guard<InstrumentedMutex> lock(hwc->GetResMan().GetMainLock());
   return static_cast<T>(((*hwc).*func)(std::forward<Args>(args)...));
 }
 
@@ -73,12 +73,14 @@ static int32_t DisplayHook(hwc2_device_t *dev, hwc2_display_t display_handle,
   ALOGV("Display #%" PRIu64 " hook: %s", display_handle,
         GetFuncName(__PRETTY_FUNCTION__).c_str());
   DrmHwcTwo *hwc = ToDrmHwcTwo(dev);
-  const std::lock_guard<std::mutex> lock(hwc->GetResMan().GetMainLock());
-  auto *display = hwc->GetDisplay(display_handle);
+  auto display = hwc->FindDisplay(display_handle);
   if (display == nullptr)
     return static_cast<int32_t>(HWC2::Error::BadDisplay);
 
-  return static_cast<int32_t>((display->*func)(std::forward<Args>(args)...));
+  const std::lock_guard<InstrumentedMutex> lock(display->GetDisplayLock());
+
+  return static_cast<int32_t>(
+      ((*display).*func)(std::forward<Args>(args)...));
 }
 
 template <typename HookType, HookType func, typename... Args>
@@ -87,11 +89,12 @@ static int32_t LayerHook(hwc2_device_t *dev, hwc2_display_t display_handle,
   ALOGV("Display #%" PRIu64 " Layer: #%" PRIu64 " hook: %s", display_handle,
         layer_handle, GetFuncName(__PRETTY_FUNCTION__).c_str());
   DrmHwcTwo *hwc = ToDrmHwcTwo(dev);
-  const std::lock_guard<std::mutex> lock(hwc->GetResMan().GetMainLock());
-  auto *display = hwc->GetDisplay(display_handle);
+  auto display = hwc->FindDisplay(display_handle);
   if (display == nullptr)
     return static_cast<int32_t>(HWC2::Error::BadDisplay);
 
+  const std::lock_guard<InstrumentedMutex> lock(display->GetDisplayLock());
+
   HwcLayer *layer = display->get_layer(layer_handle);
   if (!layer)
     return static_cast<int32_t>(HWC2::Error::BadLayer);
@@ -379,6 +382,11 @@ static hwc2_function_pointer_t HookDevGetFunction(struct hwc2_device * /*dev*/,
         return ToHook<HWC3::HWC3_PFN_SET_EXPECTED_PRESENT_TIME>(
             DisplayHook<decltype(&HwcDisplay::setExpectedPresentTime),
                         &HwcDisplay::setExpectedPresentTime, const std::optional<ClockMonotonicTimestamp>&>);
+      else if (descriptor == HWC3::HWC3_FUNCTION_SET_LAYER_SLOT_BUFFER)
+        return ToHook<HWC3::HWC3_PFN_SET_LAYER_SLOT_BUFFER>(
+            LayerHook<decltype(&HwcLayer::SetLayerSlotBuffer),
+                      &HwcLayer::SetLayerSlotBuffer, buffer_handle_t, int32_t,
+                      bool>);
       else
         return nullptr;
   }
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CommandWorkerPool.h"
+
+#include <android-base/logging.h>
+#include <sched.h>
+
+namespace aidl::android::hardware::graphics::composer3::impl {
+
+CommandWorkerPool::CommandWorkerPool(size_t numThreads) {
+    for (size_t i = 0; i < numThreads; i++) {
+        mThreads.emplace_back(&CommandWorkerPool::workerLoop, this);
+    }
+}
+
+CommandWorkerPool::~CommandWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mWorkCondition.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void CommandWorkerPool::run(const std::vector<std::function<void()>>& tasks) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks = &tasks;
+    mNextTask = 0;
+    mPendingTasks = tasks.size();
+    mWorkCondition.notify_all();
+
+    runTasksLocked(lock);
+    mDoneCondition.wait(lock, [this] { return mPendingTasks == 0; });
+    mTasks = nullptr;
+}
+
+void CommandWorkerPool::runTasksLocked(std::unique_lock<std::mutex>& lock) {
+    while (mTasks != nullptr && mNextTask < mTasks->size()) {
+        const auto& task = (*mTasks)[mNextTask++];
+        lock.unlock();
+        task();
+        lock.lock();
+        if (--mPendingTasks == 0) {
+            mDoneCondition.notify_all();
+        }
+    }
+}
+
+void CommandWorkerPool::workerLoop() {
+    // The service main thread priority is reset on fork, the frame path needs it back.
+    struct sched_param param = {0};
+    param.sched_priority = 2;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+        LOG(ERROR) << "Couldn't set SCHED_FIFO for the command worker: " << errno;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mExit) {
+        mWorkCondition.wait(lock, [this] {
+            return mExit || (mTasks != nullptr && mNextTask < mTasks->size());
+        });
+        runTasksLocked(lock);
+    }
+}
+
+} // namespace aidl::android::hardware::graphics::composer3::impl
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::graphics::composer3::impl {
+
+// Small fixed pool of threads running the commands of several displays at once.
+// The calling thread takes part in the work, so N threads run N + 1 tasks in parallel.
+class CommandWorkerPool {
+  public:
+    explicit CommandWorkerPool(size_t numThreads);
+    ~CommandWorkerPool();
+
+    // Returns once all the tasks are done. Only one caller at a time.
+    void run(const std::vector<std::function<void()>>& tasks);
+
+  private:
+    void workerLoop();
+    void runTasksLocked(std::unique_lock<std::mutex>& lock);
+
+    std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    const std::vector<std::function<void()>>* mTasks = nullptr;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+    bool mExit = false;
+    std::vector<std::thread> mThreads;
+};
+
+} // namespace aidl::android::hardware::graphics::composer3::impl
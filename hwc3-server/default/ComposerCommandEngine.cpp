@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <iterator>
 #include <set>
 
 #include "ComposerCommandEngine.h"
@@ -63,10 +65,17 @@ bool ComposerCommandEngine::init() {
 int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& commands,
                                        std::vector<CommandResultPayload>* result) {
     std::set<int64_t> displaysPendingBrightenssChange;
-    mCommandIndex = 0;
-    for (const auto& command : commands) {
-        dispatchDisplayCommand(command);
-        ++mCommandIndex;
+    DisplayGroups groups;
+    for (int32_t i = 0; i < static_cast<int32_t>(commands.size()); i++) {
+        const auto& command = commands[i];
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const auto& g) {
+            return commands[g.front()].display == command.display;
+        });
+        if (group == groups.end()) {
+            group = groups.emplace(groups.end());
+        }
+        group->push_back(i);
+
         // The input commands could have 2+ commands for the same display.
         // If the first has pending brightness change, the second presentDisplay will apply it.
         if (command.validateDisplay || command.presentDisplay ||
@@ -77,8 +86,18 @@ int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& comman
         }
     }
 
-    *result = mWriter->getPendingCommandResults();
-    mWriter->reset();
+    if (groups.size() > 1) {
+        executeDisplayGroups(commands, groups, result);
+    } else {
+        mCommandIndex = 0;
+        for (const auto& command : commands) {
+            dispatchDisplayCommand(command);
+            ++mCommandIndex;
+        }
+
+        *result = mWriter->getPendingCommandResults();
+        mWriter->reset();
+    }
 
     // standalone display brightness command shouldn't wait for next present or validate
     for (auto display : displaysPendingBrightenssChange) {
@@ -90,6 +109,46 @@ int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& comman
     return ::android::NO_ERROR;
 }
 
+void ComposerCommandEngine::executeDisplayGroups(const std::vector<DisplayCommand>& commands,
+                                                 const DisplayGroups& groups,
+                                                 std::vector<CommandResultPayload>* result) {
+    while (mGroupEngines.size() < groups.size()) {
+        auto engine = std::make_unique<ComposerCommandEngine>(mHal, mResources);
+        engine->init();
+        mGroupEngines.emplace_back(std::move(engine));
+    }
+    if (!mWorkers) {
+        mWorkers = std::make_unique<CommandWorkerPool>(kMaxWorkers);
+    }
+
+    // Each command gets its own results, the groups fill them in concurrently
+    std::vector<std::vector<CommandResultPayload>> commandResults(commands.size());
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < groups.size(); i++) {
+        tasks.emplace_back([&, i] {
+            mGroupEngines[i]->executeGroup(commands, groups[i], &commandResults);
+        });
+    }
+    mWorkers->run(tasks);
+
+    result->clear();
+    for (auto& payloads : commandResults) {
+        std::move(payloads.begin(), payloads.end(), std::back_inserter(*result));
+    }
+}
+
+void ComposerCommandEngine::executeGroup(
+        const std::vector<DisplayCommand>& commands, const std::vector<int32_t>& indices,
+        std::vector<std::vector<CommandResultPayload>>* commandResults) {
+    for (auto index : indices) {
+        // Errors refer to the command by its index in the whole input
+        mCommandIndex = index;
+        dispatchDisplayCommand(commands[index]);
+        (*commandResults)[index] = mWriter->getPendingCommandResults();
+        mWriter->reset();
+    }
+}
+
 void ComposerCommandEngine::dispatchDisplayCommand(const DisplayCommand& command) {
     //  place SetDisplayBrightness before SetLayerWhitePointNits since current
     //  display brightness is used to validate the layer white point nits.
@@ -293,7 +352,8 @@ void ComposerCommandEngine::executeSetLayerBuffer(int64_t display, int64_t layer
     auto err = mResources->getLayerBuffer(display, layer, buffer.slot, useCache,
                                           handle, hwcBuffer, bufferReleaser.get());
     if (!err) {
-        err = mHal->setLayerBuffer(display, layer, hwcBuffer, buffer.fence);
+        // A cached slot passes the handle it was given with the import
+        err = mHal->setLayerBuffer(display, layer, hwcBuffer, buffer.fence, useCache);
         if (err) {
             LOG(ERROR) << __func__ << ": setLayerBuffer err " << err;
             mWriter->setError(mCommandIndex, err);
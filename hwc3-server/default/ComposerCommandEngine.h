@@ -20,7 +20,9 @@
 #include <utils/Mutex.h>
 
 #include <memory>
+#include <vector>
 
+#include "CommandWorkerPool.h"
 #include "include/IComposerHal.h"
 #include "include/IResourceManager.h"
 
@@ -44,6 +46,15 @@ class ComposerCommandEngine {
       }
 
   private:
+      // Commands of the displays, by the index in the input and in order of appearance
+      using DisplayGroups = std::vector<std::vector<int32_t>>;
+
+      void executeDisplayGroups(const std::vector<DisplayCommand>& commands,
+                                const DisplayGroups& groups,
+                                std::vector<CommandResultPayload>* result);
+      void executeGroup(const std::vector<DisplayCommand>& commands,
+                        const std::vector<int32_t>& indices,
+                        std::vector<std::vector<CommandResultPayload>>* commandResults);
       void dispatchDisplayCommand(const DisplayCommand& displayCommand);
       void dispatchLayerCommand(int64_t display, const LayerCommand& displayCommand);
 
@@ -100,6 +111,12 @@ class ComposerCommandEngine {
       IResourceManager* mResources;
       std::unique_ptr<ComposerServiceWriter> mWriter;
       int32_t mCommandIndex;
+
+      // Independent displays are run in parallel, each group by its own engine.
+      // Both are created on the first frame with more than one display.
+      static constexpr size_t kMaxWorkers = 2;
+      std::vector<std::unique_ptr<ComposerCommandEngine>> mGroupEngines;
+      std::unique_ptr<CommandWorkerPool> mWorkers;
 };
 
 template <typename InputType, typename Functor>
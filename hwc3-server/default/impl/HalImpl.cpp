@@ -170,6 +170,17 @@ bool HalImpl::initOptionalDispatch(hwc2_function_descriptor_t desc, T* outPfn) {
     }
 }
 
+template <typename T>
+bool HalImpl::initOptionalDispatch(HWC3::hwc3_function_descriptor_t desc, T* outPfn) {
+    auto pfn = mDevice->getFunction(mDevice, desc);
+    if (pfn) {
+        *outPfn = reinterpret_cast<T>(pfn);
+        return true;
+    } else {
+        return false;
+    }
+}
+
 bool HalImpl::initDispatch() {
     if (
         !initDispatch(HWC2_FUNCTION_ACCEPT_DISPLAY_CHANGES, &mDispatch.acceptDisplayChanges) ||
@@ -229,6 +240,8 @@ bool HalImpl::initDispatch() {
         ) {
         return false;
     }
+    initOptionalDispatch(HWC3::HWC3_FUNCTION_SET_LAYER_SLOT_BUFFER, &mDispatch.setLayerSlotBuffer);
+
     //  2.2
     initOptionalDispatch(HWC2_FUNCTION_SET_LAYER_FLOAT_COLOR, &mDispatch.setLayerFloatColor);
     initOptionalDispatch(HWC2_FUNCTION_SET_LAYER_PER_FRAME_METADATA,&mDispatch.setLayerPerFrameMetadata) ;
@@ -885,12 +898,15 @@ int32_t HalImpl::setLayerBlendMode(int64_t display, int64_t layer, common::Blend
 }
 
 int32_t HalImpl::setLayerBuffer(int64_t display, int64_t layer, buffer_handle_t buffer,
-                                const ndk::ScopedFileDescriptor& acquireFence) {
+                                const ndk::ScopedFileDescriptor& acquireFence, bool reused) {
     if (!mDispatch.setLayerBuffer) {
         return HWC2_ERROR_UNSUPPORTED;
     }
     int32_t hwcFd;
     a2h::translate(acquireFence, hwcFd);
+    if (mDispatch.setLayerSlotBuffer) {
+        return mDispatch.setLayerSlotBuffer(mDevice, display, layer, buffer, hwcFd, reused);
+    }
     return mDispatch.setLayerBuffer(mDevice, display, layer, buffer, hwcFd);
 }
 
@@ -909,6 +925,7 @@ int32_t HalImpl::setLayerColorTransform(int64_t display, int64_t layer,
                                         const std::vector<float>& matrix) {
     if (!mDispatch.setLayerColorTransform) {
         const bool isIdentity = (std::equal(matrix.begin(), matrix.end(), mkIdentity.begin()));
+        std::lock_guard<std::mutex> lock(mClientCompositionLayersMutex);
         if (isIdentity) {
             mClientCompositionLayers[display].erase(layer);
             return HWC2_ERROR_UNSUPPORTED;
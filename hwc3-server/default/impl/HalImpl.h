@@ -19,6 +19,7 @@
 #include <memory>
 #include <unordered_set>
 #include <map>
+#include <mutex>
 
 #include "include/IComposerHal.h"
 #define HWC2_INCLUDE_STRINGIFICATION
@@ -105,7 +106,7 @@ class HalImpl : public IComposerHal {
                                                int64_t maxFrames) override;
     int32_t setLayerBlendMode(int64_t display, int64_t layer, common::BlendMode mode) override;
     int32_t setLayerBuffer(int64_t display, int64_t layer, buffer_handle_t buffer,
-                           const ndk::ScopedFileDescriptor& acquireFence) override;
+                           const ndk::ScopedFileDescriptor& acquireFence, bool reused) override;
     int32_t setLayerColor(int64_t display, int64_t layer, Color color) override;
     int32_t setLayerColorTransform(int64_t display, int64_t layer,
                                    const std::vector<float>& matrix) override;
@@ -158,6 +159,9 @@ private:
     template <typename T>
     bool initOptionalDispatch(hwc2_function_descriptor_t desc, T* outPfn); 
 
+    template <typename T>
+    bool initOptionalDispatch(HWC3::hwc3_function_descriptor_t desc, T* outPfn);
+
     template <typename T>
     bool initDispatch(hwc2_function_descriptor_t desc, T* outPfn);
 
@@ -247,6 +251,7 @@ private:
         HWC2_PFN_SET_LAYER_GENERIC_METADATA setLayerGenericMetadata;
         HWC2_PFN_GET_LAYER_GENERIC_METADATA_KEY getLayerGenericMetadataKey;
         HWC3::HWC3_PFN_SET_EXPECTED_PRESENT_TIME setExpectedPresentTime;
+        HWC3::HWC3_PFN_SET_LAYER_SLOT_BUFFER setLayerSlotBuffer;
     } mDispatch = {};
 
     hwc2_device_t* mDevice;
@@ -254,6 +259,8 @@ private:
     EventCallback* mEventCallback;
     std::unordered_set<Capability> mCaps;
     
+    // The commands of several displays may run at once
+    std::mutex mClientCompositionLayersMutex;
     std::map<int64_t, std::unordered_set<int64_t>> mClientCompositionLayers;
 
     constexpr static std::array<float, 16> mkIdentity = {
@@ -171,8 +171,10 @@ class IComposerHal {
                                                        FormatColorComponent componentMask,
                                                        int64_t maxFrames) = 0;
     virtual int32_t setLayerBlendMode(int64_t display, int64_t layer, common::BlendMode mode) = 0;
+    // reused: the buffer comes from the slot cache, it is not a new import
     virtual int32_t setLayerBuffer(int64_t display, int64_t layer, buffer_handle_t buffer,
-                                   const ndk::ScopedFileDescriptor& acquireFence) = 0;
+                                   const ndk::ScopedFileDescriptor& acquireFence,
+                                   bool reused) = 0;
     virtual int32_t setLayerColor(int64_t display, int64_t layer, Color color) = 0;
     virtual int32_t setLayerColorTransform(int64_t display, int64_t layer,
                                            const std::vector<float>& matrix) = 0;
@@ -0,0 +1,79 @@
+#include "bufferinfo/BufferIdCache.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+
+using android::BufferIdCache;
+
+namespace {
+
+/* Handle with a single fd and a gralloc buffer id */
+struct FakeHandle {
+  FakeHandle(int fd, int buffer_id)
+      : words{sizeof(native_handle_t), 1, 1, fd, buffer_id} {
+  }
+
+  auto Get() -> native_handle_t * {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<native_handle_t *>(words.data());
+  }
+
+  /* version, numFds, numInts, data */
+  std::array<int, 5> words;
+};
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferIdCacheTest, FindsReusedHandles) {
+  BufferIdCache cache;
+  FakeHandle a(10, 1);
+  FakeHandle b(11, 2);
+
+  EXPECT_FALSE(cache.Find(a.Get(), true));
+  cache.Add(a.Get(), 100);
+  cache.Add(b.Get(), 200);
+  EXPECT_EQ(cache.Find(a.Get(), true), 100);
+  EXPECT_EQ(cache.Find(b.Get(), true), 200);
+  EXPECT_FALSE(cache.Find(nullptr, true));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Find(a.Get(), true));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferIdCacheTest, MissesReplacedHandles) {
+  BufferIdCache cache;
+  FakeHandle a(10, 1);
+  cache.Add(a.Get(), 100);
+
+  /* Slot replaced, the new import got the same address and content */
+  EXPECT_FALSE(cache.Find(a.Get(), false));
+  /* The entry of the freed handle is gone */
+  EXPECT_FALSE(cache.Find(a.Get(), true));
+
+  cache.Add(a.Get(), 200);
+  EXPECT_EQ(cache.Find(a.Get(), true), 200);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferIdCacheTest, EvictsLeastRecentlyUsed) {
+  BufferIdCache cache;
+  std::array<std::unique_ptr<FakeHandle>, BufferIdCache::kCapacity + 1> handles;
+  for (size_t i = 0; i < handles.size(); i++) {
+    handles[i] = std::make_unique<FakeHandle>(int(i), int(i));
+  }
+
+  for (size_t i = 0; i < BufferIdCache::kCapacity; i++) {
+    cache.Add(handles[i]->Get(), i);
+  }
+  /* The first one gets used again, the second one is evicted */
+  EXPECT_EQ(cache.Find(handles[0]->Get(), true), 0);
+  cache.Add(handles.back()->Get(), handles.size() - 1);
+
+  EXPECT_EQ(cache.Find(handles[0]->Get(), true), 0);
+  EXPECT_FALSE(cache.Find(handles[1]->Get(), true));
+  EXPECT_EQ(cache.Find(handles.back()->Get(), true), handles.size() - 1);
+}
@@ -0,0 +1,54 @@
+#include "bufferinfo/BufferInfoCache.h"
+
+#include <gtest/gtest.h>
+
+using android::BufferInfoCache;
+
+namespace {
+
+auto MakeInfo(uint32_t width) -> std::shared_ptr<const BufferInfo> {
+  BufferInfo bi{};
+  bi.width = width;
+  return std::make_shared<const BufferInfo>(bi);
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferInfoCacheTest, SharesRecords) {
+  BufferInfoCache cache;
+  EXPECT_FALSE(cache.Get(1));
+
+  auto info = MakeInfo(100);
+  cache.Put(1, info);
+  EXPECT_EQ(cache.Get(1), info);
+  EXPECT_FALSE(cache.Get(2));
+
+  /* Replaced by the id */
+  cache.Put(1, MakeInfo(200));
+  EXPECT_EQ(cache.Get(1)->width, 200);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferInfoCacheTest, IgnoresInvalidId) {
+  BufferInfoCache cache;
+  cache.Put(0, MakeInfo(100));
+  EXPECT_FALSE(cache.Get(0));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(BufferInfoCacheTest, EvictsLeastRecentlyUsed) {
+  BufferInfoCache cache;
+  for (uint64_t id = 1; id <= BufferInfoCache::kCapacity; id++) {
+    cache.Put(id, MakeInfo(id));
+  }
+
+  /* The first one gets used again, the second one is evicted */
+  EXPECT_TRUE(cache.Get(1));
+  cache.Put(BufferInfoCache::kCapacity + 1, MakeInfo(0));
+
+  EXPECT_TRUE(cache.Get(1));
+  EXPECT_FALSE(cache.Get(2));
+  EXPECT_TRUE(cache.Get(3));
+  EXPECT_TRUE(cache.Get(BufferInfoCache::kCapacity + 1));
+}
@@ -0,0 +1,85 @@
+#include "utils/DamageTracker.h"
+
+#include <gtest/gtest.h>
+
+using android::Damage;
+using android::DamageTracker;
+
+namespace {
+
+auto Rect(int left, int top, int right, int bottom) -> Damage {
+  return hwc_rect_t{.left = left, .top = top, .right = right, .bottom = bottom};
+}
+
+void ExpectDamage(const Damage &damage, const Damage &expected) {
+  ASSERT_EQ(damage.has_value(), expected.has_value());
+  if (damage) {
+    EXPECT_EQ(damage->left, expected->left);
+    EXPECT_EQ(damage->top, expected->top);
+    EXPECT_EQ(damage->right, expected->right);
+    EXPECT_EQ(damage->bottom, expected->bottom);
+  }
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, NewBuffersAreDamagedAsWhole) {
+  DamageTracker tracker;
+  ExpectDamage(tracker.Present(1, Rect(0, 0, 10, 10)), {});
+  ExpectDamage(tracker.Present(2, Rect(0, 0, 10, 10)), {});
+  ExpectDamage(tracker.Present(3, Rect(0, 0, 10, 10)), {});
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, AccumulatesOverBufferAge) {
+  DamageTracker tracker;
+  tracker.Present(1, Rect(0, 0, 10, 10));
+  tracker.Present(2, Rect(20, 20, 30, 30));
+  tracker.Present(3, Rect(40, 0, 50, 10));
+
+  /* Age of 3: damage of the buffers 2, 3 and the new one */
+  ExpectDamage(tracker.Present(1, Rect(5, 5, 6, 6)), Rect(5, 0, 50, 30));
+  /* Age of 3 again, the damage of the buffer 2 is left out */
+  ExpectDamage(tracker.Present(2, Rect(0, 40, 1, 41)), Rect(0, 0, 50, 41));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, SameBufferTakesItsDamage) {
+  DamageTracker tracker;
+  tracker.Present(1, Rect(0, 0, 10, 10));
+  ExpectDamage(tracker.Present(1, Rect(1, 2, 3, 4)), Rect(1, 2, 3, 4));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, EmptyDamageIsKept) {
+  DamageTracker tracker;
+  tracker.Present(1, Rect(0, 0, 10, 10));
+  tracker.Present(2, Rect(0, 0, 0, 0));
+  ExpectDamage(tracker.Present(1, Rect(0, 0, 0, 0)), Rect(0, 0, 0, 0));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, UnknownDamageSpreads) {
+  DamageTracker tracker;
+  tracker.Present(1, Rect(0, 0, 10, 10));
+  tracker.Present(2, {});
+  ExpectDamage(tracker.Present(1, Rect(0, 0, 10, 10)), {});
+  /* The unknown damage is older than the buffer 2 */
+  ExpectDamage(tracker.Present(2, Rect(0, 0, 10, 10)), Rect(0, 0, 10, 10));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(DamageTrackerTest, ForgetsOldBuffers) {
+  DamageTracker tracker;
+  for (uint64_t id = 1; id <= DamageTracker::kHistorySize; id++) {
+    tracker.Present(id, Rect(0, 0, 1, 1));
+  }
+  ExpectDamage(tracker.Present(1, Rect(0, 0, 1, 1)), Rect(0, 0, 1, 1));
+  ExpectDamage(tracker.Present(DamageTracker::kHistorySize + 1,
+                               Rect(0, 0, 1, 1)),
+               {});
+
+  tracker.Clear();
+  ExpectDamage(tracker.Present(1, Rect(0, 0, 1, 1)), {});
+}
@@ -0,0 +1,116 @@
+#include "compositor/DrmKmsPlan.h"
+
+#include <gtest/gtest.h>
+
+using android::DrmKmsPlan;
+
+using PlaneCaps = DrmKmsPlan::PlaneCaps;
+
+struct DrmKmsPlanTest : public testing::Test {
+  /* Synthetic capability table: caps[plane][layer] */
+  static auto MakePlanes(const std::vector<std::vector<bool>> &caps,
+                         bool fixed_zpos) {
+    std::vector<PlaneCaps> planes;
+    for (const auto &valid : caps) {
+      planes.emplace_back(
+          PlaneCaps{.valid_for_layer = valid, .fixed_zpos = fixed_zpos});
+    }
+    return planes;
+  }
+};
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, NoLayers) {
+  auto planes = MakePlanes({{}, {}}, false);
+  auto res = DrmKmsPlan::AssignPlanes(0, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_TRUE(res->empty());
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, AllPlanesCapable) {
+  auto planes = MakePlanes({{true, true, true},
+                            {true, true, true},
+                            {true, true, true},
+                            {true, true, true}},
+                           false);
+  auto res = DrmKmsPlan::AssignPlanes(3, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_EQ(*res, (std::vector<size_t>{0, 1, 2}));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, MoreLayersThanPlanes) {
+  auto planes = MakePlanes({{true, true, true}, {true, true, true}}, false);
+  ASSERT_FALSE(DrmKmsPlan::AssignPlanes(3, planes).has_value());
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, LayerWithoutCapablePlane) {
+  auto planes = MakePlanes({{true, false}, {true, false}, {true, false}},
+                           false);
+  ASSERT_FALSE(DrmKmsPlan::AssignPlanes(2, planes).has_value());
+}
+
+/* Bottom layer can only go to the last overlay (e.g. YUV). First-fit would
+ * consume all the planes skipping over it.
+ */
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, RestackablePlanesAreReordered) {
+  auto planes = MakePlanes({{false, true, true},
+                            {false, true, true},
+                            {true, true, true}},
+                           false);
+  auto res = DrmKmsPlan::AssignPlanes(3, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_EQ(*res, (std::vector<size_t>{2, 0, 1}));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, FixedPlanesKeepOrder) {
+  auto planes = MakePlanes({{true, false}, {false, true}}, true);
+  auto res = DrmKmsPlan::AssignPlanes(2, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_EQ(*res, (std::vector<size_t>{0, 1}));
+
+  planes = MakePlanes({{false, true}, {true, false}}, true);
+  ASSERT_FALSE(DrmKmsPlan::AssignPlanes(2, planes).has_value());
+
+  planes = MakePlanes({{false, true}, {true, false}}, false);
+  res = DrmKmsPlan::AssignPlanes(2, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_EQ(*res, (std::vector<size_t>{1, 0}));
+}
+
+/* Primary plane has immutable zpos, overlays are free to be restacked */
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, MixedFixedAndRestackablePlanes) {
+  auto planes = MakePlanes({{true, false, true},
+                            {false, true, true},
+                            {true, true, false}},
+                           false);
+  planes[0].fixed_zpos = true;
+
+  auto res = DrmKmsPlan::AssignPlanes(3, planes);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_EQ(*res, (std::vector<size_t>{0, 2, 1}));
+
+  /* Fixed primary plane can't be stacked above the overlays */
+  planes[0].valid_for_layer = {false, false, true};
+  planes[2].valid_for_layer = {true, true, false};
+  ASSERT_FALSE(DrmKmsPlan::AssignPlanes(3, planes).has_value());
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(DrmKmsPlanTest, Deterministic) {
+  auto planes = MakePlanes({{true, true, false, true},
+                            {false, true, true, true},
+                            {true, false, true, true},
+                            {true, true, true, false}},
+                           false);
+  auto first = DrmKmsPlan::AssignPlanes(4, planes);
+  ASSERT_TRUE(first.has_value());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(DrmKmsPlan::AssignPlanes(4, planes), first);
+  }
+}
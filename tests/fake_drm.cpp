@@ -0,0 +1,1214 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_drm.h"
+
+#include <drm/drm_fourcc.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+
+#include "utils/properties.h"
+
+/* Opaque in libdrm */
+struct _drmModeAtomicReq {
+  struct Item {
+    uint32_t object_id;
+    uint32_t property_id;
+    uint64_t value;
+  };
+  std::vector<Item> items;
+};
+
+namespace android {
+
+namespace {
+
+constexpr uint32_t kCrtcId = 1;
+constexpr uint32_t kEncoderId = 2;
+constexpr uint32_t kConnectorId = 3;
+constexpr uint32_t kFirstPlaneId = 10;
+constexpr uint32_t kFirstPropertyId = 100;
+constexpr uint32_t kFirstFbId = 1000;
+constexpr uint32_t kFirstBlobId = 5000;
+
+constexpr int64_t kNsInSec = 1000000000LL;
+constexpr uint32_t kFixedPointShift = 16;
+
+struct FakeProperty {
+  uint32_t obj_id;
+  std::string name;
+  uint32_t flags;
+  std::vector<uint64_t> values;
+  std::vector<std::pair<uint64_t, std::string>> enums;
+};
+
+/* Property ids of a plane, 0 if the plane has no such property */
+struct FakePlane {
+  uint32_t id;
+  FakeKmsPlaneConfig config;
+  uint32_t crtc_id, fb_id;
+  uint32_t crtc_x, crtc_y, crtc_w, crtc_h;
+  uint32_t src_x, src_y, src_w, src_h;
+  uint32_t zpos, rotation;
+};
+
+struct FakeFb {
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;
+};
+
+struct FakeKmsState {
+  std::mutex mutex;
+  FakeKmsConfig config;
+  FakeKmsCounters counters{};
+  drmModeModeInfo mode{};
+  int64_t vblank_epoch_ns{};
+  /* Size of the committed MODE_ID. The CRTC state holds its own reference,
+   * so the blob may already be destroyed by the composer (as in the kernel).
+   */
+  uint32_t hdisplay{};
+  uint32_t vdisplay{};
+  uint32_t staged_hdisplay{};
+  uint32_t staged_vdisplay{};
+
+  /* Indexed by (property id - kFirstPropertyId) */
+  std::vector<FakeProperty> properties;
+  std::vector<uint64_t> values;
+  std::vector<uint64_t> staged;
+  std::map<uint32_t, std::vector<uint32_t>> object_props;
+
+  std::vector<FakePlane> planes;
+  uint32_t crtc_active{}, crtc_mode_id{}, crtc_out_fence_ptr{};
+  uint32_t conn_dpms{}, conn_crtc_id{};
+
+  std::map<uint32_t, FakeFb> fbs;
+  std::map<uint32_t, std::vector<uint8_t>> blobs;
+  /* dma-buf inode to GEM handle */
+  std::map<ino_t, uint32_t> gem_handles;
+  uint32_t next_fb_id = kFirstFbId;
+  uint32_t next_blob_id = kFirstBlobId;
+  uint32_t next_gem_handle = 1;
+
+  std::map<std::string, std::string> system_properties;
+
+  /* The composer opens the read end as the device node, it is readable
+   * while DRM events are pending. Every event writes one byte, and is
+   * delivered once due, as the kernel does.
+   */
+  int event_pipe[2] = {-1, -1};
+  struct PendingEvent {
+    /* Page-flip event of a commit, vblank event otherwise */
+    bool flip;
+    uint32_t sequence;
+    void *user_data;
+  };
+  std::multimap<int64_t /*due_ns*/, PendingEvent> events;
+  std::condition_variable events_changed;
+
+  void AddEvent(int64_t due_ns, const PendingEvent &event) {
+    events.emplace(due_ns, event);
+    events_changed.notify_all();
+  }
+
+  auto AddProperty(uint32_t obj_id, const char *name, uint32_t flags,
+                   std::vector<uint64_t> values, uint64_t value,
+                   std::vector<std::pair<uint64_t, std::string>> enums = {})
+      -> uint32_t {
+    auto id = uint32_t(kFirstPropertyId + properties.size());
+    properties.emplace_back(FakeProperty{.obj_id = obj_id,
+                                         .name = name,
+                                         .flags = flags,
+                                         .values = std::move(values),
+                                         .enums = std::move(enums)});
+    this->values.emplace_back(value);
+    object_props[obj_id].emplace_back(id);
+    return id;
+  }
+
+  auto GetProperty(uint32_t prop_id) -> FakeProperty * {
+    if (prop_id < kFirstPropertyId ||
+        prop_id - kFirstPropertyId >= properties.size()) {
+      return nullptr;
+    }
+    return &properties[prop_id - kFirstPropertyId];
+  }
+
+  auto Staged(uint32_t prop_id) const -> uint64_t {
+    return prop_id != 0 ? staged[prop_id - kFirstPropertyId] : 0;
+  }
+
+  auto Value(uint32_t prop_id) const -> uint64_t {
+    return prop_id != 0 ? values[prop_id - kFirstPropertyId] : 0;
+  }
+
+  auto NextVblankNs() const -> int64_t;
+  auto CheckStagedState() -> int;
+};
+
+auto State() -> FakeKmsState & {
+  /* Intentionally leaked, composer threads may outlive static destructors */
+  static auto *state = new FakeKmsState();
+  return *state;
+}
+
+auto GetTimeMonotonicNs() -> int64_t {
+  struct timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * kNsInSec + int64_t(ts.tv_nsec);
+}
+
+auto ToTimespec(int64_t ns) -> struct timespec {
+  struct timespec ts {};
+  ts.tv_sec = ns / kNsInSec;
+  ts.tv_nsec = ns % kNsInSec;
+  return ts;
+}
+
+void SleepUntil(int64_t ns) {
+  auto ts = ToTimespec(ns);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+         EINTR) {
+  }
+}
+
+auto FakeKmsState::NextVblankNs() const -> int64_t {
+  int64_t period = kNsInSec / config.refresh;
+  int64_t now = GetTimeMonotonicNs();
+  return vblank_epoch_ns + ((now - vblank_epoch_ns) / period + 1) * period;
+}
+
+auto FakeKmsState::CheckStagedState() -> int {
+  bool active = Staged(crtc_active) != 0;
+  uint64_t mode_blob = Staged(crtc_mode_id);
+  if (active && mode_blob == 0) {
+    return -EINVAL;
+  }
+
+  if (mode_blob != Value(crtc_mode_id)) {
+    staged_hdisplay = 0;
+    staged_vdisplay = 0;
+    if (mode_blob != 0) {
+      auto blob = blobs.find(uint32_t(mode_blob));
+      if (blob == blobs.end() ||
+          blob->second.size() != sizeof(drmModeModeInfo)) {
+        return -EINVAL;
+      }
+      drmModeModeInfo mode_info{};
+      memcpy(&mode_info, blob->second.data(), sizeof(mode_info));
+      staged_hdisplay = mode_info.hdisplay;
+      staged_vdisplay = mode_info.vdisplay;
+    }
+  } else {
+    staged_hdisplay = hdisplay;
+    staged_vdisplay = vdisplay;
+  }
+
+  uint32_t active_planes = 0;
+  uint64_t used_zpos = 0;
+  for (auto &plane : planes) {
+    auto fb_id = uint32_t(Staged(plane.fb_id));
+    auto crtc_id = uint32_t(Staged(plane.crtc_id));
+    if (fb_id == 0 && crtc_id == 0) {
+      continue;
+    }
+
+    if (fb_id == 0 || crtc_id != kCrtcId || !active) {
+      return -EINVAL;
+    }
+
+    auto fb = fbs.find(fb_id);
+    if (fb == fbs.end()) {
+      return -ENOENT;
+    }
+
+    auto &formats = plane.config.formats;
+    if (std::find(formats.begin(), formats.end(), fb->second.format) ==
+        formats.end()) {
+      return -EINVAL;
+    }
+
+    auto src_x = Staged(plane.src_x);
+    auto src_y = Staged(plane.src_y);
+    auto src_w = Staged(plane.src_w);
+    auto src_h = Staged(plane.src_h);
+    if (src_w == 0 || src_h == 0 ||
+        src_x + src_w > uint64_t(fb->second.width) << kFixedPointShift ||
+        src_y + src_h > uint64_t(fb->second.height) << kFixedPointShift) {
+      return -ENOSPC;
+    }
+
+    auto crtc_x = int32_t(Staged(plane.crtc_x));
+    auto crtc_y = int32_t(Staged(plane.crtc_y));
+    auto crtc_w = int64_t(Staged(plane.crtc_w));
+    auto crtc_h = int64_t(Staged(plane.crtc_h));
+    if (crtc_w <= 0 || crtc_h <= 0 || crtc_x + crtc_w <= 0 ||
+        crtc_y + crtc_h <= 0 || crtc_x >= int64_t(staged_hdisplay) ||
+        crtc_y >= int64_t(staged_vdisplay)) {
+      return -EINVAL;
+    }
+
+    uint64_t rotation = plane.rotation != 0 ? Staged(plane.rotation)
+                                            : DRM_MODE_ROTATE_0;
+    bool swap_axes = (rotation &
+                      (DRM_MODE_ROTATE_90 | DRM_MODE_ROTATE_270)) != 0;
+    auto dst_w = uint64_t(swap_axes ? crtc_h : crtc_w) << kFixedPointShift;
+    auto dst_h = uint64_t(swap_axes ? crtc_w : crtc_h) << kFixedPointShift;
+    if (!plane.config.scaling) {
+      if (src_w != dst_w || src_h != dst_h) {
+        return -ERANGE;
+      }
+    } else {
+      /* Up to 2x downscaling */
+      constexpr uint64_t kMaxDownscale = 2;
+      if (src_w > dst_w * kMaxDownscale || src_h > dst_h * kMaxDownscale) {
+        return -ERANGE;
+      }
+    }
+
+    if (plane.zpos != 0) {
+      uint64_t zpos_bit = 1ULL << (Staged(plane.zpos) % 64);
+      if ((used_zpos & zpos_bit) != 0) {
+        return -EINVAL;
+      }
+      used_zpos |= zpos_bit;
+    }
+
+    active_planes++;
+  }
+
+  uint32_t max_active_planes = config.max_active_planes != 0
+                                   ? config.max_active_planes
+                                   : uint32_t(planes.size());
+  if (active_planes > max_active_planes) {
+    return -ENOSPC;
+  }
+
+  return 0;
+}
+
+/* Present fence, signaled at |signal_ns| or immediately if it is 0 */
+auto CreateFence(int64_t signal_ns) -> int {
+  if (signal_ns == 0) {
+    return eventfd(1, EFD_CLOEXEC);
+  }
+
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (fd < 0) {
+    return fd;
+  }
+
+  struct itimerspec its {};
+  its.it_value = ToTimespec(signal_ns);
+  timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, nullptr);
+  return fd;
+}
+
+void FillMode(drmModeModeInfo &mode, uint32_t width, uint32_t height,
+              uint32_t refresh) {
+  constexpr uint32_t kHBlank = 160;
+  constexpr uint32_t kVBlank = 45;
+  constexpr uint32_t kKhzInHz = 1000;
+
+  mode = {};
+  mode.hdisplay = width;
+  mode.hsync_start = width + kHBlank / 4;
+  mode.hsync_end = width + kHBlank / 2;
+  mode.htotal = width + kHBlank;
+  mode.vdisplay = height;
+  mode.vsync_start = height + kVBlank / 9;
+  mode.vsync_end = height + kVBlank / 3;
+  mode.vtotal = height + kVBlank;
+  mode.clock = uint32_t(uint64_t(mode.htotal) * mode.vtotal * refresh /
+                        kKhzInHz);
+  mode.vrefresh = refresh;
+  mode.type = DRM_MODE_TYPE_PREFERRED | DRM_MODE_TYPE_DRIVER;
+  snprintf(mode.name, sizeof(mode.name), "%ux%u", width, height);
+}
+
+void CountIoctl() {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+}
+
+template <typename T>
+auto CopyToCArray(const std::vector<T> &v) -> T * {
+  auto *arr = static_cast<T *>(calloc(v.size() + 1, sizeof(T)));
+  std::copy(v.begin(), v.end(), arr);
+  return arr;
+}
+
+}  // namespace
+
+auto FakeKms::DefaultConfig() -> FakeKmsConfig {
+  FakeKmsConfig config;
+  std::vector<uint32_t> rgb = {DRM_FORMAT_XRGB8888, DRM_FORMAT_ARGB8888,
+                               DRM_FORMAT_XBGR8888, DRM_FORMAT_ABGR8888,
+                               DRM_FORMAT_BGR565,   DRM_FORMAT_ABGR2101010};
+  std::vector<uint32_t> rgb_yuv = rgb;
+  rgb_yuv.emplace_back(DRM_FORMAT_NV12);
+  rgb_yuv.emplace_back(DRM_FORMAT_YVU420);
+
+  config.planes.emplace_back(FakeKmsPlaneConfig{.type = DRM_PLANE_TYPE_PRIMARY,
+                                                .formats = rgb,
+                                                .scaling = false,
+                                                .rotation = false,
+                                                .zpos_mutable = false});
+  for (int i = 0; i < 3; i++) {
+    config.planes.emplace_back(
+        FakeKmsPlaneConfig{.type = DRM_PLANE_TYPE_OVERLAY,
+                           .formats = rgb_yuv,
+                           .scaling = true,
+                           .rotation = true,
+                           .zpos_mutable = true});
+  }
+  return config;
+}
+
+void FakeKms::Setup(const FakeKmsConfig &config) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+
+  st.config = config;
+  st.counters = {};
+  st.properties.clear();
+  st.values.clear();
+  st.object_props.clear();
+  st.planes.clear();
+  st.fbs.clear();
+  st.blobs.clear();
+  st.gem_handles.clear();
+  st.hdisplay = 0;
+  st.vdisplay = 0;
+  st.vblank_epoch_ns = GetTimeMonotonicNs();
+  FillMode(st.mode, config.width, config.height, config.refresh);
+
+  if (st.event_pipe[0] < 0 && pipe2(st.event_pipe, O_CLOEXEC) != 0) {
+    abort();
+  }
+  st.events.clear();
+
+  constexpr uint64_t kFenceFdMax = INT32_MAX;
+  constexpr uint64_t kCoordMax = INT32_MAX;
+  constexpr uint64_t kAlphaMax = UINT16_MAX;
+
+  st.crtc_active = st.AddProperty(kCrtcId, "ACTIVE", DRM_MODE_PROP_RANGE,
+                                  {0, 1}, 0);
+  st.crtc_mode_id = st.AddProperty(kCrtcId, "MODE_ID", DRM_MODE_PROP_BLOB,
+                                   {}, 0);
+  st.crtc_out_fence_ptr = st.AddProperty(kCrtcId, "OUT_FENCE_PTR",
+                                         DRM_MODE_PROP_RANGE,
+                                         {0, UINT64_MAX}, 0);
+  constexpr uint64_t kGammaLutSize = 256;
+  st.AddProperty(kCrtcId, "CTM", DRM_MODE_PROP_BLOB, {}, 0);
+  st.AddProperty(kCrtcId, "GAMMA_LUT", DRM_MODE_PROP_BLOB, {}, 0);
+  st.AddProperty(kCrtcId, "GAMMA_LUT_SIZE",
+                 DRM_MODE_PROP_RANGE | DRM_MODE_PROP_IMMUTABLE,
+                 {0, UINT32_MAX}, kGammaLutSize);
+
+  st.conn_dpms = st.AddProperty(kConnectorId, "DPMS", DRM_MODE_PROP_ENUM,
+                                {0, 1, 2, 3}, 0,
+                                {{0, "On"},
+                                 {1, "Standby"},
+                                 {2, "Suspend"},
+                                 {3, "Off"}});
+  st.conn_crtc_id = st.AddProperty(kConnectorId, "CRTC_ID",
+                                   DRM_MODE_PROP_OBJECT,
+                                   {DRM_MODE_OBJECT_CRTC}, 0);
+
+  auto zpos_max = uint64_t(config.planes.size() - 1);
+  for (size_t i = 0; i < config.planes.size(); i++) {
+    auto &pc = config.planes[i];
+    FakePlane plane{};
+    plane.id = kFirstPlaneId + uint32_t(i);
+    plane.config = pc;
+
+    st.AddProperty(plane.id, "type",
+                   DRM_MODE_PROP_ENUM | DRM_MODE_PROP_IMMUTABLE, {0, 1, 2},
+                   pc.type,
+                   {{DRM_PLANE_TYPE_OVERLAY, "Overlay"},
+                    {DRM_PLANE_TYPE_PRIMARY, "Primary"},
+                    {DRM_PLANE_TYPE_CURSOR, "Cursor"}});
+    plane.crtc_id = st.AddProperty(plane.id, "CRTC_ID", DRM_MODE_PROP_OBJECT,
+                                   {DRM_MODE_OBJECT_CRTC}, 0);
+    plane.fb_id = st.AddProperty(plane.id, "FB_ID", DRM_MODE_PROP_OBJECT,
+                                 {DRM_MODE_OBJECT_FB}, 0);
+    plane.crtc_x = st.AddProperty(plane.id, "CRTC_X", DRM_MODE_PROP_RANGE,
+                                  {0, kCoordMax}, 0);
+    plane.crtc_y = st.AddProperty(plane.id, "CRTC_Y", DRM_MODE_PROP_RANGE,
+                                  {0, kCoordMax}, 0);
+    plane.crtc_w = st.AddProperty(plane.id, "CRTC_W", DRM_MODE_PROP_RANGE,
+                                  {0, kCoordMax}, 0);
+    plane.crtc_h = st.AddProperty(plane.id, "CRTC_H", DRM_MODE_PROP_RANGE,
+                                  {0, kCoordMax}, 0);
+    plane.src_x = st.AddProperty(plane.id, "SRC_X", DRM_MODE_PROP_RANGE,
+                                 {0, UINT32_MAX}, 0);
+    plane.src_y = st.AddProperty(plane.id, "SRC_Y", DRM_MODE_PROP_RANGE,
+                                 {0, UINT32_MAX}, 0);
+    plane.src_w = st.AddProperty(plane.id, "SRC_W", DRM_MODE_PROP_RANGE,
+                                 {0, UINT32_MAX}, 0);
+    plane.src_h = st.AddProperty(plane.id, "SRC_H", DRM_MODE_PROP_RANGE,
+                                 {0, UINT32_MAX}, 0);
+    plane.zpos = st.AddProperty(plane.id, "zpos",
+                                DRM_MODE_PROP_RANGE |
+                                    (pc.zpos_mutable ? 0
+                                                     : DRM_MODE_PROP_IMMUTABLE),
+                                {pc.zpos_mutable ? 0 : i,
+                                 pc.zpos_mutable ? zpos_max : i},
+                                i);
+    if (pc.rotation) {
+      plane.rotation = st.AddProperty(plane.id, "rotation",
+                                      DRM_MODE_PROP_BITMASK,
+                                      {0, 1, 2, 3, 4, 5}, DRM_MODE_ROTATE_0,
+                                      {{0, "rotate-0"},
+                                       {1, "rotate-90"},
+                                       {2, "rotate-180"},
+                                       {3, "rotate-270"},
+                                       {4, "reflect-x"},
+                                       {5, "reflect-y"}});
+    }
+    st.AddProperty(plane.id, "alpha", DRM_MODE_PROP_RANGE, {0, kAlphaMax},
+                   kAlphaMax);
+    st.AddProperty(plane.id, "pixel blend mode", DRM_MODE_PROP_ENUM,
+                   {0, 1, 2}, 1,
+                   {{0, "None"}, {1, "Pre-multiplied"}, {2, "Coverage"}});
+    st.AddProperty(plane.id, "IN_FENCE_FD", DRM_MODE_PROP_RANGE,
+                   {0, kFenceFdMax}, UINT64_MAX);
+    st.AddProperty(plane.id, "FB_DAMAGE_CLIPS", DRM_MODE_PROP_BLOB, {}, 0);
+
+    st.planes.emplace_back(plane);
+  }
+
+  st.staged = st.values;
+}
+
+auto FakeKms::GetCounters() -> FakeKmsCounters {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  return st.counters;
+}
+
+auto FakeKms::GetDevicePath() -> std::string {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  return "/proc/self/fd/" + std::to_string(st.event_pipe[0]);
+}
+
+void FakeKms::SetProperty(const std::string &name, const std::string &value) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.system_properties[name] = value;
+#ifndef ANDROID
+  /* utils/properties.h reads the environment on non-Android builds */
+  setenv(name.c_str(), value.c_str(), 1);
+#endif
+}
+
+}  // namespace android
+
+using android::FakeFb;
+using android::State;
+
+#ifdef ANDROID
+/* Interposes libcutils */
+extern "C" int property_get(const char *key, char *value,
+                            const char *default_value) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  auto it = st.system_properties.find(key);
+  const char *res = it != st.system_properties.end()
+                        ? it->second.c_str()
+                        : (default_value != nullptr ? default_value : "");
+  snprintf(value, PROPERTY_VALUE_MAX, "%s", res);
+  return int(strlen(value));
+}
+#endif
+
+extern "C" {
+
+int drmIoctl(int /*fd*/, unsigned long request, void *arg) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+
+  switch (request) {
+    case DRM_IOCTL_MODE_CREATEPROPBLOB: {
+      auto *create = static_cast<drm_mode_create_blob *>(arg);
+      // NOLINTNEXTLINE(performance-no-int-to-ptr)
+      auto *data = reinterpret_cast<const uint8_t *>(create->data);
+      create->blob_id = st.next_blob_id++;
+      st.blobs[create->blob_id] = {data, data + create->length};
+      st.counters.blobs_created++;
+      return 0;
+    }
+    case DRM_IOCTL_MODE_DESTROYPROPBLOB: {
+      auto *destroy = static_cast<drm_mode_destroy_blob *>(arg);
+      if (st.blobs.erase(destroy->blob_id) == 0) {
+        errno = ENOENT;
+        return -1;
+      }
+      return 0;
+    }
+    case DRM_IOCTL_GEM_CLOSE: {
+      auto *gem_close = static_cast<drm_gem_close *>(arg);
+      for (auto it = st.gem_handles.begin(); it != st.gem_handles.end();
+           ++it) {
+        if (it->second == gem_close->handle) {
+          st.gem_handles.erase(it);
+          return 0;
+        }
+      }
+      errno = EINVAL;
+      return -1;
+    }
+    default:
+      errno = ENOTTY;
+      return -1;
+  }
+}
+
+drmVersionPtr drmGetVersion(int /*fd*/) {
+  android::CountIoctl();
+  auto *ver = static_cast<drmVersionPtr>(calloc(1, sizeof(drmVersion)));
+  ver->version_major = 1;
+  ver->name = strdup("fake-kms");
+  ver->name_len = int(strlen(ver->name));
+  ver->date = strdup("20230101");
+  ver->date_len = int(strlen(ver->date));
+  ver->desc = strdup("In-process fake DRM/KMS device");
+  ver->desc_len = int(strlen(ver->desc));
+  return ver;
+}
+
+void drmFreeVersion(drmVersionPtr ver) {
+  if (ver == nullptr) {
+    return;
+  }
+  free(ver->name);
+  free(ver->date);
+  free(ver->desc);
+  free(ver);
+}
+
+int drmGetCap(int /*fd*/, uint64_t capability, uint64_t *value) {
+  android::CountIoctl();
+  *value = capability == DRM_CAP_ADDFB2_MODIFIERS ||
+                   capability == DRM_CAP_CRTC_IN_VBLANK_EVENT
+               ? 1
+               : 0;
+  return 0;
+}
+
+int drmSetClientCap(int /*fd*/, uint64_t /*capability*/, uint64_t /*value*/) {
+  android::CountIoctl();
+  return 0;
+}
+
+int drmSetMaster(int /*fd*/) {
+  android::CountIoctl();
+  return 0;
+}
+
+int drmIsMaster(int /*fd*/) {
+  android::CountIoctl();
+  return 1;
+}
+
+int drmWaitVBlank(int fd, drmVBlankPtr vbl) {
+  auto &st = State();
+  int64_t vblank_ns = 0;
+  int64_t period = 0;
+  {
+    const std::lock_guard<std::mutex> lock(st.mutex);
+    st.counters.ioctls++;
+    vblank_ns = st.NextVblankNs();
+    period = android::kNsInSec / st.config.refresh;
+    vbl->reply.sequence = uint32_t((vblank_ns - st.vblank_epoch_ns) / period);
+
+    if ((vbl->request.type & DRM_VBLANK_EVENT) != 0) {
+      /* As the kernel, no events from a disabled CRTC */
+      if (st.Value(st.crtc_active) == 0) {
+        return -EINVAL;
+      }
+      st.AddEvent(vblank_ns,
+                        android::FakeKmsState::PendingEvent{
+                            .flip = false,
+                            .sequence = vbl->reply.sequence,
+                            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+                            .user_data = reinterpret_cast<void *>(
+                                vbl->request.signal)});
+      return write(fd, "v", 1) == 1 ? 0 : -errno;
+    }
+  }
+
+  android::SleepUntil(vblank_ns);
+
+  constexpr int64_t kNsInUs = 1000;
+  vbl->reply.tval_sec = long(vblank_ns / android::kNsInSec);
+  vbl->reply.tval_usec = long((vblank_ns % android::kNsInSec) / kNsInUs);
+  return 0;
+}
+
+/* Delivers the earliest pending event once it is due. Events requested
+ * meanwhile may be due earlier, so it waits for the changes of the queue.
+ */
+int drmHandleEvent(int fd, drmEventContextPtr evctx) {
+  auto &st = State();
+  std::unique_lock<std::mutex> lock(st.mutex);
+  for (;;) {
+    if (st.events.empty()) {
+      /* Dropped by Setup() */
+      lock.unlock();
+      char byte = 0;
+      return read(fd, &byte, 1) == 1 ? 0 : -errno;
+    }
+
+    auto due_ns = st.events.begin()->first;
+    if (due_ns <= android::GetTimeMonotonicNs()) {
+      break;
+    }
+    st.events_changed.wait_until(
+        lock, std::chrono::steady_clock::time_point(
+                  std::chrono::nanoseconds(due_ns)));
+  }
+
+  auto due_ns = st.events.begin()->first;
+  auto event = st.events.begin()->second;
+  st.events.erase(st.events.begin());
+  lock.unlock();
+
+  char byte = 0;
+  if (read(fd, &byte, 1) != 1) {
+    return -errno;
+  }
+
+  constexpr int64_t kNsInUs = 1000;
+  auto tv_sec = unsigned(due_ns / android::kNsInSec);
+  auto tv_usec = unsigned((due_ns % android::kNsInSec) / kNsInUs);
+  if (event.flip && evctx->page_flip_handler2 != nullptr) {
+    evctx->page_flip_handler2(fd, event.sequence, tv_sec, tv_usec,
+                              android::kCrtcId, event.user_data);
+  } else if (!event.flip && evctx->vblank_handler != nullptr) {
+    evctx->vblank_handler(fd, event.sequence, tv_sec, tv_usec,
+                          event.user_data);
+  }
+  return 0;
+}
+
+int drmPrimeFDToHandle(int /*fd*/, int prime_fd, uint32_t *handle) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  st.counters.prime_imports++;
+
+  struct stat sb {};
+  if (fstat(prime_fd, &sb) != 0) {
+    return -errno;
+  }
+
+  auto it = st.gem_handles.find(sb.st_ino);
+  if (it == st.gem_handles.end()) {
+    it = st.gem_handles.emplace(sb.st_ino, st.next_gem_handle++).first;
+  }
+  *handle = it->second;
+  return 0;
+}
+
+drmModeResPtr drmModeGetResources(int /*fd*/) {
+  android::CountIoctl();
+  auto *res = static_cast<drmModeResPtr>(calloc(1, sizeof(drmModeRes)));
+  res->count_crtcs = 1;
+  res->crtcs = android::CopyToCArray<uint32_t>({android::kCrtcId});
+  res->count_encoders = 1;
+  res->encoders = android::CopyToCArray<uint32_t>({android::kEncoderId});
+  res->count_connectors = 1;
+  res->connectors = android::CopyToCArray<uint32_t>({android::kConnectorId});
+  constexpr uint32_t kMaxResolution = 8192;
+  res->max_width = res->max_height = kMaxResolution;
+  return res;
+}
+
+void drmModeFreeResources(drmModeResPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->fbs);
+  free(ptr->crtcs);
+  free(ptr->encoders);
+  free(ptr->connectors);
+  free(ptr);
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int /*fd*/) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  std::vector<uint32_t> ids;
+  for (auto &plane : st.planes) {
+    ids.emplace_back(plane.id);
+  }
+  auto *res = static_cast<drmModePlaneResPtr>(
+      calloc(1, sizeof(drmModePlaneRes)));
+  res->count_planes = uint32_t(ids.size());
+  res->planes = android::CopyToCArray(ids);
+  return res;
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->planes);
+  free(ptr);
+}
+
+drmModePlanePtr drmModeGetPlane(int /*fd*/, uint32_t plane_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  for (auto &plane : st.planes) {
+    if (plane.id != plane_id) {
+      continue;
+    }
+    auto *p = static_cast<drmModePlanePtr>(calloc(1, sizeof(drmModePlane)));
+    p->plane_id = plane.id;
+    p->crtc_id = uint32_t(st.Value(plane.crtc_id));
+    p->fb_id = uint32_t(st.Value(plane.fb_id));
+    p->possible_crtcs = 1;
+    p->count_formats = uint32_t(plane.config.formats.size());
+    p->formats = android::CopyToCArray(plane.config.formats);
+    return p;
+  }
+  errno = ENOENT;
+  return nullptr;
+}
+
+void drmModeFreePlane(drmModePlanePtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->formats);
+  free(ptr);
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int /*fd*/, uint32_t crtc_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  if (crtc_id != android::kCrtcId) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  auto *crtc = static_cast<drmModeCrtcPtr>(calloc(1, sizeof(drmModeCrtc)));
+  crtc->crtc_id = crtc_id;
+  crtc->mode_valid = st.Value(st.crtc_active) != 0 ? 1 : 0;
+  if (crtc->mode_valid != 0) {
+    crtc->mode = st.mode;
+    crtc->width = st.mode.hdisplay;
+    crtc->height = st.mode.vdisplay;
+  }
+  return crtc;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr) {
+  free(ptr);
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int /*fd*/, uint32_t encoder_id) {
+  android::CountIoctl();
+  if (encoder_id != android::kEncoderId) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  auto *enc = static_cast<drmModeEncoderPtr>(
+      calloc(1, sizeof(drmModeEncoder)));
+  enc->encoder_id = encoder_id;
+  enc->encoder_type = DRM_MODE_ENCODER_TMDS;
+  enc->crtc_id = android::kCrtcId;
+  enc->possible_crtcs = 1;
+  return enc;
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr ptr) {
+  free(ptr);
+}
+
+drmModeConnectorPtr drmModeGetConnector(int /*fd*/, uint32_t connector_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  if (connector_id != android::kConnectorId) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  auto *conn = static_cast<drmModeConnectorPtr>(
+      calloc(1, sizeof(drmModeConnector)));
+  conn->connector_id = connector_id;
+  conn->encoder_id = android::kEncoderId;
+  conn->connector_type = DRM_MODE_CONNECTOR_eDP;
+  conn->connector_type_id = 1;
+  conn->connection = DRM_MODE_CONNECTED;
+  constexpr uint32_t kMmWidth = 344;
+  constexpr uint32_t kMmHeight = 194;
+  conn->mmWidth = kMmWidth;
+  conn->mmHeight = kMmHeight;
+  conn->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+  conn->count_modes = 1;
+  conn->modes = android::CopyToCArray<drmModeModeInfo>({st.mode});
+  conn->count_encoders = 1;
+  conn->encoders = android::CopyToCArray<uint32_t>({android::kEncoderId});
+
+  auto &prop_ids = st.object_props[connector_id];
+  std::vector<uint64_t> values;
+  for (auto id : prop_ids) {
+    values.emplace_back(st.Value(id));
+  }
+  conn->count_props = int(prop_ids.size());
+  conn->props = android::CopyToCArray(prop_ids);
+  conn->prop_values = android::CopyToCArray(values);
+  return conn;
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->modes);
+  free(ptr->encoders);
+  free(ptr->props);
+  free(ptr->prop_values);
+  free(ptr);
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int /*fd*/,
+                                                      uint32_t object_id,
+                                                      uint32_t /*type*/) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  auto it = st.object_props.find(object_id);
+  if (it == st.object_props.end()) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  std::vector<uint64_t> values;
+  for (auto id : it->second) {
+    values.emplace_back(st.Value(id));
+  }
+  auto *props = static_cast<drmModeObjectPropertiesPtr>(
+      calloc(1, sizeof(drmModeObjectProperties)));
+  props->count_props = uint32_t(it->second.size());
+  props->props = android::CopyToCArray(it->second);
+  props->prop_values = android::CopyToCArray(values);
+  return props;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->props);
+  free(ptr->prop_values);
+  free(ptr);
+}
+
+drmModePropertyPtr drmModeGetProperty(int /*fd*/, uint32_t property_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  auto *fp = st.GetProperty(property_id);
+  if (fp == nullptr) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  auto *p = static_cast<drmModePropertyPtr>(
+      calloc(1, sizeof(drmModePropertyRes)));
+  p->prop_id = property_id;
+  p->flags = fp->flags;
+  snprintf(p->name, sizeof(p->name), "%s", fp->name.c_str());
+  p->count_values = int(fp->values.size());
+  p->values = android::CopyToCArray(fp->values);
+  p->count_enums = int(fp->enums.size());
+  p->enums = static_cast<drm_mode_property_enum *>(
+      calloc(fp->enums.size() + 1, sizeof(drm_mode_property_enum)));
+  for (size_t i = 0; i < fp->enums.size(); i++) {
+    p->enums[i].value = fp->enums[i].first;
+    snprintf(p->enums[i].name, sizeof(p->enums[i].name), "%s",
+             fp->enums[i].second.c_str());
+  }
+  return p;
+}
+
+void drmModeFreeProperty(drmModePropertyPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->values);
+  free(ptr->enums);
+  free(ptr->blob_ids);
+  free(ptr);
+}
+
+drmModePropertyBlobPtr drmModeGetPropertyBlob(int /*fd*/, uint32_t blob_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  auto it = st.blobs.find(blob_id);
+  if (it == st.blobs.end()) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  auto *blob = static_cast<drmModePropertyBlobPtr>(
+      calloc(1, sizeof(drmModePropertyBlobRes)));
+  blob->id = blob_id;
+  blob->length = uint32_t(it->second.size());
+  blob->data = android::CopyToCArray(it->second);
+  return blob;
+}
+
+void drmModeFreePropertyBlob(drmModePropertyBlobPtr ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  free(ptr->data);
+  free(ptr);
+}
+
+int drmModeCreatePropertyBlob(int fd, const void *data, size_t size,
+                              uint32_t *id) {
+  struct drm_mode_create_blob create {};
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  create.data = reinterpret_cast<uint64_t>(data);
+  create.length = uint32_t(size);
+  if (drmIoctl(fd, DRM_IOCTL_MODE_CREATEPROPBLOB, &create) != 0) {
+    return -errno;
+  }
+  *id = create.blob_id;
+  return 0;
+}
+
+int drmModeDestroyPropertyBlob(int fd, uint32_t id) {
+  struct drm_mode_destroy_blob destroy {};
+  destroy.blob_id = id;
+  return drmIoctl(fd, DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy) != 0 ? -errno
+                                                                     : 0;
+}
+
+int drmModeObjectSetProperty(int /*fd*/, uint32_t object_id,
+                             uint32_t /*object_type*/, uint32_t property_id,
+                             uint64_t value) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  auto *fp = st.GetProperty(property_id);
+  if (fp == nullptr || fp->obj_id != object_id ||
+      (fp->flags & DRM_MODE_PROP_IMMUTABLE) != 0) {
+    return -EINVAL;
+  }
+  st.values[property_id - android::kFirstPropertyId] = value;
+  return 0;
+}
+
+int drmModeConnectorSetProperty(int fd, uint32_t connector_id,
+                                uint32_t property_id, uint64_t value) {
+  return drmModeObjectSetProperty(fd, connector_id, DRM_MODE_OBJECT_CONNECTOR,
+                                  property_id, value);
+}
+
+int drmModeAddFB2WithModifiers(int /*fd*/, uint32_t width, uint32_t height,
+                               uint32_t pixel_format,
+                               const uint32_t bo_handles[4],
+                               const uint32_t /*pitches*/[4],
+                               const uint32_t /*offsets*/[4],
+                               const uint64_t /*modifier*/[4],
+                               uint32_t *buf_id, uint32_t /*flags*/) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+
+  bool handle_found = false;
+  for (auto &gem : st.gem_handles) {
+    handle_found |= gem.second == bo_handles[0];
+  }
+  if (!handle_found || width == 0 || height == 0) {
+    return -EINVAL;
+  }
+
+  *buf_id = st.next_fb_id++;
+  st.fbs[*buf_id] = FakeFb{.width = width,
+                           .height = height,
+                           .format = pixel_format};
+  st.counters.fbs_added++;
+  return 0;
+}
+
+int drmModeAddFB2(int fd, uint32_t width, uint32_t height,
+                  uint32_t pixel_format, const uint32_t bo_handles[4],
+                  const uint32_t pitches[4], const uint32_t offsets[4],
+                  uint32_t *buf_id, uint32_t flags) {
+  return drmModeAddFB2WithModifiers(fd, width, height, pixel_format,
+                                    bo_handles, pitches, offsets, nullptr,
+                                    buf_id, flags);
+}
+
+int drmModeRmFB(int /*fd*/, uint32_t buffer_id) {
+  auto &st = State();
+  const std::lock_guard<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+  if (st.fbs.erase(buffer_id) == 0) {
+    return -ENOENT;
+  }
+  st.counters.fbs_removed++;
+  return 0;
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc() {
+  return new _drmModeAtomicReq();
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req) {
+  delete req;
+}
+
+int drmModeAtomicGetCursor(drmModeAtomicReqPtr req) {
+  return int(req->items.size());
+}
+
+void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor) {
+  /* Keeps the capacity, same as libdrm keeps the item array */
+  req->items.resize(cursor);
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t object_id,
+                             uint32_t property_id, uint64_t value) {
+  req->items.emplace_back(_drmModeAtomicReq::Item{.object_id = object_id,
+                                                  .property_id = property_id,
+                                                  .value = value});
+  return int(req->items.size());
+}
+
+int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags,
+                        void *user_data) {
+  auto &st = State();
+  std::unique_lock<std::mutex> lock(st.mutex);
+  st.counters.ioctls++;
+
+  bool test_only = (flags & DRM_MODE_ATOMIC_TEST_ONLY) != 0;
+  if (test_only) {
+    st.counters.test_commits++;
+  } else {
+    st.counters.commits++;
+    st.counters.commit_props += req->items.size();
+  }
+
+  /* Same size every time, does not reallocate */
+  st.staged = st.values;
+
+  uint64_t out_fence_ptr = 0;
+  int err = 0;
+  for (auto &item : req->items) {
+    auto *fp = st.GetProperty(item.property_id);
+    if (fp == nullptr || fp->obj_id != item.object_id) {
+      err = -ENOENT;
+      break;
+    }
+    if ((fp->flags & DRM_MODE_PROP_IMMUTABLE) != 0) {
+      err = -EINVAL;
+      break;
+    }
+    if (item.property_id == st.crtc_out_fence_ptr) {
+      out_fence_ptr = item.value;
+      continue;
+    }
+    st.staged[item.property_id - android::kFirstPropertyId] = item.value;
+  }
+
+  if (err == 0) {
+    err = st.CheckStagedState();
+  }
+
+  bool flip_event = (flags & DRM_MODE_PAGE_FLIP_EVENT) != 0;
+  if (err == 0 && flip_event) {
+    /* As the kernel, one flip at a time and only for an active CRTC */
+    auto flip_pending = std::any_of(st.events.begin(), st.events.end(),
+                                    [](auto &e) { return e.second.flip; });
+    if (flip_pending) {
+      err = -EBUSY;
+    } else if (st.Staged(st.crtc_active) == 0) {
+      err = -EINVAL;
+    }
+  }
+
+  if (err != 0 || test_only) {
+    if (err != 0 && test_only) {
+      st.counters.failed_test_commits++;
+    }
+    return err;
+  }
+
+  std::swap(st.values, st.staged);
+  st.hdisplay = st.staged_hdisplay;
+  st.vdisplay = st.staged_vdisplay;
+  int64_t vblank_ns = st.config.vblank_timing ? st.NextVblankNs() : 0;
+  if (flip_event) {
+    int64_t period = android::kNsInSec / st.config.refresh;
+    int64_t flip_ns = vblank_ns != 0 ? vblank_ns
+                                     : android::GetTimeMonotonicNs();
+    st.AddEvent(flip_ns,
+                      android::FakeKmsState::PendingEvent{
+                          .flip = true,
+                          .sequence = uint32_t((flip_ns - st.vblank_epoch_ns) /
+                                               period),
+                          .user_data = user_data});
+    if (write(fd, "f", 1) != 1) {
+      return -errno;
+    }
+  }
+  lock.unlock();
+
+  if (out_fence_ptr != 0) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    *reinterpret_cast<int32_t *>(out_fence_ptr) = android::CreateFence(
+        vblank_ns);
+  }
+
+  /* Blocking commit returns once the new frame is scanned out */
+  if (vblank_ns != 0 && (flags & DRM_MODE_ATOMIC_NONBLOCK) == 0) {
+    android::SleepUntil(vblank_ns);
+  }
+
+  return 0;
+}
+
+}  // extern "C"
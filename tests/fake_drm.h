@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKE_DRM_H_
+#define FAKE_DRM_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android {
+
+/*
+ * In-process replacement of the libdrm entry points used by drm_hwcomposer.
+ * Linking fake_drm.cpp into an executable together with the composer sources
+ * interposes the real libdrm, so no DRM device (or GPU) is required.
+ *
+ * The fake models a single CRTC/encoder/connector chain with a configurable
+ * set of planes, object properties, property blobs, framebuffers, GEM handles
+ * and atomic commits (including the TEST_ONLY checks), vblank and page-flip
+ * events, and it counts every call which would be an ioctl on real hardware.
+ */
+struct FakeKmsPlaneConfig {
+  uint32_t type;  // DRM_PLANE_TYPE_*
+  std::vector<uint32_t> formats;
+  bool scaling;
+  bool rotation;
+  bool zpos_mutable;
+};
+
+struct FakeKmsConfig {
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  uint32_t refresh = 60;
+  std::vector<FakeKmsPlaneConfig> planes;
+  /* Bandwidth limit, 0 - number of planes */
+  uint32_t max_active_planes = 0;
+  /* Blocking commits and present fences follow the synthetic vblank
+   * instead of completing immediately.
+   */
+  bool vblank_timing = false;
+};
+
+struct FakeKmsCounters {
+  uint64_t ioctls;
+  uint64_t commits;
+  /* Properties set by the non-test commits */
+  uint64_t commit_props;
+  uint64_t test_commits;
+  uint64_t failed_test_commits;
+  uint64_t fbs_added;
+  uint64_t fbs_removed;
+  uint64_t prime_imports;
+  uint64_t blobs_created;
+};
+
+class FakeKms {
+ public:
+  /* Primary plane and 3 scaling-capable overlays */
+  static auto DefaultConfig() -> FakeKmsConfig;
+
+  /* Recreates the object tree and resets the counters */
+  static void Setup(const FakeKmsConfig &config);
+
+  static auto GetCounters() -> FakeKmsCounters;
+
+  /* Device node for the composer, delivers the requested DRM events */
+  static auto GetDevicePath() -> std::string;
+
+  /* Properties seen by property_get() of the composer. Anything not set here
+   * reads as the default value, so the results do not depend on the device.
+   */
+  static void SetProperty(const std::string &name, const std::string &value);
+};
+
+}  // namespace android
+
+#endif
@@ -0,0 +1,92 @@
+#include "hwc2_device/FlatteningPolicy.h"
+
+#include <gtest/gtest.h>
+
+using android::FlatteningPolicy;
+using android::LayerActivity;
+
+namespace {
+
+constexpr int64_t kIdleNs = 1000;
+
+auto MakeLayers(const std::vector<int64_t> &last_update_ns)
+    -> std::vector<LayerActivity> {
+  std::vector<LayerActivity> layers;
+  for (auto ns : last_update_ns) {
+    layers.emplace_back(LayerActivity{.last_update_ns = ns});
+  }
+  return layers;
+}
+
+auto Evaluate(FlatteningPolicy &policy,
+              const std::vector<LayerActivity> &layers, int64_t now_ns)
+    -> std::tuple<int, size_t> {
+  std::vector<const LayerActivity *> activity;
+  for (auto &layer : layers) {
+    activity.emplace_back(&layer);
+  }
+  return policy.Evaluate(activity, now_ns);
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(FlatteningPolicyTest, FlattensAllStaticLayers) {
+  FlatteningPolicy policy({.idle_ns = kIdleNs, .min_layers = 2});
+  auto layers = MakeLayers({100, 200, 300});
+
+  EXPECT_EQ(Evaluate(policy, layers, 1150), std::make_tuple(-1, size_t(0)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 1200);
+
+  EXPECT_EQ(Evaluate(policy, layers, 1200), std::make_tuple(0, size_t(2)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 1300);
+
+  EXPECT_EQ(Evaluate(policy, layers, 1300), std::make_tuple(0, size_t(3)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 0);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(FlatteningPolicyTest, KeepsActiveLayersOnPlanes) {
+  FlatteningPolicy policy({.idle_ns = kIdleNs, .min_layers = 2});
+  /* Wallpaper, launcher, video, status bar, navigation bar */
+  auto layers = MakeLayers({0, 4500, 5000, 100, 200});
+
+  EXPECT_EQ(Evaluate(policy, layers, 5100), std::make_tuple(3, size_t(2)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 5500);
+
+  /* The longest run wins */
+  layers[1].last_update_ns = 0;
+  layers[4].last_update_ns = 5000;
+  EXPECT_EQ(Evaluate(policy, layers, 5100), std::make_tuple(0, size_t(2)));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(FlatteningPolicyTest, RespectsMinLayers) {
+  FlatteningPolicy policy({.idle_ns = kIdleNs, .min_layers = 2});
+  auto layers = MakeLayers({0, 5000, 0});
+
+  EXPECT_EQ(Evaluate(policy, layers, 5100), std::make_tuple(-1, size_t(0)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 6000);
+
+  EXPECT_EQ(Evaluate(policy, MakeLayers({0}), 5100),
+            std::make_tuple(-1, size_t(0)));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(FlatteningPolicyTest, CanBeDisabled) {
+  FlatteningPolicy policy({.idle_ns = 0, .min_layers = 2});
+  EXPECT_EQ(Evaluate(policy, MakeLayers({0, 0}), 5000),
+            std::make_tuple(-1, size_t(0)));
+  EXPECT_EQ(policy.GetNextEvaluationNs(), 0);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(FlatteningPolicyTest, AveragesUpdateInterval) {
+  LayerActivity activity;
+  activity.Update(1000);
+  EXPECT_EQ(activity.update_interval_ns, 0);
+  activity.Update(2000);
+  EXPECT_EQ(activity.update_interval_ns, 1000);
+  activity.Update(2800);
+  EXPECT_EQ(activity.update_interval_ns, 975);
+}
@@ -0,0 +1,184 @@
+#include "utils/GammaLut.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using android::ApplyContrastBrightness;
+using android::ApplyContrastBrightnessScalar;
+using android::BuildGammaLut;
+using android::GammaCurve;
+
+namespace {
+
+struct LutEntry {
+  uint16_t red;
+  uint16_t green;
+  uint16_t blue;
+  uint16_t reserved;
+};
+
+/* Per-entry code the generator replaces, kept as the reference */
+float TransformContrastBrightness(float value, float brightness,
+                                  float contrast) {
+  float result;
+  result = (value - 0.5) * contrast + 0.5 + brightness;
+
+  if (result < 0.0) {
+    result = 0.0;
+  }
+  if (result > 1.0) {
+    result = 1.0;
+  }
+  return result;
+}
+
+float TransformGamma(float value, float gamma) {
+  float result;
+
+  result = pow(value, gamma);
+  if (result < 0.0) {
+    result = 0.0;
+  }
+  if (result > 1.0) {
+    result = 1.0;
+  }
+
+  return result;
+}
+
+auto ReferenceLut(const std::array<GammaCurve, 3> &curves, uint64_t lut_size)
+    -> std::vector<LutEntry> {
+  std::vector<LutEntry> lut(lut_size);
+  for (uint64_t i = 0; i < lut_size; i++) {
+    if (i == 0) {
+      lut[i].red = 0;
+      lut[i].green = 0;
+      lut[i].blue = 0;
+      continue;
+    }
+
+    lut[i].red = 0xFFFF * TransformGamma(TransformContrastBrightness(
+                                             (float)(i) / lut_size,
+                                             curves[0].brightness,
+                                             curves[0].contrast),
+                                         curves[0].gamma);
+    lut[i].green = 0xFFFF * TransformGamma(TransformContrastBrightness(
+                                               (float)(i) / lut_size,
+                                               curves[1].brightness,
+                                               curves[1].contrast),
+                                           curves[1].gamma);
+    lut[i].blue = 0xFFFF * TransformGamma(TransformContrastBrightness(
+                                              (float)(i) / lut_size,
+                                              curves[2].brightness,
+                                              curves[2].contrast),
+                                          curves[2].gamma);
+  }
+  return lut;
+}
+
+/* Same mapping as the color adjustment settings use */
+auto MakeCurve(uint32_t brightness, uint32_t contrast, float gamma)
+    -> GammaCurve {
+  return {.brightness = float((float)(brightness) / 255 - 0.5),
+          .contrast = (float)(contrast) / 128,
+          .gamma = gamma};
+}
+
+void ExpectSameLut(const std::array<GammaCurve, 3> &curves, size_t size) {
+  auto expected = ReferenceLut(curves, size);
+  std::vector<LutEntry> lut(size);
+  BuildGammaLut(curves, lut.size(), lut.data());
+
+  for (size_t i = 0; i < size; i++) {
+    ASSERT_EQ(lut[i].red, expected[i].red) << "entry " << i;
+    ASSERT_EQ(lut[i].green, expected[i].green) << "entry " << i;
+    ASSERT_EQ(lut[i].blue, expected[i].blue) << "entry " << i;
+  }
+}
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(GammaLutTest, MatchesReferenceForAllSettings) {
+  for (size_t size : {256, 1024, 4096}) {
+    for (uint32_t brightness = 0; brightness <= 0xFF; brightness += 5) {
+      for (uint32_t contrast = 0; contrast <= 0xFF; contrast += 5) {
+        auto curve = MakeCurve(brightness, contrast, 1.0F);
+        ExpectSameLut({curve, curve, curve}, size);
+      }
+    }
+  }
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(GammaLutTest, MatchesReferenceForSeparateChannelsAndGamma) {
+  for (size_t size : {1, 2, 65, 4096, 8192}) {
+    for (float gamma : {0.45F, 1.0F, 2.2F}) {
+      ExpectSameLut({MakeCurve(0x80, 0x80, gamma),
+                     MakeCurve(0x20, 0xC0, gamma),
+                     MakeCurve(0xF0, 0x10, 1.0F)},
+                    size);
+    }
+  }
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(GammaLutTest, SimdMatchesScalarForUnalignedBlocks) {
+  constexpr size_t kSize = 1000;
+  std::array<float, kSize> expected{};
+  std::array<float, kSize> values{};
+
+  for (uint32_t contrast : {0x00, 0x40, 0x80, 0xFF}) {
+    auto curve = MakeCurve(0x30, contrast, 1.0F);
+    for (size_t base : {0, 1, 3, 7}) {
+      auto count = kSize - base;
+      ApplyContrastBrightnessScalar(curve, kSize, base, count, expected.data());
+      ApplyContrastBrightness(curve, kSize, base, count, values.data());
+      for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(values[i], expected[i]) << "entry " << base + i;
+      }
+    }
+  }
+}
+
+/* Prints timings only, run with --gtest_also_run_disabled_tests */
+// NOLINTNEXTLINE: required by gtest macros
+TEST(GammaLutTest, DISABLED_Benchmark) {
+  constexpr size_t kSize = 4096;
+  constexpr int kRuns = 200;
+  auto curve = MakeCurve(0x90, 0xA0, 1.0F);
+  std::array<GammaCurve, 3> curves = {curve, curve, curve};
+
+  auto measure = [&](auto &&build) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRuns; i++) {
+      build();
+    }
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           kRuns;
+  };
+
+  std::vector<LutEntry> lut(kSize);
+  auto reference_us = measure([&] { ReferenceLut(curves, kSize); });
+  auto generator_us = measure(
+      [&] { BuildGammaLut(curves, lut.size(), lut.data()); });
+  printf("%zu entries LUT: reference %.1f us, generator %.1f us\n", kSize,
+         reference_us, generator_us);
+
+  std::vector<float> values(kSize);
+  auto scalar_us = measure([&] {
+    ApplyContrastBrightnessScalar(curve, kSize, 0, kSize, values.data());
+  });
+  auto simd_us = measure([&] {
+    ApplyContrastBrightness(curve, kSize, 0, kSize, values.data());
+  });
+  printf("%zu entries contrast and brightness: scalar %.2f us, simd %.2f us\n",
+         kSize, scalar_us, simd_us);
+}
@@ -0,0 +1,835 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Offline composition benchmark.
+ *
+ * Replays layer stacks (synthetic scenarios or traces in utils/LayerTrace.h
+ * format) through HwcDisplay::ValidateDisplay()/PresentDisplay() on top of the
+ * in-process fake DRM/KMS device (see fake_drm.h) and reports per-frame CPU
+ * time, heap allocations and DRM ioctl counts. Does not need a GPU or a DRM
+ * device, so it can run on any CI box.
+ */
+
+#include <cutils/native_handle.h>
+#include <drm/drm_fourcc.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bufferinfo/BufferInfoGetter.h"
+#include "fake_drm.h"
+#include "hwc2_device/DrmHwcTwo.h"
+#include "utils/LatencyHistogram.h"
+#include "utils/LayerTrace.h"
+
+/* Heap allocation counters, all threads */
+static std::atomic<uint64_t> allocs_num{0};
+static std::atomic<uint64_t> allocs_bytes{0};
+
+void *operator new(size_t size) {
+  allocs_num.fetch_add(1, std::memory_order_relaxed);
+  allocs_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *ptr = malloc(size != 0 ? size : 1);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t /*size*/) noexcept {
+  free(ptr);
+}
+
+namespace android {
+
+/* Fake gralloc buffer: memfd (unique inode for GetUniqueId()) + geometry */
+enum FakeBufferInts { kWidth, kHeight, kFormat, kIntsNum };
+
+class FakeBufferInfoGetter : public LegacyBufferInfoGetter {
+ public:
+  auto GetBoInfo(buffer_handle_t handle) -> std::optional<BufferInfo> override {
+    if (handle == nullptr || handle->numFds != 1 ||
+        handle->numInts != kIntsNum) {
+      return {};
+    }
+
+    const int *ints = &handle->data[handle->numFds];
+    BufferInfo bi{};
+    bi.width = uint32_t(ints[kWidth]);
+    bi.height = uint32_t(ints[kHeight]);
+    bi.format = uint32_t(ints[kFormat]);
+
+    int fd = handle->data[0];
+    switch (bi.format) {
+      case DRM_FORMAT_NV12:
+        bi.pitches[0] = bi.pitches[1] = bi.width;
+        bi.offsets[1] = bi.width * bi.height;
+        bi.prime_fds[0] = bi.prime_fds[1] = fd;
+        break;
+      case DRM_FORMAT_YVU420:
+        bi.pitches[0] = bi.width;
+        bi.pitches[1] = bi.pitches[2] = bi.width / 2;
+        bi.offsets[1] = bi.width * bi.height;
+        bi.offsets[2] = bi.offsets[1] + bi.width * bi.height / 4;
+        bi.prime_fds[0] = bi.prime_fds[1] = bi.prime_fds[2] = fd;
+        break;
+      case DRM_FORMAT_BGR565:
+        bi.pitches[0] = bi.width * 2;
+        bi.prime_fds[0] = fd;
+        break;
+      default:
+        bi.pitches[0] = bi.width * 4;
+        bi.prime_fds[0] = fd;
+        break;
+    }
+
+    return bi;
+  }
+};
+
+std::unique_ptr<LegacyBufferInfoGetter>
+LegacyBufferInfoGetter::CreateInstance() {
+  return std::make_unique<FakeBufferInfoGetter>();
+}
+
+namespace {
+
+constexpr int64_t kNsInUs = 1000;
+constexpr int64_t kNsInSec = 1000000000LL;
+
+struct TraceFrame {
+  LayerTraceFrame frame;
+  std::vector<LayerTraceLayer> layers;
+};
+
+using Workload = std::vector<TraceFrame>;
+
+class FakeBufferPool {
+ public:
+  FakeBufferPool() = default;
+  FakeBufferPool(const FakeBufferPool &) = delete;
+  FakeBufferPool &operator=(const FakeBufferPool &) = delete;
+
+  ~FakeBufferPool() {
+    Clear();
+  }
+
+  /* Buffer ids are only unique within a workload */
+  void Clear() {
+    for (auto &buf : buffers_) {
+      native_handle_close(buf.second);
+      native_handle_delete(buf.second);
+    }
+    buffers_.clear();
+  }
+
+  auto Has(uint64_t id) const -> bool {
+    return buffers_.count(id) != 0;
+  }
+
+  auto Get(uint64_t id, uint32_t width, uint32_t height, uint32_t format)
+      -> buffer_handle_t {
+    auto it = buffers_.find(id);
+    if (it != buffers_.end()) {
+      return it->second;
+    }
+
+    int fd = memfd_create("hwc-bench-buffer", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, getpagesize()) != 0) {
+      fprintf(stderr, "Failed to create fake buffer: %s\n", strerror(errno));
+      abort();
+    }
+
+    auto *handle = native_handle_create(1, kIntsNum);
+    handle->data[0] = fd;
+    handle->data[1 + kWidth] = int(width);
+    handle->data[1 + kHeight] = int(height);
+    handle->data[1 + kFormat] = int(format);
+    buffers_[id] = handle;
+    return handle;
+  }
+
+ private:
+  std::map<uint64_t, native_handle_t *> buffers_;
+};
+
+struct FrameStats {
+  LatencyHistogram cpu_ns;
+  int64_t cpu_ns_total{};
+  uint64_t frames{};
+  uint64_t allocs{};
+  uint64_t alloc_bytes{};
+  uint64_t ioctls{};
+  uint64_t commits{};
+  uint64_t commit_props{};
+  uint64_t test_commits{};
+  uint64_t failed_test_commits{};
+  uint64_t fbs_added{};
+  uint64_t client_frames{};
+  uint64_t failed_frames{};
+};
+
+auto ThreadCpuTimeNs() -> int64_t {
+  struct timespec ts {};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return int64_t(ts.tv_sec) * kNsInSec + int64_t(ts.tv_nsec);
+}
+
+auto ToHwcBlendMode(uint8_t blend_mode) -> int32_t {
+  switch (static_cast<BufferBlendMode>(blend_mode)) {
+    case BufferBlendMode::kNone:
+      return HWC2_BLEND_MODE_NONE;
+    case BufferBlendMode::kCoverage:
+      return HWC2_BLEND_MODE_COVERAGE;
+    default:
+      return HWC2_BLEND_MODE_PREMULTIPLIED;
+  }
+}
+
+auto ToHwcTransform(uint32_t transform) -> int32_t {
+  if ((transform & LayerTransform::kRotate270) != 0) {
+    return HWC_TRANSFORM_ROT_270;
+  }
+  if ((transform & LayerTransform::kRotate180) != 0) {
+    return HWC_TRANSFORM_ROT_180;
+  }
+  int32_t res = 0;
+  if ((transform & LayerTransform::kFlipH) != 0)
+    res |= HWC_TRANSFORM_FLIP_H;
+  if ((transform & LayerTransform::kFlipV) != 0)
+    res |= HWC_TRANSFORM_FLIP_V;
+  if ((transform & LayerTransform::kRotate90) != 0)
+    res |= HWC_TRANSFORM_ROT_90;
+  return res;
+}
+
+auto ToHwcDataspace(uint8_t color_space, uint8_t sample_range) -> int32_t {
+  int32_t dataspace = 0;
+  switch (static_cast<BufferColorSpace>(color_space)) {
+    case BufferColorSpace::kItuRec601:
+      dataspace |= HAL_DATASPACE_STANDARD_BT601_625;
+      break;
+    case BufferColorSpace::kItuRec709:
+      dataspace |= HAL_DATASPACE_STANDARD_BT709;
+      break;
+    case BufferColorSpace::kItuRec2020:
+      dataspace |= HAL_DATASPACE_STANDARD_BT2020;
+      break;
+    default:
+      break;
+  }
+  switch (static_cast<BufferSampleRange>(sample_range)) {
+    case BufferSampleRange::kFullRange:
+      dataspace |= HAL_DATASPACE_RANGE_FULL;
+      break;
+    case BufferSampleRange::kLimitedRange:
+      dataspace |= HAL_DATASPACE_RANGE_LIMITED;
+      break;
+    default:
+      break;
+  }
+  return dataspace;
+}
+
+/* Drives the primary display the way SurfaceFlinger does */
+class BenchDisplay {
+ public:
+  static auto Create() -> std::unique_ptr<BenchDisplay> {
+    auto bench = std::unique_ptr<BenchDisplay>(new BenchDisplay());
+    auto &hwc = *bench->hwc_;
+    const std::lock_guard<InstrumentedMutex> lock(
+        hwc.GetResMan().GetMainLock());
+
+    hwc.RegisterCallback(HWC2_CALLBACK_HOTPLUG, bench.get(),
+                         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                         reinterpret_cast<hwc2_function_pointer_t>(
+                             &BenchDisplay::HotplugHook));
+
+    bench->display_ = hwc.GetDisplay(kPrimaryDisplay);
+    if (bench->display_ == nullptr || bench->display_->IsInHeadlessMode()) {
+      fprintf(stderr, "No display is attached to the fake DRM device\n");
+      return {};
+    }
+
+    const std::lock_guard<InstrumentedMutex> display_lock(
+        bench->display_->GetDisplayLock());
+    bench->display_->SetPowerMode(static_cast<int32_t>(HWC2::PowerMode::On));
+    return bench;
+  }
+
+  BenchDisplay(const BenchDisplay &) = delete;
+  BenchDisplay &operator=(const BenchDisplay &) = delete;
+
+  ~BenchDisplay() {
+    const std::lock_guard<InstrumentedMutex> lock(
+        hwc_->GetResMan().GetMainLock());
+    hwc_->RegisterCallback(HWC2_CALLBACK_HOTPLUG, nullptr, nullptr);
+  }
+
+  auto Run(const Workload &workload, uint64_t warmup) -> FrameStats {
+    FrameStats stats;
+    for (size_t i = 0; i < workload.size(); i++) {
+      auto allocs_start = allocs_num.load(std::memory_order_relaxed);
+      auto bytes_start = allocs_bytes.load(std::memory_order_relaxed);
+      auto kms_start = FakeKms::GetCounters();
+      auto cpu_start = ThreadCpuTimeNs();
+
+      bool client = false;
+      bool ok = PlayFrame(workload[i], &client);
+
+      auto cpu_ns = ThreadCpuTimeNs() - cpu_start;
+      auto kms = FakeKms::GetCounters();
+      if (i < warmup) {
+        continue;
+      }
+
+      stats.frames++;
+      stats.cpu_ns.Record(cpu_ns);
+      stats.cpu_ns_total += cpu_ns;
+      stats.allocs += allocs_num.load(std::memory_order_relaxed) -
+                      allocs_start;
+      stats.alloc_bytes += allocs_bytes.load(std::memory_order_relaxed) -
+                           bytes_start;
+      stats.ioctls += kms.ioctls - kms_start.ioctls;
+      stats.commits += kms.commits - kms_start.commits;
+      stats.commit_props += kms.commit_props - kms_start.commit_props;
+      stats.test_commits += kms.test_commits - kms_start.test_commits;
+      stats.failed_test_commits += kms.failed_test_commits -
+                                   kms_start.failed_test_commits;
+      stats.fbs_added += kms.fbs_added - kms_start.fbs_added;
+      stats.client_frames += client ? 1 : 0;
+      stats.failed_frames += ok ? 0 : 1;
+    }
+
+    DestroyLayers();
+    return stats;
+  }
+
+ private:
+  BenchDisplay() : hwc_(std::make_unique<DrmHwcTwo>()) {
+  }
+
+  static void HotplugHook(hwc2_callback_data_t /*data*/,
+                          hwc2_display_t /*display*/, int32_t /*connected*/) {
+  }
+
+  void DestroyLayers() {
+    const std::lock_guard<InstrumentedMutex> lock(display_->GetDisplayLock());
+    for (auto &l : layers_) {
+      display_->DestroyLayer(l.second);
+    }
+    layers_.clear();
+    layer_buffers_.clear();
+    buffers_.Clear();
+  }
+
+  auto PlayFrame(const TraceFrame &tf, bool *client) -> bool {
+    const std::lock_guard<InstrumentedMutex> lock(display_->GetDisplayLock());
+
+    /* Layers which are gone from the stack */
+    for (auto it = layers_.begin(); it != layers_.end();) {
+      bool present = false;
+      for (const auto &tl : tf.layers) {
+        present |= tl.layer_id == it->first;
+      }
+      if (!present) {
+        display_->DestroyLayer(it->second);
+        layer_buffers_.erase(it->first);
+        it = layers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (const auto &tl : tf.layers) {
+      if (layers_.count(tl.layer_id) == 0) {
+        hwc2_layer_t id = 0;
+        display_->CreateLayer(&id);
+        layers_[tl.layer_id] = id;
+      }
+      auto *layer = display_->get_layer(layers_[tl.layer_id]);
+
+      if (tl.buffer_id != 0 && layer_buffers_[tl.layer_id] != tl.buffer_id) {
+        /* Like a composer slot, the handle is imported once and reused */
+        bool reused = buffers_.Has(tl.buffer_id);
+        layer->SetLayerSlotBuffer(buffers_.Get(tl.buffer_id, tl.buffer_width,
+                                               tl.buffer_height,
+                                               tl.buffer_format),
+                                  -1, reused);
+        layer_buffers_[tl.layer_id] = tl.buffer_id;
+      }
+
+      layer->SetLayerCompositionType(tl.sf_type);
+      layer->SetLayerDisplayFrame({.left = tl.display_frame[0],
+                                   .top = tl.display_frame[1],
+                                   .right = tl.display_frame[2],
+                                   .bottom = tl.display_frame[3]});
+      layer->SetLayerSourceCrop({.left = tl.source_crop[0],
+                                 .top = tl.source_crop[1],
+                                 .right = tl.source_crop[2],
+                                 .bottom = tl.source_crop[3]});
+      layer->SetLayerZOrder(tl.z_order);
+      layer->SetLayerPlaneAlpha(float(tl.alpha) / UINT16_MAX);
+      layer->SetLayerBlendMode(ToHwcBlendMode(tl.blend_mode));
+      layer->SetLayerTransform(ToHwcTransform(tl.transform));
+      layer->SetLayerDataspace(ToHwcDataspace(tl.color_space,
+                                              tl.sample_range));
+    }
+
+    uint32_t num_types = 0;
+    uint32_t num_requests = 0;
+    auto err = display_->ValidateDisplay(&num_types, &num_requests);
+    if (err != HWC2::Error::None && err != HWC2::Error::HasChanges) {
+      return false;
+    }
+    display_->AcceptDisplayChanges();
+
+    *client = false;
+    for (auto &l : display_->layers()) {
+      *client |= l.second.GetValidatedType() == HWC2::Composition::Client;
+    }
+
+    if (*client) {
+      /* Triple-buffered client target */
+      constexpr uint64_t kClientTargetIdBase = UINT64_MAX - 3;
+      auto id = kClientTargetIdBase + (client_target_seq_++ % 3);
+      int32_t width = 0;
+      int32_t height = 0;
+      hwc2_config_t config = 0;
+      display_->GetActiveConfig(&config);
+      display_->GetDisplayAttribute(config, HWC2_ATTRIBUTE_WIDTH, &width);
+      display_->GetDisplayAttribute(config, HWC2_ATTRIBUTE_HEIGHT, &height);
+      display_->SetClientTarget(buffers_.Get(id, uint32_t(width),
+                                             uint32_t(height),
+                                             DRM_FORMAT_ABGR8888),
+                                -1, HAL_DATASPACE_UNKNOWN, {});
+    }
+
+    int32_t present_fence = -1;
+    err = display_->PresentDisplay(&present_fence);
+    if (present_fence >= 0) {
+      close(present_fence);
+    }
+    if (err != HWC2::Error::None) {
+      return false;
+    }
+
+    uint32_t num_fences = 0;
+    display_->GetReleaseFences(&num_fences, nullptr, nullptr);
+    release_layers_.resize(num_fences);
+    release_fences_.resize(num_fences);
+    display_->GetReleaseFences(&num_fences, release_layers_.data(),
+                               release_fences_.data());
+    for (uint32_t i = 0; i < num_fences; i++) {
+      close(release_fences_[i]);
+    }
+
+    return true;
+  }
+
+  std::unique_ptr<DrmHwcTwo> hwc_;
+  HwcDisplay *display_{};
+  FakeBufferPool buffers_;
+  /* Trace layer id to the HWC2 layer handle and its current buffer */
+  std::map<uint64_t, hwc2_layer_t> layers_;
+  std::map<uint64_t, uint64_t> layer_buffers_;
+  uint64_t client_target_seq_{};
+  std::vector<hwc2_layer_t> release_layers_;
+  std::vector<int32_t> release_fences_;
+};
+
+/* Synthetic workloads */
+
+struct SynthLayer {
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;
+  hwc_rect_t frame;
+  /* New buffer every |update_period| frames, 0 - static */
+  uint32_t update_period;
+  uint32_t transform;
+  uint8_t blend_mode;
+  uint8_t color_space;
+};
+
+auto MakeWorkload(const std::vector<SynthLayer> &stack, uint32_t frames)
+    -> Workload {
+  /* Triple-buffered swapchain per layer */
+  constexpr uint64_t kSwapchainSize = 3;
+  constexpr uint64_t kMaxSwapchainsPerLayer = 16;
+
+  Workload workload(frames);
+  for (uint32_t f = 0; f < frames; f++) {
+    auto &tf = workload[f];
+    tf.frame = {};
+    tf.frame.frame_no = f;
+    tf.frame.layers_num = uint32_t(stack.size());
+
+    for (size_t l = 0; l < stack.size(); l++) {
+      const auto &sl = stack[l];
+      uint64_t updates = sl.update_period != 0 ? f / sl.update_period : 0;
+
+      LayerTraceLayer tl{};
+      tl.layer_id = l + 1;
+      tl.buffer_id = (l + 1) * kMaxSwapchainsPerLayer +
+                     updates % kSwapchainSize;
+      tl.buffer_width = sl.width;
+      tl.buffer_height = sl.height;
+      tl.buffer_format = sl.format;
+      tl.z_order = uint32_t(l);
+      tl.sf_type = int32_t(HWC2::Composition::Device);
+      tl.source_crop[2] = float(sl.width);
+      tl.source_crop[3] = float(sl.height);
+      tl.display_frame[0] = sl.frame.left;
+      tl.display_frame[1] = sl.frame.top;
+      tl.display_frame[2] = sl.frame.right;
+      tl.display_frame[3] = sl.frame.bottom;
+      tl.transform = sl.transform;
+      tl.alpha = UINT16_MAX;
+      tl.blend_mode = sl.blend_mode;
+      tl.color_space = sl.color_space;
+      tf.layers.emplace_back(tl);
+    }
+  }
+  return workload;
+}
+
+auto SyntheticWorkload(const std::string &name, uint32_t frames, int32_t w,
+                       int32_t h) -> std::optional<Workload> {
+  auto none = uint8_t(BufferBlendMode::kNone);
+  auto premult = uint8_t(BufferBlendMode::kPreMult);
+  auto bt709 = uint8_t(BufferColorSpace::kItuRec709);
+  auto full = hwc_rect_t{0, 0, w, h};
+  constexpr int32_t kBarHeight = 64;
+
+  if (name == "fullscreen") {
+    return MakeWorkload({{uint32_t(w), uint32_t(h), DRM_FORMAT_XBGR8888, full,
+                          1, 0, none, 0}},
+                        frames);
+  }
+
+  if (name == "home") {
+    return MakeWorkload(
+        {{uint32_t(w), uint32_t(h), DRM_FORMAT_XBGR8888, full, 0, 0, none, 0},
+         {uint32_t(w), uint32_t(h), DRM_FORMAT_ABGR8888, full, 2, 0, premult,
+          0},
+         {uint32_t(w), kBarHeight, DRM_FORMAT_ABGR8888,
+          hwc_rect_t{0, 0, w, kBarHeight}, 60, 0, premult, 0},
+         {uint32_t(w), kBarHeight, DRM_FORMAT_ABGR8888,
+          hwc_rect_t{0, h - kBarHeight, w, h}, 0, 0, premult, 0}},
+        frames);
+  }
+
+  if (name == "video") {
+    constexpr uint32_t kVideoW = 1280;
+    constexpr uint32_t kVideoH = 720;
+    /* Primary plane is RGB-only, video goes to an overlay above the static
+     * background
+     */
+    return MakeWorkload(
+        {{uint32_t(w), uint32_t(h), DRM_FORMAT_XBGR8888, full, 0, 0, none, 0},
+         {kVideoW, kVideoH, DRM_FORMAT_NV12, full, 2, 0, none, bt709},
+         {uint32_t(w), uint32_t(h), DRM_FORMAT_ABGR8888, full, 30, 0, premult,
+          0}},
+        frames);
+  }
+
+  if (name == "camera") {
+    /* Sensor-oriented preview rotated by the display controller */
+    return MakeWorkload(
+        {{uint32_t(w), uint32_t(h), DRM_FORMAT_XBGR8888, full, 0, 0, none, 0},
+         {uint32_t(h), uint32_t(w), DRM_FORMAT_NV12, full, 1,
+          LayerTransform::kRotate90, none, bt709},
+         {uint32_t(w), kBarHeight, DRM_FORMAT_ABGR8888,
+          hwc_rect_t{0, 0, w, kBarHeight}, 0, 0, premult, 0}},
+        frames);
+  }
+
+  if (name == "overload") {
+    /* More layers than planes, exercises the client composition fallback */
+    constexpr int kWindows = 8;
+    std::vector<SynthLayer> stack;
+    stack.push_back(
+        {uint32_t(w), uint32_t(h), DRM_FORMAT_XBGR8888, full, 0, 0, none, 0});
+    for (int i = 0; i < kWindows - 1; i++) {
+      int32_t off = i * kBarHeight;
+      stack.push_back({uint32_t(w / 2), uint32_t(h / 2), DRM_FORMAT_ABGR8888,
+                       hwc_rect_t{off, off, off + w / 2, off + h / 2},
+                       uint32_t(i + 1), 0, premult, 0});
+    }
+    return MakeWorkload(stack, frames);
+  }
+
+  return {};
+}
+
+const std::vector<std::string> kSyntheticWorkloads = {"fullscreen", "home",
+                                                      "video", "camera",
+                                                      "overload"};
+
+auto LoadTrace(const std::string &path) -> std::optional<Workload> {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Can't open %s\n", path.c_str());
+    return {};
+  }
+
+  LayerTraceHeader header{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || header.magic != kLayerTraceMagic ||
+      header.version < kLayerTraceVersion || header.frame_record_size == 0 ||
+      header.layer_record_size == 0) {
+    fprintf(stderr, "%s is not a layer trace\n", path.c_str());
+    return {};
+  }
+
+  /* Records may grow in newer versions, read the known part only */
+  auto read_record = [&file](void *dst, size_t known_size,
+                             size_t record_size) {
+    file.read(static_cast<char *>(dst),
+              std::streamsize(std::min(known_size, record_size)));
+    if (record_size > known_size) {
+      file.seekg(std::streamoff(record_size - known_size), std::ios::cur);
+    }
+    return bool(file);
+  };
+
+  Workload workload;
+  for (;;) {
+    TraceFrame tf{};
+    if (!read_record(&tf.frame, sizeof(tf.frame), header.frame_record_size)) {
+      break;
+    }
+    tf.layers.resize(tf.frame.layers_num);
+    for (auto &tl : tf.layers) {
+      if (!read_record(&tl, sizeof(tl), header.layer_record_size)) {
+        fprintf(stderr, "%s: truncated frame %" PRIu64 "\n", path.c_str(),
+                tf.frame.frame_no);
+        return workload;
+      }
+    }
+
+    /* Only the primary display is modeled by the fake device */
+    if (tf.frame.display == kPrimaryDisplay) {
+      workload.emplace_back(std::move(tf));
+    }
+  }
+
+  return workload;
+}
+
+void PrintHeader() {
+  printf("%-24s %7s %9s %9s %9s %9s %9s %9s %8s %8s %8s %7s %7s\n",
+         "workload", "frames", "cpu_avg", "cpu_p50", "cpu_p99", "allocs",
+         "alloc_kb", "ioctls", "commits", "props", "tests", "fb_add",
+         "client");
+  printf("%-24s %7s %9s %9s %9s %9s %9s %9s %8s %8s %8s %7s %7s\n", "", "",
+         "us/frame", "us", "us", "/frame", "/frame", "/frame", "/frame",
+         "/commit", "/frame", "/frame", "%");
+}
+
+void PrintStats(const std::string &name, const FrameStats &s) {
+  auto per_frame = [&s](uint64_t v) {
+    return s.frames != 0 ? double(v) / double(s.frames) : 0.0;
+  };
+  constexpr double kBytesInKb = 1024.0;
+  constexpr double kPercent = 100.0;
+
+  printf("%-24s %7" PRIu64
+         " %9.1f %9.1f %9.1f %9.1f %9.2f %9.1f %8.2f %8.1f %8.2f %7.2f"
+         " %7.1f\n",
+         name.c_str(), s.frames,
+         per_frame(uint64_t(s.cpu_ns_total)) / double(kNsInUs),
+         double(s.cpu_ns.Percentile(50)) / double(kNsInUs),
+         double(s.cpu_ns.Percentile(99)) / double(kNsInUs),
+         per_frame(s.allocs), per_frame(s.alloc_bytes) / kBytesInKb,
+         per_frame(s.ioctls), per_frame(s.commits),
+         s.commits != 0 ? double(s.commit_props) / double(s.commits) : 0.0,
+         per_frame(s.test_commits),
+         per_frame(s.fbs_added), per_frame(s.client_frames) * kPercent);
+
+  if (s.failed_frames != 0) {
+    printf("%-24s %" PRIu64 " frames failed to validate or present\n", "",
+           s.failed_frames);
+  }
+}
+
+void Usage(const char *argv0) {
+  printf(
+      "Usage: %s [options] [trace...]\n"
+      "Replays layer-stack traces (or synthetic workloads if no trace is "
+      "given)\nagainst a fake DRM/KMS device.\n\n"
+      "  --workload NAME     synthetic workload to run, may be repeated\n"
+      "                      (fullscreen, home, video, camera, overload)\n"
+      "  --frames N          frames per synthetic workload (default 600)\n"
+      "  --warmup N          frames excluded from the stats (default 10)\n"
+      "  --overlays N        overlay planes of the fake device (default 3)\n"
+      "  --vblank            present fences follow a synthetic 60Hz vblank\n"
+      "  --max-cpu-us X      fail if avg CPU time per frame exceeds X\n"
+      "  --max-allocs X      fail if avg allocations per frame exceed X\n"
+      "  --max-ioctls X      fail if avg ioctls per frame exceed X\n",
+      argv0);
+}
+
+}  // namespace
+}  // namespace android
+
+int main(int argc, char *argv[]) {
+  using namespace android;
+
+  enum Opt { kWorkload = 1, kFrames, kWarmup, kOverlays, kVblank, kMaxCpu,
+             kMaxAllocs, kMaxIoctls, kHelp };
+  const struct option options[] = {
+      {"workload", required_argument, nullptr, kWorkload},
+      {"frames", required_argument, nullptr, kFrames},
+      {"warmup", required_argument, nullptr, kWarmup},
+      {"overlays", required_argument, nullptr, kOverlays},
+      {"vblank", no_argument, nullptr, kVblank},
+      {"max-cpu-us", required_argument, nullptr, kMaxCpu},
+      {"max-allocs", required_argument, nullptr, kMaxAllocs},
+      {"max-ioctls", required_argument, nullptr, kMaxIoctls},
+      {"help", no_argument, nullptr, kHelp},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  std::vector<std::string> workload_names;
+  uint32_t frames = 600;
+  uint64_t warmup = 10;
+  int overlays = 3;
+  bool vblank = false;
+  std::optional<double> max_cpu_us;
+  std::optional<double> max_allocs;
+  std::optional<double> max_ioctls;
+
+  int opt = 0;
+  while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+    switch (opt) {
+      case kWorkload:
+        workload_names.emplace_back(optarg);
+        break;
+      case kFrames:
+        frames = uint32_t(strtoul(optarg, nullptr, 0));
+        break;
+      case kWarmup:
+        warmup = strtoull(optarg, nullptr, 0);
+        break;
+      case kOverlays:
+        overlays = int(strtol(optarg, nullptr, 0));
+        break;
+      case kVblank:
+        vblank = true;
+        break;
+      case kMaxCpu:
+        max_cpu_us = strtod(optarg, nullptr);
+        break;
+      case kMaxAllocs:
+        max_allocs = strtod(optarg, nullptr);
+        break;
+      case kMaxIoctls:
+        max_ioctls = strtod(optarg, nullptr);
+        break;
+      case kHelp:
+        Usage(argv[0]);
+        return 0;
+      default:
+        Usage(argv[0]);
+        return -EINVAL;
+    }
+  }
+
+  auto config = FakeKms::DefaultConfig();
+  auto overlay = config.planes.back();
+  config.planes.resize(1 + std::max(overlays, 0), overlay);
+  config.vblank_timing = vblank;
+  FakeKms::Setup(config);
+  FakeKms::SetProperty("vendor.hwc.drm.device", FakeKms::GetDevicePath());
+
+  std::vector<std::pair<std::string, Workload>> workloads;
+  if (optind < argc) {
+    for (int i = optind; i < argc; i++) {
+      auto workload = LoadTrace(argv[i]);
+      if (!workload) {
+        return -EINVAL;
+      }
+      workloads.emplace_back(argv[i], std::move(*workload));
+    }
+  } else {
+    if (workload_names.empty()) {
+      workload_names = kSyntheticWorkloads;
+    }
+    for (auto &name : workload_names) {
+      auto workload = SyntheticWorkload(name, frames, int32_t(config.width),
+                                        int32_t(config.height));
+      if (!workload) {
+        fprintf(stderr, "Unknown workload %s\n", name.c_str());
+        return -EINVAL;
+      }
+      workloads.emplace_back(name, std::move(*workload));
+    }
+  }
+
+  auto bench = BenchDisplay::Create();
+  if (!bench) {
+    return -ENODEV;
+  }
+
+  printf("fake-kms: %ux%u@%u, %zu planes, %s fences\n", config.width,
+         config.height, config.refresh, config.planes.size(),
+         vblank ? "vblank" : "immediate");
+  PrintHeader();
+
+  int ret = 0;
+  for (auto &w : workloads) {
+    auto stats = bench->Run(w.second, warmup);
+    PrintStats(w.first, stats);
+
+    if (stats.frames == 0) {
+      continue;
+    }
+    auto n = double(stats.frames);
+    if ((max_cpu_us &&
+         double(stats.cpu_ns_total) / n / double(kNsInUs) > *max_cpu_us) ||
+        (max_allocs && double(stats.allocs) / n > *max_allocs) ||
+        (max_ioctls && double(stats.ioctls) / n > *max_ioctls)) {
+      fprintf(stderr, "%s: per-frame budget exceeded\n", w.first.c_str());
+      ret = 1;
+    }
+  }
+
+  /* The composer is not torn down: ~ResourceManager joins the uevent
+   * listener, which stays blocked in recv() until the next uevent.
+   */
+  // NOLINTNEXTLINE(bugprone-unused-return-value)
+  bench.release();
+  return ret;
+}
@@ -0,0 +1,48 @@
+#include "utils/InstrumentedMutex.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+using android::InstrumentedMutex;
+
+namespace {
+
+constexpr int64_t kNsInMs = 1000000;
+
+}  // namespace
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(InstrumentedMutexTest, RecordsHoldTime) {
+  InstrumentedMutex mutex;
+  {
+    const std::lock_guard<InstrumentedMutex> lock(mutex);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  ASSERT_TRUE(mutex.try_lock());
+  mutex.unlock();
+
+  EXPECT_EQ(mutex.GetHoldTimes().Count(), 2);
+  EXPECT_GE(mutex.GetHoldTimes().Percentile(100), 2 * kNsInMs);
+  EXPECT_EQ(mutex.GetWaitTimes().Count(), 0);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(InstrumentedMutexTest, RecordsContendedWaits) {
+  InstrumentedMutex mutex;
+  mutex.lock();
+
+  std::thread waiter([&mutex] {
+    const std::lock_guard<InstrumentedMutex> lock(mutex);
+  });
+  /* Gives the waiter time to block */
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+  waiter.join();
+
+  EXPECT_EQ(mutex.GetHoldTimes().Count(), 2);
+  ASSERT_EQ(mutex.GetWaitTimes().Count(), 1);
+  EXPECT_GE(mutex.GetWaitTimes().Percentile(100), kNsInMs);
+}
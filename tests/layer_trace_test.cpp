@@ -0,0 +1,145 @@
+#include "utils/LayerTraceRecorder.h"
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+using android::LayerTraceFrame;
+using android::LayerTraceHeader;
+using android::LayerTraceLayer;
+using android::LayerTraceRecorder;
+
+struct LayerTraceTest : public testing::Test {
+  static void AddFrame(LayerTraceRecorder &rec, uint64_t frame_no,
+                       uint32_t layers_num) {
+    auto *layers = rec.BeginFrame(layers_num);
+    ASSERT_NE(layers, nullptr);
+    rec.PendingFrame()->frame_no = frame_no;
+    for (uint32_t i = 0; i < layers_num; i++) {
+      layers[i] = {};
+      layers[i].layer_id = frame_no;
+      layers[i].z_order = i;
+    }
+    rec.EndFrame();
+  }
+
+  /* Parses the written trace, checks layer records belong to their frames */
+  static auto ReadFrameNumbers(const LayerTraceRecorder &rec)
+      -> std::vector<uint64_t> {
+    int fd = memfd_create("layer_trace_test", MFD_CLOEXEC);
+    EXPECT_GE(fd, 0);
+    LayerTraceHeader header{};
+    header.magic = android::kLayerTraceMagic;
+    EXPECT_EQ(rec.WriteTo(fd, header), 0);
+
+    auto size = lseek(fd, 0, SEEK_END);
+    std::vector<uint8_t> data(size);
+    EXPECT_EQ(pread(fd, data.data(), data.size(), 0), size);
+    close(fd);
+
+    std::vector<uint64_t> frame_numbers;
+    size_t pos = sizeof(LayerTraceHeader);
+    while (pos < data.size()) {
+      LayerTraceFrame frame{};
+      memcpy(&frame, &data[pos], sizeof(frame));
+      pos += sizeof(frame);
+      for (uint32_t i = 0; i < frame.layers_num; i++) {
+        LayerTraceLayer layer{};
+        memcpy(&layer, &data[pos], sizeof(layer));
+        pos += sizeof(layer);
+        EXPECT_EQ(layer.layer_id, frame.frame_no);
+        EXPECT_EQ(layer.z_order, i);
+      }
+      frame_numbers.emplace_back(frame.frame_no);
+    }
+    EXPECT_EQ(pos, data.size());
+    return frame_numbers;
+  }
+};
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(LayerTraceTest, DisabledRecordsNothing) {
+  LayerTraceRecorder rec;
+  ASSERT_FALSE(rec.IsEnabled());
+  ASSERT_EQ(rec.BeginFrame(1), nullptr);
+  ASSERT_EQ(rec.PendingFrame(), nullptr);
+  rec.EndFrame();
+  ASSERT_TRUE(rec.IsEmpty());
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(LayerTraceTest, PendingFrameIsRestarted) {
+  LayerTraceRecorder rec;
+  rec.Enable();
+  AddFrame(rec, 1, 3);
+
+  /* Validated twice, presented once */
+  rec.BeginFrame(5);
+  AddFrame(rec, 2, 2);
+
+  /* Validated, but never presented */
+  rec.BeginFrame(4);
+
+  ASSERT_EQ(ReadFrameNumbers(rec), (std::vector<uint64_t>{1, 2}));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(LayerTraceTest, FramesRingWraps) {
+  LayerTraceRecorder rec;
+  rec.Enable();
+  auto frames_num = LayerTraceRecorder::kFramesMax + 10;
+  for (uint64_t i = 0; i < frames_num; i++) {
+    AddFrame(rec, i, 1);
+  }
+
+  /* Pending frame takes the slot of the oldest one */
+  rec.BeginFrame(1);
+
+  auto frame_numbers = ReadFrameNumbers(rec);
+  ASSERT_EQ(frame_numbers.size(), LayerTraceRecorder::kFramesMax - 1);
+  ASSERT_EQ(frame_numbers.front(), 11);
+  ASSERT_EQ(frame_numbers.back(), frames_num - 1);
+  ASSERT_EQ(rec.FirstFrameNo(), 11);
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(LayerTraceTest, LayersRingDropsOverwrittenFrames) {
+  LayerTraceRecorder rec;
+  rec.Enable();
+  /* Does not divide the layers ring evenly, frames have to skip the tail */
+  constexpr uint32_t kLayersPerFrame = 100;
+  for (uint64_t i = 0; i < 300; i++) {
+    AddFrame(rec, i, kLayersPerFrame);
+  }
+
+  auto frame_numbers = ReadFrameNumbers(rec);
+  ASSERT_FALSE(frame_numbers.empty());
+  ASSERT_LE(frame_numbers.size() * kLayersPerFrame,
+            LayerTraceRecorder::kLayersMax);
+  ASSERT_EQ(frame_numbers.back(), 299);
+  for (size_t i = 1; i < frame_numbers.size(); i++) {
+    ASSERT_EQ(frame_numbers[i], frame_numbers[i - 1] + 1);
+  }
+
+  /* Started, not finished frame reuses the oldest layers */
+  rec.BeginFrame(LayerTraceRecorder::kLayersMax);
+  ASSERT_TRUE(ReadFrameNumbers(rec).empty());
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST_F(LayerTraceTest, ClearAndDisable) {
+  LayerTraceRecorder rec;
+  rec.Enable();
+  AddFrame(rec, 7, 2);
+  ASSERT_FALSE(rec.IsEmpty());
+
+  rec.Clear();
+  ASSERT_TRUE(rec.IsEmpty());
+  ASSERT_TRUE(ReadFrameNumbers(rec).empty());
+
+  AddFrame(rec, 8, 2);
+  rec.Disable();
+  ASSERT_FALSE(rec.IsEnabled());
+  ASSERT_TRUE(rec.IsEmpty());
+}
@@ -0,0 +1,83 @@
+#include "utils/SwapChainCache.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+using android::SwapChainCache;
+
+using Cache = SwapChainCache<std::shared_ptr<int>>;
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(SwapChainCacheTest, FindsAddedBuffers) {
+  Cache cache;
+  EXPECT_EQ(cache.Get(1), nullptr);
+
+  cache.Add(1, std::make_shared<int>(10));
+  cache.Add(2, std::make_shared<int>(20));
+  ASSERT_NE(cache.Get(1), nullptr);
+  EXPECT_EQ(**cache.Get(1), 10);
+  EXPECT_EQ(**cache.Get(2), 20);
+  EXPECT_TRUE(cache.Contains(2));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_FALSE(cache.Contains(2));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(SwapChainCacheTest, EvictsLeastRecentlyPresented) {
+  Cache cache;
+  for (uint64_t id = 1; id <= Cache::kCapacity; id++) {
+    cache.Add(id, std::make_shared<int>(int(id)));
+    cache.NextFrame(id);
+  }
+
+  /* The first one is presented again, the second one is replaced */
+  cache.NextFrame(1);
+  cache.Add(Cache::kCapacity + 1, std::make_shared<int>(0));
+  EXPECT_TRUE(cache.Contains(1));
+  EXPECT_FALSE(cache.Contains(2));
+  EXPECT_TRUE(cache.Contains(Cache::kCapacity + 1));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(SwapChainCacheTest, ReleasesIdleBuffers) {
+  Cache cache;
+  auto old_buffer = std::make_shared<int>(1);
+  std::weak_ptr<int> old_ref = old_buffer;
+  cache.Add(1, std::move(old_buffer));
+  cache.Add(2, std::make_shared<int>(2));
+  cache.NextFrame(1);
+
+  /* The swapchain is recreated, only the new buffers are presented */
+  for (uint64_t frame = 0; frame < Cache::kMaxIdleFrames; frame++) {
+    cache.Add(3, std::make_shared<int>(3));
+    cache.NextFrame(3);
+    EXPECT_FALSE(old_ref.expired());
+  }
+  cache.NextFrame(3);
+
+  EXPECT_TRUE(old_ref.expired());
+  EXPECT_FALSE(cache.Contains(1));
+  EXPECT_FALSE(cache.Contains(2));
+  EXPECT_TRUE(cache.Contains(3));
+}
+
+// NOLINTNEXTLINE: required by gtest macros
+TEST(SwapChainCacheTest, KeepsTheShownBuffer) {
+  Cache cache;
+  cache.Add(1, std::make_shared<int>(1));
+
+  /* A static layer keeps showing its buffer */
+  for (uint64_t frame = 0; frame < 4 * Cache::kMaxIdleFrames; frame++) {
+    cache.NextFrame(1);
+  }
+  EXPECT_TRUE(cache.Contains(1));
+
+  /* Until it has no buffer */
+  for (uint64_t frame = 0; frame <= Cache::kMaxIdleFrames; frame++) {
+    cache.NextFrame({});
+  }
+  EXPECT_FALSE(cache.Contains(1));
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DAMAGETRACKER_H_
+#define DAMAGETRACKER_H_
+
+#include <hardware/hwcomposer.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace android {
+
+/* Damage rects are in buffer coordinates, no value means the whole buffer */
+using Damage = std::optional<hwc_rect_t>;
+
+inline auto IsDamageEmpty(const hwc_rect_t &rect) -> bool {
+  return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+/* Bounding rect of both, empty rects are ignored */
+inline auto UniteDamage(const Damage &a, const Damage &b) -> Damage {
+  if (!a || !b) {
+    return {};
+  }
+  if (IsDamageEmpty(*a)) {
+    return b;
+  }
+  if (IsDamageEmpty(*b)) {
+    return a;
+  }
+  return hwc_rect_t{.left = std::min(a->left, b->left),
+                    .top = std::min(a->top, b->top),
+                    .right = std::max(a->right, b->right),
+                    .bottom = std::max(a->bottom, b->bottom)};
+}
+
+/*
+ * Damage of the buffers of a swapchain, accumulated over the buffer age.
+ *
+ * The damage given by the client describes the changes since the previous
+ * buffer. A buffer presented again has to be updated by the damage of all
+ * the buffers presented after it, the age of the buffer is found by its id.
+ * A buffer not found in the last kHistorySize ones is damaged as a whole.
+ */
+class DamageTracker {
+ public:
+  static constexpr size_t kHistorySize = 8;
+
+  /* Records the buffer presented next, returns its area changed since it was
+   * presented last time.
+   */
+  auto Present(uint64_t buffer_id, const Damage &damage) -> Damage {
+    Damage accumulated = damage;
+    bool found = false;
+    for (size_t i = 0; i < count_ && accumulated; i++) {
+      auto &entry = history_[(head_ + kHistorySize - i) % kHistorySize];
+      if (entry.buffer_id == buffer_id) {
+        found = true;
+        break;
+      }
+      accumulated = UniteDamage(accumulated, entry.damage);
+    }
+
+    head_ = (head_ + 1) % kHistorySize;
+    history_[head_] = {.buffer_id = buffer_id, .damage = damage};
+    count_ = std::min(count_ + 1, kHistorySize);
+
+    return found ? accumulated : Damage{};
+  }
+
+  /* The next buffers are damaged as a whole */
+  void Clear() {
+    count_ = 0;
+  }
+
+ private:
+  struct Entry {
+    uint64_t buffer_id;
+    Damage damage;
+  };
+
+  std::array<Entry, kHistorySize> history_{};
+  /* Index of the latest entry */
+  size_t head_{};
+  size_t count_{};
+};
+
+}  // namespace android
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GAMMALUT_H_
+#define GAMMALUT_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace android {
+
+/* Curve of a gamma LUT channel, contrast and brightness are applied first */
+struct GammaCurve {
+  /* -0.5 - 0.5 */
+  float brightness = 0.0F;
+  /* 0.0 - 2.0 */
+  float contrast = 1.0F;
+  float gamma = 1.0F;
+
+  auto operator==(const GammaCurve &other) const -> bool {
+    return brightness == other.brightness && contrast == other.contrast &&
+           gamma == other.gamma;
+  }
+};
+
+/*
+ * Contrast and brightness of count entries from index base of a size entries
+ * LUT, clamped to 0.0 - 1.0. Same code as the per-entry one it replaces: the
+ * float index is scaled in double precision.
+ */
+inline void ApplyContrastBrightnessScalar(const GammaCurve &curve, size_t size,
+                                          size_t base, size_t count,
+                                          float *out) {
+  for (size_t i = 0; i < count; i++) {
+    float value = float(base + i) / float(size);
+    float result = float((value - 0.5) * curve.contrast + 0.5 +
+                         curve.brightness);
+    out[i] = std::min(std::max(result, 0.0F), 1.0F);
+  }
+}
+
+/*
+ * Same as ApplyContrastBrightnessScalar(), 4 entries at a time with SSE2 or
+ * AArch64 NEON. The values are bit-exact: the lanes do the same IEEE
+ * operations in the same order and precision, with the double step on two
+ * pairs of lanes. Other targets (and the remainder) use the scalar code.
+ */
+inline void ApplyContrastBrightness(const GammaCurve &curve, size_t size,
+                                    size_t base, size_t count, float *out) {
+  size_t i = 0;
+  /* Indexes are converted from int32 lanes */
+  bool simd = size <= size_t(std::numeric_limits<int32_t>::max());
+
+#if defined(__SSE2__)
+  const __m128 divisor = _mm_set1_ps(float(size));
+  const __m128d half = _mm_set1_pd(0.5);
+  const __m128d contrast = _mm_set1_pd(curve.contrast);
+  const __m128d brightness = _mm_set1_pd(curve.brightness);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0F);
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+  for (; simd && i + 4 <= count; i += 4) {
+    __m128i index = _mm_add_epi32(_mm_set1_epi32(int32_t(base + i)), lanes);
+    __m128 value = _mm_div_ps(_mm_cvtepi32_ps(index), divisor);
+
+    __m128d low = _mm_cvtps_pd(value);
+    __m128d high = _mm_cvtps_pd(_mm_movehl_ps(value, value));
+    low = _mm_mul_pd(_mm_sub_pd(low, half), contrast);
+    low = _mm_add_pd(_mm_add_pd(low, half), brightness);
+    high = _mm_mul_pd(_mm_sub_pd(high, half), contrast);
+    high = _mm_add_pd(_mm_add_pd(high, half), brightness);
+
+    /* Operands ordered as std::max() and std::min() compare them */
+    __m128 result = _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+    result = _mm_min_ps(one, _mm_max_ps(zero, result));
+    _mm_storeu_ps(out + i, result);
+  }
+#elif defined(__aarch64__)
+  const float32x4_t divisor = vdupq_n_f32(float(size));
+  const float64x2_t half = vdupq_n_f64(0.5);
+  const float64x2_t contrast = vdupq_n_f64(curve.contrast);
+  const float64x2_t brightness = vdupq_n_f64(curve.brightness);
+  const float32x4_t zero = vdupq_n_f32(0.0F);
+  const float32x4_t one = vdupq_n_f32(1.0F);
+  const int32_t lane_index[] = {0, 1, 2, 3};
+  const int32x4_t lanes = vld1q_s32(lane_index);
+
+  for (; simd && i + 4 <= count; i += 4) {
+    int32x4_t index = vaddq_s32(vdupq_n_s32(int32_t(base + i)), lanes);
+    float32x4_t value = vdivq_f32(vcvtq_f32_s32(index), divisor);
+
+    /* Compilers contract the multiply-add of the scalar code on AArch64 */
+    float64x2_t low = vcvt_f64_f32(vget_low_f32(value));
+    float64x2_t high = vcvt_high_f64_f32(value);
+    low = vfmaq_f64(half, vsubq_f64(low, half), contrast);
+    low = vaddq_f64(low, brightness);
+    high = vfmaq_f64(half, vsubq_f64(high, half), contrast);
+    high = vaddq_f64(high, brightness);
+
+    float32x4_t result = vcvt_high_f32_f64(vcvt_f32_f64(low), high);
+    result = vminq_f32(vmaxq_f32(result, zero), one);
+    vst1q_f32(out + i, result);
+  }
+#endif
+
+  ApplyContrastBrightnessScalar(curve, size, base + i, count - i, out + i);
+}
+
+/*
+ * Computes the 16-bit entries of a gamma LUT channel, entry 0 is always
+ * black. store(index, value) is called for every entry.
+ *
+ * The values are the same as of the per-entry float code it replaces.
+ * Entries are done in blocks: contrast and brightness with
+ * ApplyContrastBrightness(), then the scaling to 16 bits, which the compiler
+ * vectorizes. The gamma step keeps pow() to stay exact, it is skipped for the
+ * gamma of 1, which doesn't change the values.
+ */
+template <typename Store>
+void BuildGammaCurve(const GammaCurve &curve, size_t size, Store &&store) {
+  constexpr size_t kBlockSize = 64;
+  constexpr float kMaxEntry = 0xFFFF;
+
+  if (size == 0) {
+    return;
+  }
+  store(0, uint16_t(0));
+
+  std::array<float, kBlockSize> block{};
+  for (size_t base = 1; base < size; base += kBlockSize) {
+    auto count = std::min(kBlockSize, size - base);
+
+    ApplyContrastBrightness(curve, size, base, count, block.data());
+
+    if (curve.gamma != 1.0F) {
+      for (size_t i = 0; i < count; i++) {
+        float result = pow(block[i], curve.gamma);
+        block[i] = std::min(std::max(result, 0.0F), 1.0F);
+      }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      store(base + i, uint16_t(kMaxEntry * block[i]));
+    }
+  }
+}
+
+/* Entries with red, green and blue members, e.g. drm_color_lut */
+template <typename Entry>
+void BuildGammaLut(const std::array<GammaCurve, 3> &curves, size_t size,
+                   Entry *lut) {
+  BuildGammaCurve(curves[0], size,
+                  [lut](size_t i, uint16_t value) { lut[i].red = value; });
+
+  /* Channels usually share the curve */
+  if (curves[1] == curves[0]) {
+    for (size_t i = 0; i < size; i++) {
+      lut[i].green = lut[i].red;
+    }
+  } else {
+    BuildGammaCurve(curves[1], size,
+                    [lut](size_t i, uint16_t value) { lut[i].green = value; });
+  }
+
+  if (curves[2] == curves[0]) {
+    for (size_t i = 0; i < size; i++) {
+      lut[i].blue = lut[i].red;
+    }
+  } else {
+    BuildGammaCurve(curves[2], size,
+                    [lut](size_t i, uint16_t value) { lut[i].blue = value; });
+  }
+}
+
+}  // namespace android
+
+#endif
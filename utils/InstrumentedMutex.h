@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INSTRUMENTEDMUTEX_H_
+#define INSTRUMENTEDMUTEX_H_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "LatencyHistogram.h"
+
+namespace android {
+
+/*
+ * Mutex which records how long it is held and how long the contending
+ * threads wait for it. Both histograms may be read without the lock.
+ */
+class InstrumentedMutex {
+ public:
+  void lock() {
+    if (!mutex_.try_lock()) {
+      auto wait_start_ns = Now();
+      mutex_.lock();
+      locked_ns_ = Now();
+      wait_ns_.Record(locked_ns_ - wait_start_ns);
+      return;
+    }
+    locked_ns_ = Now();
+  }
+
+  auto try_lock() -> bool {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    locked_ns_ = Now();
+    return true;
+  }
+
+  void unlock() {
+    hold_ns_.Record(Now() - locked_ns_);
+    mutex_.unlock();
+  }
+
+  auto GetHoldTimes() const -> const LatencyHistogram & {
+    return hold_ns_;
+  }
+
+  /* Only the contended locking is recorded */
+  auto GetWaitTimes() const -> const LatencyHistogram & {
+    return wait_ns_;
+  }
+
+ private:
+  static auto Now() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  std::mutex mutex_;
+  /* Written by the owner only */
+  int64_t locked_ns_{};
+  LatencyHistogram hold_ns_;
+  LatencyHistogram wait_ns_;
+};
+
+}  // namespace android
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LATENCYHISTOGRAM_H_
+#define LATENCYHISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace android {
+
+/*
+ * Fixed-bucket latency histogram.
+ *
+ * Buckets are spaced logarithmically with 4 sub-buckets per power of two
+ * (relative error below 25%), covering 1us .. ~1min. Recording is a single
+ * relaxed atomic increment, so it is safe to call from any thread without
+ * locking.
+ */
+class LatencyHistogram {
+ public:
+  LatencyHistogram() = default;
+
+  LatencyHistogram(const LatencyHistogram &other) {
+    *this = other;
+  }
+
+  LatencyHistogram &operator=(const LatencyHistogram &other) {
+    if (this != &other) {
+      for (size_t i = 0; i < kBucketsNum; i++) {
+        buckets_[i].store(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      }
+    }
+    return *this;
+  }
+
+  void Record(int64_t duration_ns) {
+    buckets_[BucketIndex(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  auto minus(const LatencyHistogram &b) const {
+    LatencyHistogram res;
+    for (size_t i = 0; i < kBucketsNum; i++) {
+      res.buckets_[i].store(buckets_[i].load(std::memory_order_relaxed) -
+                                b.buckets_[i].load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    }
+    return res;
+  }
+
+  auto Count() const {
+    uint64_t count = 0;
+    for (const auto &bucket : buckets_) {
+      count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  /* Returns upper bound of the bucket holding the percentile, in ns */
+  auto Percentile(unsigned percent) const -> int64_t {
+    uint64_t count = Count();
+    if (count == 0) {
+      return 0;
+    }
+
+    uint64_t target = (count * percent + 99) / 100;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < kBucketsNum; i++) {
+      acc += buckets_[i].load(std::memory_order_relaxed);
+      if (acc >= target) {
+        return BucketUpperBoundUs(i) * kNsInUs;
+      }
+    }
+
+    return BucketUpperBoundUs(kBucketsNum - 1) * kNsInUs;
+  }
+
+ private:
+  static constexpr int64_t kNsInUs = 1000;
+  static constexpr int kSubBucketsShift = 2;
+  static constexpr int kSubBuckets = 1 << kSubBucketsShift;
+  static constexpr int kMaxLog2 = 26;
+  static constexpr size_t kBucketsNum = (kMaxLog2 + 1) * kSubBuckets;
+
+  static auto BucketIndex(int64_t duration_ns) -> size_t {
+    auto us = uint64_t(duration_ns > 0 ? duration_ns / kNsInUs : 0);
+    if (us < kSubBuckets) {
+      return us;
+    }
+
+    int log2 = 63 - __builtin_clzll(us);
+    if (log2 > kMaxLog2) {
+      return kBucketsNum - 1;
+    }
+
+    auto sub = (us >> (log2 - kSubBucketsShift)) & (kSubBuckets - 1);
+    return size_t(log2) * kSubBuckets + sub;
+  }
+
+  static auto BucketUpperBoundUs(size_t index) -> int64_t {
+    if (index < kSubBuckets) {
+      return int64_t(index);
+    }
+
+    auto log2 = int(index / kSubBuckets);
+    auto sub = int64_t(index % kSubBuckets);
+    return ((kSubBuckets + sub + 1) << (log2 - kSubBucketsShift)) - 1;
+  }
+
+  std::array<std::atomic<uint32_t>, kBucketsNum> buckets_{};
+};
+
+}  // namespace android
+
+#endif
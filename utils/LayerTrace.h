@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LAYERTRACE_H_
+#define LAYERTRACE_H_
+
+#include <cstdint>
+
+namespace android {
+
+/*
+ * Binary layer-stack trace format.
+ *
+ * File starts with LayerTraceHeader, followed by the frames. Every frame is a
+ * LayerTraceFrame record immediately followed by |layers_num| LayerTraceLayer
+ * records. All the fields are in host byte order. Readers must use the record
+ * sizes from the header to skip unknown trailing fields of newer versions.
+ */
+constexpr uint32_t kLayerTraceMagic = 0x544c5748; /* 'HWLT' */
+constexpr uint32_t kLayerTraceVersion = 1;
+
+struct LayerTraceHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t frame_record_size;
+  uint32_t layer_record_size;
+  uint32_t display_width;
+  uint32_t display_height;
+  uint32_t vsync_period_ns;
+  uint32_t reserved;
+};
+
+struct LayerTraceFrame {
+  uint64_t frame_no;
+  /* CLOCK_MONOTONIC, ns */
+  int64_t validate_start_ns;
+  int64_t validate_end_ns;
+  int64_t present_start_ns;
+  int64_t commit_done_ns;
+  uint32_t display;
+  uint32_t layers_num;
+  /* HWC2::Error */
+  int32_t validate_error;
+  int32_t present_error;
+};
+
+struct LayerTraceLayer {
+  uint64_t layer_id;
+  /* BufferUniqueId, 0 if the layer has no buffer */
+  uint64_t buffer_id;
+  /* Acquire fence signal time, 0 if no fence, -1 if not signaled at present */
+  int64_t acquire_fence_ns;
+  uint32_t buffer_width;
+  uint32_t buffer_height;
+  /* DRM_FORMAT_* */
+  uint32_t buffer_format;
+  uint32_t z_order;
+  /* HWC2::Composition requested by the client and after the validation */
+  int32_t sf_type;
+  int32_t validated_type;
+  /* left, top, right, bottom */
+  float source_crop[4];
+  int32_t display_frame[4];
+  /* LayerTransform */
+  uint32_t transform;
+  uint16_t alpha;
+  /* BufferBlendMode, BufferColorSpace, BufferSampleRange */
+  uint8_t blend_mode;
+  uint8_t color_space;
+  uint8_t sample_range;
+  uint8_t reserved[7];
+};
+
+static_assert(sizeof(LayerTraceHeader) == 32, "Trace format changed");
+static_assert(sizeof(LayerTraceFrame) == 56, "Trace format changed");
+static_assert(sizeof(LayerTraceLayer) == 96, "Trace format changed");
+
+}  // namespace android
+
+#endif
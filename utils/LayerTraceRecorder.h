@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LAYERTRACERECORDER_H_
+#define LAYERTRACERECORDER_H_
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+
+#include "LayerTrace.h"
+
+namespace android {
+
+/*
+ * Ring of the most recent LayerTrace frames.
+ *
+ * Storage is allocated by Enable() and released by Disable(), recording itself
+ * never allocates. Layer records of every frame are kept contiguous, so a frame
+ * is dropped as a whole once its layers get overwritten.
+ *
+ * A frame is started by BeginFrame() and becomes a part of the trace after
+ * EndFrame(). Starting a new frame without ending the pending one restarts it
+ * in place (e.g. when the frame is validated more than once).
+ */
+class LayerTraceRecorder {
+ public:
+  static constexpr uint32_t kFramesMax = 512;
+  static constexpr uint32_t kLayersMax = 8192;
+
+  void Enable() {
+    if (IsEnabled()) {
+      return;
+    }
+    frames_.resize(kFramesMax);
+    layers_.resize(kLayersMax);
+    Clear();
+  }
+
+  void Disable() {
+    frames_ = {};
+    layers_ = {};
+    Clear();
+  }
+
+  auto IsEnabled() const -> bool {
+    return !frames_.empty();
+  }
+
+  auto IsEmpty() const -> bool {
+    return frames_ended_ == 0;
+  }
+
+  void Clear() {
+    frames_ended_ = 0;
+    layers_pos_ = 0;
+    layers_end_ = 0;
+    pending_ = false;
+  }
+
+  /* Returns storage for |layers_num| layer records of the new frame */
+  auto BeginFrame(uint32_t layers_num) -> LayerTraceLayer * {
+    if (!IsEnabled() || layers_num > kLayersMax) {
+      pending_ = false;
+      return nullptr;
+    }
+
+    auto pos = layers_pos_;
+    if (pos % kLayersMax + layers_num > kLayersMax) {
+      pos += kLayersMax - pos % kLayersMax;
+    }
+
+    auto &slot = frames_[frames_ended_ % kFramesMax];
+    slot.frame = {};
+    slot.frame.layers_num = layers_num;
+    slot.first_layer = pos;
+    layers_end_ = std::max(layers_end_, pos + layers_num);
+    pending_ = true;
+
+    return &layers_[pos % kLayersMax];
+  }
+
+  auto PendingFrame() -> LayerTraceFrame * {
+    return pending_ ? &frames_[frames_ended_ % kFramesMax].frame : nullptr;
+  }
+
+  auto PendingLayers() -> LayerTraceLayer * {
+    if (!pending_) {
+      return nullptr;
+    }
+    return &layers_[frames_[frames_ended_ % kFramesMax].first_layer %
+                    kLayersMax];
+  }
+
+  void EndFrame() {
+    if (!pending_) {
+      return;
+    }
+    auto &slot = frames_[frames_ended_ % kFramesMax];
+    layers_pos_ = slot.first_layer + slot.frame.layers_num;
+    frames_ended_++;
+    pending_ = false;
+  }
+
+  /* Number of the first frame still in the ring */
+  auto FirstFrameNo() const -> uint64_t {
+    auto first = FirstValidSlot();
+    return first < frames_ended_ ? frames_[first % kFramesMax].frame.frame_no
+                                 : 0;
+  }
+
+  /* Writes |header| and the ended frames, oldest first */
+  auto WriteTo(int fd, const LayerTraceHeader &header) const -> int {
+    if (!Write(fd, &header, sizeof(header))) {
+      return -errno;
+    }
+
+    for (auto i = FirstValidSlot(); i < frames_ended_; i++) {
+      const auto &slot = frames_[i % kFramesMax];
+      if (!Write(fd, &slot.frame, sizeof(slot.frame)) ||
+          !Write(fd, &layers_[slot.first_layer % kLayersMax],
+                 sizeof(LayerTraceLayer) * slot.frame.layers_num)) {
+        return -errno;
+      }
+    }
+
+    return 0;
+  }
+
+ private:
+  struct FrameSlot {
+    LayerTraceFrame frame;
+    /* Position in the layers ring, not wrapped */
+    uint64_t first_layer;
+  };
+
+  auto FirstValidSlot() const -> uint64_t {
+    /* One slot is always reserved for the pending frame */
+    auto first = frames_ended_ >= kFramesMax ? frames_ended_ - kFramesMax + 1
+                                             : 0;
+    while (first < frames_ended_ &&
+           frames_[first % kFramesMax].first_layer + kLayersMax < layers_end_) {
+      first++;
+    }
+    return first;
+  }
+
+  static auto Write(int fd, const void *data, size_t size) -> bool {
+    return write(fd, data, size) == ssize_t(size);
+  }
+
+  std::vector<FrameSlot> frames_;
+  std::vector<LayerTraceLayer> layers_;
+  uint64_t frames_ended_{};
+  uint64_t layers_pos_{};
+  /* End of the layers written so far, including the pending frame */
+  uint64_t layers_end_{};
+  bool pending_{};
+};
+
+}  // namespace android
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SWAPCHAINCACHE_H_
+#define SWAPCHAINCACHE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace android {
+
+/*
+ * Imported buffers of a layer by their unique id, in any order. Once full,
+ * the least recently presented one is replaced.
+ *
+ * The elements hold the buffer references (GEM handles and framebuffers),
+ * so the ones of buffers the producer has dropped (a swapchain recreated on
+ * resize, a replaced decoder pool) are released after they have not been
+ * presented for kMaxIdleFrames frames.
+ */
+template <typename T>
+class SwapChainCache {
+ public:
+  static constexpr size_t kCapacity = 8;
+  static constexpr uint64_t kMaxIdleFrames = 2 * kCapacity;
+
+  auto Get(uint64_t unique_id) -> T * {
+    int index = Find(unique_id);
+    if (index < 0) {
+      return nullptr;
+    }
+
+    auto &el = elements_[index];
+    el.last_presented = frame_;
+    return &el.value;
+  }
+
+  auto Contains(uint64_t unique_id) const -> bool {
+    return Find(unique_id) >= 0;
+  }
+
+  void Add(uint64_t unique_id, T value) {
+    int index = Find(unique_id);
+    if (index < 0) {
+      /* Free elements have never been presented, they are taken first */
+      index = 0;
+      for (size_t i = 1; i < kCapacity; i++) {
+        if (elements_[i].last_presented < elements_[index].last_presented) {
+          index = int(i);
+        }
+      }
+      ids_[index] = unique_id;
+    }
+
+    auto &el = elements_[index];
+    el.value = std::move(value);
+    el.last_presented = frame_;
+  }
+
+  /* Call for every presented frame, with the buffer the layer shows */
+  void NextFrame(std::optional<uint64_t> unique_id) {
+    frame_++;
+    if (unique_id) {
+      Get(*unique_id);
+    }
+
+    for (size_t i = 0; i < kCapacity; i++) {
+      auto &el = elements_[i];
+      if (ids_[i] != 0 && el.last_presented + kMaxIdleFrames < frame_) {
+        ids_[i] = 0;
+        el = {};
+      }
+    }
+  }
+
+  void Clear() {
+    ids_.fill(0);
+    elements_.fill({});
+  }
+
+ private:
+  struct Element {
+    T value{};
+    uint64_t last_presented{};
+  };
+
+  auto Find(uint64_t unique_id) const -> int {
+    for (size_t i = 0; i < kCapacity; i++) {
+      if (ids_[i] == unique_id) {
+        return int(i);
+      }
+    }
+    return -1;
+  }
+
+  /* Ids are kept apart to be scanned quickly, 0 marks a free element */
+  std::array<uint64_t, kCapacity> ids_{};
+  std::array<Element, kCapacity> elements_;
+  /* Starts at 1, free elements are the least recently presented */
+  uint64_t frame_ = 1;
+};
+
+}  // namespace android
+
+#endif
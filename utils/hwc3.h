@@ -48,10 +48,16 @@ enum class Error : int32_t {
 
 typedef enum {
     HWC3_FUNCTION_SET_EXPECTED_PRESENT_TIME = HWC2_FUNCTION_GET_LAYER_GENERIC_METADATA_KEY + 1,
+    HWC3_FUNCTION_SET_LAYER_SLOT_BUFFER,
 }hwc3_function_descriptor_t;
 
 typedef int32_t /*hwc_error_t*/ (*HWC3_PFN_SET_EXPECTED_PRESENT_TIME)(hwc2_device_t* device,
         hwc2_display_t display, const std::optional<ClockMonotonicTimestamp>& expectedPresentTime);
+/* setLayerBuffer, reused is true if the handle comes from the slot cache of the composer
+ * (it was passed before), false if it has just been imported into the slot */
+typedef int32_t /*hwc_error_t*/ (*HWC3_PFN_SET_LAYER_SLOT_BUFFER)(hwc2_device_t* device,
+        hwc2_display_t display, hwc2_layer_t layer, buffer_handle_t buffer,
+        int32_t acquireFence, bool reused);
 }  // namespace HWC3
 
 #endif